@@ -0,0 +1,72 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Mock OFX host: the part of the OFX C API used by the support library.
+ */
+
+#ifndef openfx_supportext_bench_ofxCore_h
+#define openfx_supportext_bench_ofxCore_h
+
+#include <climits>
+#include <cstddef>
+
+typedef int OfxStatus;
+
+#define kOfxStatOK 0
+#define kOfxStatFailed ( (int)1 )
+#define kOfxStatErrFatal ( (int)2 )
+#define kOfxStatErrUnknown ( (int)3 )
+#define kOfxStatErrMissingHostFeature ( (int)4 )
+#define kOfxStatErrUnsupported ( (int)5 )
+#define kOfxStatErrExists ( (int)6 )
+#define kOfxStatErrFormat ( (int)7 )
+#define kOfxStatErrMemory ( (int)8 )
+#define kOfxStatErrBadHandle ( (int)9 )
+#define kOfxStatErrBadIndex ( (int)10 )
+#define kOfxStatErrValue ( (int)11 )
+
+#define kOfxFlagInfiniteMax INT_MAX
+#define kOfxFlagInfiniteMin INT_MIN
+
+struct OfxPointI
+{
+    int x, y;
+};
+
+struct OfxPointD
+{
+    double x, y;
+};
+
+struct OfxRangeD
+{
+    double min, max;
+};
+
+struct OfxRectI
+{
+    int x1, y1, x2, y2;
+};
+
+struct OfxRectD
+{
+    double x1, y1, x2, y2;
+};
+
+#endif // ifndef openfx_supportext_bench_ofxCore_h
@@ -0,0 +1,275 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Mock OFX host: the images, image memory and effects of the OFX Support library.
+ *
+ * Only the members used by the support library are declared, with the same signatures as in the
+ * OFX Support library. Images are built by the benchmarks from their own pixel buffers, and the
+ * parameter descriptors are only declared, since the describe functions are never called.
+ */
+
+#ifndef openfx_supportext_bench_ofxsImageEffect_h
+#define openfx_supportext_bench_ofxsImageEffect_h
+
+#include <cassert>
+#include <cstddef>
+#include <exception>
+#include <string>
+
+#include "ofxCore.h"
+
+namespace OFX {
+enum PixelComponentEnum
+{
+    ePixelComponentNone,
+    ePixelComponentRGBA,
+    ePixelComponentRGB,
+    ePixelComponentAlpha,
+    ePixelComponentCustom
+};
+
+enum BitDepthEnum
+{
+    eBitDepthNone,
+    eBitDepthUByte,
+    eBitDepthUShort,
+    eBitDepthHalf,
+    eBitDepthFloat,
+    eBitDepthCustom
+};
+
+enum LayoutHintEnum
+{
+    eLayoutHintNormal,
+    eLayoutHintNoNewLine,
+    eLayoutHintDivider
+};
+
+namespace Exception {
+/** @brief exception thrown when a suite returns an error status */
+class Suite
+    : public std::exception
+{
+    OfxStatus _status;
+
+public:
+    explicit Suite(OfxStatus s)
+        : _status(s)
+    {
+    }
+
+    OfxStatus status() const
+    {
+        return _status;
+    }
+
+    virtual const char* what() const throw()
+    {
+        return "OFX suite error";
+    }
+};
+} // namespace Exception
+
+/** @brief throws an OFX::Exception::Suite */
+void throwSuiteStatusException(OfxStatus stat);
+
+/** @brief an effect instance. The mock host never aborts a render. */
+class ImageEffect
+{
+public:
+    ImageEffect() {}
+
+    virtual ~ImageEffect() {}
+
+    bool abort() const
+    {
+        return false;
+    }
+};
+
+/** @brief an image, which does not own its pixels */
+class ImageBase
+{
+protected:
+    void* _pixelData;
+    OfxRectI _bounds;
+    PixelComponentEnum _pixelComponents;
+    int _pixelComponentCount;
+    BitDepthEnum _pixelDepth;
+    int _rowBytes;
+    int _pixelBytes;
+
+public:
+    ImageBase(void* pixelData,
+              const OfxRectI & bounds,
+              PixelComponentEnum pixelComponents,
+              BitDepthEnum pixelDepth,
+              int rowBytes);
+
+    virtual ~ImageBase() {}
+
+    OfxRectI getBounds() const
+    {
+        return _bounds;
+    }
+
+    OfxRectI getRegionOfDefinition() const
+    {
+        return _bounds;
+    }
+
+    int getRowBytes() const
+    {
+        return _rowBytes;
+    }
+
+    PixelComponentEnum getPixelComponents() const
+    {
+        return _pixelComponents;
+    }
+
+    int getPixelComponentCount() const
+    {
+        return _pixelComponentCount;
+    }
+
+    BitDepthEnum getPixelDepth() const
+    {
+        return _pixelDepth;
+    }
+
+    OfxPointD getRenderScale() const
+    {
+        OfxPointD s = { 1., 1. };
+
+        return s;
+    }
+
+    double getPixelAspectRatio() const
+    {
+        return 1.;
+    }
+};
+
+class Image
+    : public ImageBase
+{
+public:
+    Image(void* pixelData,
+          const OfxRectI & bounds,
+          PixelComponentEnum pixelComponents,
+          BitDepthEnum pixelDepth,
+          int rowBytes)
+        : ImageBase(pixelData, bounds, pixelComponents, pixelDepth, rowBytes)
+    {
+    }
+
+    void* getPixelData() const
+    {
+        return _pixelData;
+    }
+
+    /** @brief the address of pixel (x,y), or NULL if it is outside the bounds */
+    void* getPixelAddress(int x,
+                          int y) const
+    {
+        if ( (x < _bounds.x1) || (x >= _bounds.x2) || (y < _bounds.y1) || (y >= _bounds.y2) ) {
+            return NULL;
+        }
+
+        return (char*)_pixelData + (ptrdiff_t)(y - _bounds.y1) * _rowBytes + (ptrdiff_t)(x - _bounds.x1) * _pixelBytes;
+    }
+};
+
+/** @brief memory allocated by the host */
+class ImageMemory
+{
+    void* _ptr;
+
+public:
+    ImageMemory(size_t nBytes,
+                ImageEffect* associatedEffect = 0);
+
+    ~ImageMemory();
+
+    void* lock();
+
+    void unlock() {}
+};
+
+class ParamDescriptor
+{
+public:
+    void setLabel(const std::string &label);
+    void setHint(const std::string &hint);
+    void setLayoutHint(LayoutHintEnum layoutHint);
+    void setIsSecret(bool v);
+    void setAnimates(bool v);
+    void setEvaluateOnChange(bool v);
+};
+
+class BooleanParamDescriptor
+    : public ParamDescriptor
+{
+public:
+    void setDefault(bool v);
+};
+
+class ChoiceParamDescriptor
+    : public ParamDescriptor
+{
+public:
+    void appendOption(const std::string &v, const std::string &label = "");
+    int getNOptions();
+    void setDefault(int v);
+};
+
+class DoubleParamDescriptor
+    : public ParamDescriptor
+{
+public:
+    void setDefault(double v);
+    void setRange(double min, double max);
+    void setDisplayRange(double min, double max);
+    void setIncrement(double v);
+};
+
+class PageParamDescriptor
+{
+public:
+    void addChild(const ParamDescriptor &p);
+};
+
+class ImageEffectDescriptor
+{
+public:
+    BooleanParamDescriptor* defineBooleanParam(const std::string &name);
+    ChoiceParamDescriptor* defineChoiceParam(const std::string &name);
+    DoubleParamDescriptor* defineDoubleParam(const std::string &name);
+};
+
+struct ImageEffectHostDescription
+{
+    std::string hostName;
+};
+
+ImageEffectHostDescription* getImageEffectHostDescription();
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_bench_ofxsImageEffect_h
@@ -0,0 +1,269 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Mock OFX host: implementation of the mock suites, with POSIX threads.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMultiThread.h"
+#include "ofxsProcessing.H"
+
+namespace {
+unsigned int gNumCPUs = 0;
+pthread_key_t gThreadIndexKey;
+pthread_once_t gThreadIndexKeyOnce = PTHREAD_ONCE_INIT;
+
+void
+createThreadIndexKey()
+{
+    pthread_key_create(&gThreadIndexKey, NULL);
+}
+
+struct ThreadArgs
+{
+    OFX::MultiThread::Processor* processor;
+    unsigned int threadId;
+    unsigned int nThreads;
+};
+
+void*
+threadFunction(void* p)
+{
+    const ThreadArgs* args = (const ThreadArgs*)p;
+
+    // the index is stored plus one, so that the main thread (NULL) is not a spawned thread
+    pthread_setspecific( gThreadIndexKey, (void*)(size_t)(args->threadId + 1) );
+    args->processor->multiThreadFunction(args->threadId, args->nThreads);
+
+    return NULL;
+}
+} // anonymous namespace
+
+void
+OFX::throwSuiteStatusException(OfxStatus stat)
+{
+    throw OFX::Exception::Suite(stat);
+}
+
+OFX::ImageBase::ImageBase(void* pixelData,
+                          const OfxRectI & bounds,
+                          PixelComponentEnum pixelComponents,
+                          BitDepthEnum pixelDepth,
+                          int rowBytes)
+    : _pixelData(pixelData)
+    , _bounds(bounds)
+    , _pixelComponents(pixelComponents)
+    , _pixelComponentCount(0)
+    , _pixelDepth(pixelDepth)
+    , _rowBytes(rowBytes)
+    , _pixelBytes(0)
+{
+    switch (pixelComponents) {
+    case ePixelComponentRGBA:
+        _pixelComponentCount = 4;
+        break;
+    case ePixelComponentRGB:
+        _pixelComponentCount = 3;
+        break;
+    case ePixelComponentAlpha:
+        _pixelComponentCount = 1;
+        break;
+    default:
+        throwSuiteStatusException(kOfxStatErrFormat);
+    }
+    switch (pixelDepth) {
+    case eBitDepthUByte:
+        _pixelBytes = _pixelComponentCount;
+        break;
+    case eBitDepthUShort:
+    case eBitDepthHalf:
+        _pixelBytes = 2 * _pixelComponentCount;
+        break;
+    case eBitDepthFloat:
+        _pixelBytes = 4 * _pixelComponentCount;
+        break;
+    default:
+        throwSuiteStatusException(kOfxStatErrFormat);
+    }
+}
+
+OFX::ImageMemory::ImageMemory(size_t nBytes,
+                              ImageEffect* /*associatedEffect*/)
+    : _ptr( std::malloc(nBytes) )
+{
+    if (!_ptr) {
+        throw std::bad_alloc();
+    }
+}
+
+OFX::ImageMemory::~ImageMemory()
+{
+    std::free(_ptr);
+}
+
+void*
+OFX::ImageMemory::lock()
+{
+    return _ptr;
+}
+
+unsigned int
+OFX::MultiThread::getNumCPUs()
+{
+    if (gNumCPUs > 0) {
+        return gNumCPUs;
+    }
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (n > 0) ? (unsigned int)n : 1;
+}
+
+void
+OFX::MultiThread::setNumCPUs(unsigned int nCPUs)
+{
+    gNumCPUs = nCPUs;
+}
+
+unsigned int
+OFX::MultiThread::getThreadIndex()
+{
+    pthread_once(&gThreadIndexKeyOnce, createThreadIndexKey);
+    size_t i = (size_t)pthread_getspecific(gThreadIndexKey);
+
+    return (i > 0) ? (unsigned int)(i - 1) : 0;
+}
+
+bool
+OFX::MultiThread::isSpawnedThread()
+{
+    pthread_once(&gThreadIndexKeyOnce, createThreadIndexKey);
+
+    return pthread_getspecific(gThreadIndexKey) != NULL;
+}
+
+void
+OFX::MultiThread::Processor::multiThread(unsigned int nCPUs)
+{
+    if (nCPUs == 0) {
+        nCPUs = getNumCPUs();
+    }
+    if (nCPUs <= 1) {
+        multiThreadFunction(0, 1);
+
+        return;
+    }
+    pthread_once(&gThreadIndexKeyOnce, createThreadIndexKey);
+    std::vector<pthread_t> threads(nCPUs);
+    std::vector<ThreadArgs> args(nCPUs);
+    for (unsigned int i = 0; i < nCPUs; ++i) {
+        args[i].processor = this;
+        args[i].threadId = i;
+        args[i].nThreads = nCPUs;
+        if (pthread_create(&threads[i], NULL, threadFunction, &args[i]) != 0) {
+            // could not spawn the thread: run it here
+            pthread_setspecific( gThreadIndexKey, (void*)(size_t)(i + 1) );
+            multiThreadFunction(i, nCPUs);
+            pthread_setspecific(gThreadIndexKey, NULL);
+            threads[i] = pthread_self();
+        }
+    }
+    for (unsigned int i = 0; i < nCPUs; ++i) {
+        if ( !pthread_equal( threads[i], pthread_self() ) ) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+OFX::MultiThread::Mutex::Mutex(int /*lockCount*/)
+    : _handle(0)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutex_t* m = new pthread_mutex_t;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(m, &attr);
+    pthread_mutexattr_destroy(&attr);
+    _handle = m;
+}
+
+OFX::MultiThread::Mutex::~Mutex()
+{
+    pthread_mutex_t* m = (pthread_mutex_t*)_handle;
+
+    pthread_mutex_destroy(m);
+    delete m;
+}
+
+void
+OFX::MultiThread::Mutex::lock()
+{
+    pthread_mutex_lock( (pthread_mutex_t*)_handle );
+}
+
+void
+OFX::MultiThread::Mutex::unlock()
+{
+    pthread_mutex_unlock( (pthread_mutex_t*)_handle );
+}
+
+bool
+OFX::MultiThread::Mutex::tryLock()
+{
+    return pthread_mutex_trylock( (pthread_mutex_t*)_handle ) == 0;
+}
+
+void
+OFX::ImageProcessor::multiThreadFunction(unsigned int threadId,
+                                         unsigned int nThreads)
+{
+    // slice the y range into the number of threads it has
+    unsigned int dy = _renderWindow.y2 - _renderWindow.y1;
+    unsigned int h = (dy + nThreads - 1) / nThreads;
+
+    if (h == 0) {
+        h = 1;
+    }
+    if (threadId * h >= dy) {
+        return;
+    }
+    OfxRectI win = _renderWindow;
+    win.y1 = _renderWindow.y1 + threadId * h;
+    win.y2 = _renderWindow.y1 + std::min( (threadId + 1) * h, dy );
+    multiThreadProcessImages(win);
+}
+
+void
+OFX::ImageProcessor::process()
+{
+    if ( (_renderWindow.x2 <= _renderWindow.x1) || (_renderWindow.y2 <= _renderWindow.y1) ) {
+        return;
+    }
+    preProcess();
+    multiThread( std::min( OFX::MultiThread::getNumCPUs(), (unsigned int)(_renderWindow.y2 - _renderWindow.y1) ) );
+    postProcess();
+}
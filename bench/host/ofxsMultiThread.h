@@ -0,0 +1,97 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Mock OFX host: the multithread suite of the OFX Support library.
+ *
+ * The threads are POSIX threads. The number of CPUs reported to the processors can be set with
+ * OFX::MultiThread::setNumCPUs(), which is only available in the mock host.
+ */
+
+#ifndef openfx_supportext_bench_ofxsMultiThread_h
+#define openfx_supportext_bench_ofxsMultiThread_h
+
+namespace OFX {
+namespace MultiThread {
+/** @brief runs multiThreadFunction() on several threads */
+class Processor
+{
+public:
+    Processor() {}
+
+    virtual ~Processor() {}
+
+    virtual void multiThreadFunction(unsigned int threadId, unsigned int nThreads) = 0;
+
+    /** @brief call multiThreadFunction() from nCPUs threads (or getNumCPUs() if it is 0), and wait for them */
+    void multiThread(unsigned int nCPUs = 0);
+};
+
+/** @brief the number of CPUs that can be used for multithreaded processing */
+unsigned int getNumCPUs();
+
+/** @brief mock host only: set the value returned by getNumCPUs(). 0 restores the number of online processors. */
+void setNumCPUs(unsigned int nCPUs);
+
+/** @brief the index of the calling thread in Processor::multiThread(), or 0 */
+unsigned int getThreadIndex();
+
+/** @brief is the calling thread one of the threads spawned by Processor::multiThread()? */
+bool isSpawnedThread();
+
+/** @brief a recursive mutex */
+class Mutex
+{
+    void* _handle;
+
+public:
+    Mutex(int lockCount = 0);
+
+    virtual ~Mutex();
+
+    void lock();
+
+    void unlock();
+
+    bool tryLock();
+
+private:
+    Mutex(const Mutex &);
+    Mutex & operator=(const Mutex &);
+};
+
+class AutoMutex
+{
+    Mutex &_mutex;
+
+public:
+    explicit AutoMutex(Mutex &m)
+        : _mutex(m)
+    {
+        _mutex.lock();
+    }
+
+    ~AutoMutex()
+    {
+        _mutex.unlock();
+    }
+};
+} // namespace MultiThread
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_bench_ofxsMultiThread_h
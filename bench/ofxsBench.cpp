@@ -0,0 +1,217 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Benchmark of the pixel kernels of the support library, run with the mock host of bench/host.
+ *
+ * Each kernel is run on each size, bit depth and component count it supports. The kernel is run once
+ * to warm up, then repeatedly until the minimum time is spent (and at least 3 times), and the best
+ * run is reported. The results are written as JSON:
+ *
+ * { "simd": true, "f16c": false, "threads": 8,
+ *   "results": [ { "kernel": "PixelCopier", "width": 1920, "height": 1080, "depth": "float",
+ *                  "components": 4, "runs": 31, "ns_per_pixel": 0.42, "mpix_per_s": 2380.9 }, ... ] }
+ *
+ * Usage: ofxsBench [-o file.json] [--quick] [--threads n] [--min-time seconds] [--filter substring]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ofxsBenchKernels.h"
+#include "ofxsTimer.h"
+
+using namespace OFX::Bench;
+
+namespace {
+struct Result
+{
+    std::string kernel;
+    int width;
+    int height;
+    OFX::BitDepthEnum depth;
+    int nComponents;
+    int runs;
+    double secondsPerPixel;
+};
+
+void
+usage(const char* argv0)
+{
+    std::fprintf(stderr, "Usage: %s [-o file.json] [--quick] [--threads n] [--min-time seconds] [--filter substring]\n", argv0);
+    std::exit(1);
+}
+
+/** @brief write the string as a JSON string */
+void
+writeJSONString(FILE* f,
+                const std::string & s)
+{
+    std::fputc('"', f);
+    for (size_t i = 0; i < s.size(); ++i) {
+        if ( (s[i] == '"') || (s[i] == '\\') ) {
+            std::fputc('\\', f);
+        }
+        std::fputc(s[i], f);
+    }
+    std::fputc('"', f);
+}
+
+void
+writeJSON(FILE* f,
+          const std::vector<Result> & results)
+{
+#ifdef OFXS_USE_SSE2
+    const bool simd = true;
+#else
+    const bool simd = false;
+#endif
+#ifdef OFXS_USE_F16C
+    const bool f16c = true;
+#else
+    const bool f16c = false;
+#endif
+
+    std::fprintf(f, "{\n  \"simd\": %s,\n  \"f16c\": %s,\n  \"threads\": %u,\n  \"results\": [\n",
+                 simd ? "true" : "false", f16c ? "true" : "false", OFX::MultiThread::getNumCPUs() );
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result & r = results[i];
+        std::fprintf(f, "    { \"kernel\": ");
+        writeJSONString(f, r.kernel);
+        std::fprintf(f, ", \"width\": %d, \"height\": %d, \"depth\": \"%s\", \"components\": %d, \"runs\": %d, \"ns_per_pixel\": %.4f, \"mpix_per_s\": %.2f }%s\n",
+                     r.width, r.height, getBitDepthName(r.depth), r.nComponents, r.runs,
+                     r.secondsPerPixel * 1e9, 1e-6 / r.secondsPerPixel, (i + 1 < results.size()) ? "," : "");
+    }
+    std::fprintf(f, "  ]\n}\n");
+}
+} // anon namespace
+
+int
+main(int argc,
+     char* argv[])
+{
+    const char* outputFile = NULL;
+    bool quick = false;
+    double minTime = 0.2;
+    const char* filter = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if ( !std::strcmp(argv[i], "-o") && (i + 1 < argc) ) {
+            outputFile = argv[++i];
+        } else if ( !std::strcmp(argv[i], "--quick") ) {
+            quick = true;
+        } else if ( !std::strcmp(argv[i], "--threads") && (i + 1 < argc) ) {
+            OFX::MultiThread::setNumCPUs( std::atoi(argv[++i]) );
+        } else if ( !std::strcmp(argv[i], "--min-time") && (i + 1 < argc) ) {
+            minTime = std::atof(argv[++i]);
+        } else if ( !std::strcmp(argv[i], "--filter") && (i + 1 < argc) ) {
+            filter = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (quick) {
+        minTime = 0.;
+    }
+
+    static const int sizes[][2] = { { 256, 256 }, { 1920, 1080 } };
+    static const OFX::BitDepthEnum depths[] = { OFX::eBitDepthUByte, OFX::eBitDepthUShort, OFX::eBitDepthHalf, OFX::eBitDepthFloat };
+    static const int components[] = { 1, 3, 4 };
+    static const OFX::MergeImages2D::MergingFunctionEnum operations[] = {
+        OFX::MergeImages2D::eMergeOver, OFX::MergeImages2D::eMergePlus, OFX::MergeImages2D::eMergeMultiply,
+        OFX::MergeImages2D::eMergeScreen, OFX::MergeImages2D::eMergeHue,
+    };
+    const int nSizes = quick ? 1 : 2;
+    OFX::ImageEffect effect;
+    std::vector<Result> results;
+
+    for (int s = 0; s < nSizes; ++s) {
+        for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d) {
+            for (size_t c = 0; c < sizeof(components) / sizeof(components[0]); ++c) {
+                KernelImages images(&effect, sizes[s][0], sizes[s][1], depths[d], components[c]);
+                KernelContext & ctx = images.context();
+
+                for (const Kernel* k = getKernels(); k->name; ++k) {
+                    if ( !isKernelSupported(*k, depths[d], components[c]) ) {
+                        continue;
+                    }
+                    const size_t nOperations = k->perOperation ? sizeof(operations) / sizeof(operations[0]) : 1;
+                    for (size_t o = 0; o < nOperations; ++o) {
+                        std::string name = k->name;
+                        if (k->perOperation) {
+                            ctx.operation = operations[o];
+                            name += "/" + OFX::MergeImages2D::getOperationString(operations[o]);
+                        }
+                        if ( filter && (name.find(filter) == std::string::npos) ) {
+                            continue;
+                        }
+
+                        Result r;
+                        r.kernel = name;
+                        r.width = sizes[s][0];
+                        r.height = sizes[s][1];
+                        r.depth = depths[d];
+                        r.nComponents = components[c];
+                        r.runs = 0;
+                        r.secondsPerPixel = 0.;
+
+                        // warm up: touch the LUTs, the pages of the output and the caches
+                        k->run(ctx);
+
+                        double total = 0.;
+                        while ( r.runs < 3 || total < minTime ) {
+                            const double t0 = OFX::getTimeSeconds();
+                            const double nPixels = k->run(ctx);
+                            const double t = OFX::getTimeSeconds() - t0;
+                            const double secondsPerPixel = t / nPixels;
+                            if ( (r.runs == 0) || (secondsPerPixel < r.secondsPerPixel) ) {
+                                r.secondsPerPixel = secondsPerPixel;
+                            }
+                            total += t;
+                            ++r.runs;
+                        }
+                        // avoid infinite throughput on timers with a low resolution
+                        if (r.secondsPerPixel <= 0.) {
+                            r.secondsPerPixel = 1e-12;
+                        }
+                        results.push_back(r);
+                        std::fprintf(stderr, "%-50s %4dx%-4d %-5s %d %10.3f ns/pixel\n", name.c_str(), r.width, r.height,
+                                     getBitDepthName(r.depth), r.nComponents, r.secondsPerPixel * 1e9);
+                    }
+                }
+                ctx.operation = OFX::MergeImages2D::eMergeOver;
+            }
+        }
+    }
+
+    FILE* f = outputFile ? std::fopen(outputFile, "w") : stdout;
+    if (!f) {
+        std::perror(outputFile);
+
+        return 1;
+    }
+    writeJSON(f, results);
+    if (f != stdout) {
+        std::fclose(f);
+    }
+
+    return 0;
+}
@@ -0,0 +1,960 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Kernels driven by the benchmark (ofxsBench.cpp) and by the SIMD checks (ofxsCheck.cpp).
+ *
+ * Each kernel renders the destination image of a KernelContext from its source images, for one bit
+ * depth and component count. The images are filled with a deterministic pattern which has runs of
+ * transparent and opaque pixels, and runs of 0, 1 and partial mask values, so that the shortcuts
+ * of the processors are exercised as well as the general case.
+ */
+
+#ifndef openfx_supportext_bench_ofxsBenchKernels_h
+#define openfx_supportext_bench_ofxsBenchKernels_h
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+#include "ofxsCoords.h"
+#include "ofxsCopier.h"
+#include "ofxsFilter.h"
+#include "ofxsHalf.h"
+#include "ofxsImageAccumulator.h"
+#include "ofxsImageBlenderMasked.h"
+#include "ofxsLut.h"
+#include "ofxsMatrix2D.h"
+#include "ofxsMergeProcessor.h"
+#include "ofxsMergeStack.h"
+#include "ofxsMerging.h"
+#include "ofxsMipmap.h"
+#include "ofxsPixelConverter.h"
+#include "ofxsTransform3x3Processor.h"
+
+namespace OFX {
+namespace Bench {
+inline const char*
+getBitDepthName(OFX::BitDepthEnum depth)
+{
+    switch (depth) {
+    case OFX::eBitDepthUByte:
+
+        return "8u";
+    case OFX::eBitDepthUShort:
+
+        return "16u";
+    case OFX::eBitDepthHalf:
+
+        return "half";
+    case OFX::eBitDepthFloat:
+
+        return "float";
+    default:
+
+        return "none";
+    }
+}
+
+inline OFX::PixelComponentEnum
+getPixelComponents(int nComponents)
+{
+    return (nComponents == 1) ? OFX::ePixelComponentAlpha : ( (nComponents == 3) ? OFX::ePixelComponentRGB : OFX::ePixelComponentRGBA );
+}
+
+/** @brief an image which owns its pixels. Its rows may be padded by rowPadding pixels, which are not
+   part of the image: they are filled with 0xff bytes, so that reading them gives visible garbage. */
+class BenchImage
+{
+public:
+    BenchImage(const OfxRectI & bounds,
+               int nComponents,
+               OFX::BitDepthEnum depth,
+               int rowPadding = 0)
+        : _bounds(bounds)
+        , _nComponents(nComponents)
+        , _depth(depth)
+        , _rowBytes( (bounds.x2 - bounds.x1 + rowPadding) * nComponents * OFX::getComponentBytes(depth) )
+        , _data( (size_t)_rowBytes * (bounds.y2 - bounds.y1) + 16 )
+        , _image(0)
+    {
+        // 16-byte aligned pixels, as allocated by most hosts
+        _pixels = &_data[0] + ( ( 16 - ( (size_t)&_data[0] & 15 ) ) & 15 );
+        if (rowPadding > 0) {
+            std::memset( _pixels, 0xff, size() );
+        }
+        _image = new OFX::Image(_pixels, bounds, getPixelComponents(nComponents), depth, _rowBytes);
+    }
+
+    ~BenchImage()
+    {
+        delete _image;
+    }
+
+    OFX::Image* image() const
+    {
+        return _image;
+    }
+
+    void* pixels() const
+    {
+        return _pixels;
+    }
+
+    const OfxRectI & bounds() const
+    {
+        return _bounds;
+    }
+
+    int rowBytes() const
+    {
+        return _rowBytes;
+    }
+
+    int nComponents() const
+    {
+        return _nComponents;
+    }
+
+    OFX::BitDepthEnum depth() const
+    {
+        return _depth;
+    }
+
+    size_t size() const
+    {
+        return (size_t)_rowBytes * (_bounds.y2 - _bounds.y1);
+    }
+
+    /** @brief set all pixels to 0 (but not the row padding) */
+    void clear()
+    {
+        const size_t pixelRowBytes = (size_t)(_bounds.x2 - _bounds.x1) * _nComponents * OFX::getComponentBytes(_depth);
+
+        for (int y = 0; y < _bounds.y2 - _bounds.y1; ++y) {
+            std::memset( (char*)_pixels + (size_t)y * _rowBytes, 0, pixelRowBytes );
+        }
+    }
+
+    /** @brief fill with the test pattern. Masks (isMask) have runs of 0, 1 and partial values;
+       color images have runs of transparent, opaque and partially transparent pixels. */
+    void fill(unsigned int seed,
+              bool isMask)
+    {
+        switch (_depth) {
+        case OFX::eBitDepthUByte:
+            fillForDepth<unsigned char, 255>(seed, isMask);
+            break;
+        case OFX::eBitDepthUShort:
+            fillForDepth<unsigned short, 65535>(seed, isMask);
+            break;
+        case OFX::eBitDepthHalf:
+            fillForDepth<OFX::Half, 1>(seed, isMask);
+            break;
+        case OFX::eBitDepthFloat:
+            fillForDepth<float, 1>(seed, isMask);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /** @brief a hash of the pixel values (FNV-1a). Float values are hashed, not their bits:
+       -0 and +0 are equal, and so are all NaNs. */
+    unsigned long long hash() const
+    {
+        unsigned long long h = 14695981039346656037ULL;
+        const int componentBytes = OFX::getComponentBytes(_depth);
+        const unsigned char* p = (const unsigned char*)_pixels;
+        const size_t n = size() / componentBytes;
+
+        for (size_t i = 0; i < n; ++i, p += componentBytes) {
+            unsigned char v[4] = { 0, 0, 0, 0 };
+            std::memcpy(v, p, componentBytes);
+            if (_depth == OFX::eBitDepthFloat) {
+                float f;
+                std::memcpy(&f, p, sizeof(f) );
+                if (f != f) {
+                    v[0] = v[1] = v[2] = v[3] = 0xff;
+                } else if (f == 0.f) {
+                    v[0] = v[1] = v[2] = v[3] = 0;
+                }
+            } else if (_depth == OFX::eBitDepthHalf) {
+                if ( ( (v[1] & 0x7c) == 0x7c ) && ( (v[1] & 0x03) || v[0] ) ) {
+                    v[0] = v[1] = 0xff;
+                } else if ( ( (v[1] & 0x7f) == 0 ) && (v[0] == 0) ) {
+                    v[1] = 0;
+                }
+            }
+            for (int k = 0; k < componentBytes; ++k) {
+                h = (h ^ v[k]) * 1099511628211ULL;
+            }
+        }
+
+        return h;
+    }
+
+private:
+    template <class PIX, int maxValue>
+    void fillForDepth(unsigned int seed,
+                      bool isMask)
+    {
+        unsigned int state = seed;
+        const bool isFloat = (maxValue == 1);
+
+        for (int y = _bounds.y1; y < _bounds.y2; ++y) {
+            PIX* pix = (PIX*)( (char*)_pixels + (size_t)(y - _bounds.y1) * _rowBytes );
+            for (int x = _bounds.x1; x < _bounds.x2; ++x, pix += _nComponents) {
+                // the kind of run (0: zero, 1: one, other: partial) changes every 8 to 71 pixels
+                const int run = ( (x + 3 * y) / ( 8 + (y * 7 + seed) % 64 ) + seed ) % 4;
+                for (int c = 0; c < _nComponents; ++c) {
+                    state = state * 1103515245u + 12345u;
+                    float v = ( (state >> 8) & 0xffff ) / 65535.f;
+                    const bool isAlpha = isMask || (_nComponents == 1) || (c == 3);
+                    if (isAlpha) {
+                        v = (run == 0) ? 0.f : ( (run == 1) ? 1.f : v );
+                    } else {
+                        if (run == 0) {
+                            // transparent pixels are black (premultiplied)
+                            v = 0.f;
+                        } else if (isFloat && !isMask) {
+                            // float images have some values outside of [0,1]
+                            v = v * 1.5f - 0.25f;
+                        }
+                    }
+                    pix[c] = isFloat ? PIX(v) : PIX( (int)(v * maxValue + 0.5f) );
+                }
+            }
+        }
+    }
+
+    OfxRectI _bounds;
+    int _nComponents;
+    OFX::BitDepthEnum _depth;
+    int _rowBytes;
+    std::vector<unsigned char> _data;
+    void* _pixels;
+    OFX::Image* _image;
+
+    BenchImage(const BenchImage &);
+    BenchImage & operator=(const BenchImage &);
+};
+
+/** @brief the images used by the kernels. All images have the depth and component count of the test,
+   except the byte, short and mask images. The source images overlap the destination partially, so that
+   the processors also handle pixels outside of their sources. */
+struct KernelContext
+{
+    OFX::ImageEffect* effect;
+    OFX::BitDepthEnum depth;
+    int nComponents;
+    OfxRectI renderWindow;
+    const BenchImage* srcA;
+    const BenchImage* srcB;
+    const BenchImage* mask;        //!< Alpha, same depth
+    const BenchImage* srcFloat;    //!< float, same components
+    const BenchImage* srcBytes;    //!< 8-bit, same components
+    const BenchImage* srcShorts;   //!< 16-bit, same components
+    BenchImage* dst;
+    BenchImage* dstBytes;          //!< 8-bit, same components
+    BenchImage* dstShorts;         //!< 16-bit, same components
+    BenchImage* dstGray;           //!< 8-bit Alpha
+    BenchImage* dstHalfRes;        //!< half the size of srcA, same depth and components
+    OFX::MergeImages2D::MergingFunctionEnum operation;
+};
+
+/** @brief what a kernel writes */
+enum KernelOutputEnum
+{
+    eKernelOutputDst = 0,
+    eKernelOutputBytes,
+    eKernelOutputShorts,
+    eKernelOutputGray,
+    eKernelOutputHalfRes,
+};
+
+/** @brief run K<PIX, nComponents, maxValue>::run() for the depth and components of the context */
+template <template <class, int, int> class K, class PIX, int maxValue>
+double
+runKernelForComponents(const KernelContext & ctx)
+{
+    switch (ctx.nComponents) {
+    case 1:
+
+        return K<PIX, 1, maxValue>::run(ctx);
+    case 3:
+
+        return K<PIX, 3, maxValue>::run(ctx);
+    case 4:
+
+        return K<PIX, 4, maxValue>::run(ctx);
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
+
+        return 0.;
+    }
+}
+
+/** @brief run the kernel and return the number of pixels it rendered */
+template <template <class, int, int> class K>
+double
+runKernel(const KernelContext & ctx)
+{
+    switch (ctx.depth) {
+    case OFX::eBitDepthUByte:
+
+        return runKernelForComponents<K, unsigned char, 255>(ctx);
+    case OFX::eBitDepthUShort:
+
+        return runKernelForComponents<K, unsigned short, 65535>(ctx);
+    case OFX::eBitDepthHalf:
+
+        return runKernelForComponents<K, OFX::Half, 1>(ctx);
+    case OFX::eBitDepthFloat:
+
+        return runKernelForComponents<K, float, 1>(ctx);
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
+
+        return 0.;
+    }
+}
+
+/** @brief K<PIX, nComponents, maxValue>::run() if supported is true. Else the kernel is not instantiated,
+   and running it throws. */
+template <template <class, int, int> class K, class PIX, int nComponents, int maxValue, bool supported>
+struct KernelIfSupported
+{
+    static double run(const KernelContext & ctx)
+    {
+        return K<PIX, nComponents, maxValue>::run(ctx);
+    }
+};
+
+template <template <class, int, int> class K, class PIX, int nComponents, int maxValue>
+struct KernelIfSupported<K, PIX, nComponents, maxValue, false>
+{
+    static double run(const KernelContext &)
+    {
+        OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
+
+        return 0.;
+    }
+};
+
+/** @brief the kernel K for RGB and RGBA images only, for the processors that assert it
+   (e.g. the copiers that premultiply or unpremultiply) */
+template <template <class, int, int> class K>
+struct ColorKernel
+{
+    template <class PIX, int nComponents, int maxValue>
+    struct Kernel
+        : public KernelIfSupported<K, PIX, nComponents, maxValue, (nComponents == 3 || nComponents == 4)>
+    {
+    };
+};
+
+inline double
+getPixelCount(const OfxRectI & window)
+{
+    return (double)(window.x2 - window.x1) * (window.y2 - window.y1);
+}
+
+template <class PIX, int nComponents, int maxValue>
+struct PixelCopierKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::PixelCopier<PIX, nComponents> p(*ctx.effect);
+
+        p.setDstImg( ctx.dst->image() );
+        p.setSrcImg( ctx.srcA->image() );
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+/** @brief PixelCopier with a Repeat boundary, from a source smaller than the render window */
+template <class PIX, int nComponents, int maxValue>
+struct PixelCopierRepeatKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::PixelCopier<PIX, nComponents> p(*ctx.effect);
+        const BenchImage & src = *ctx.dstHalfRes;
+
+        // the half-size image is used as a small source: fill it from srcA
+        for (int y = src.bounds().y1; y < src.bounds().y2; ++y) {
+            std::memcpy( src.image()->getPixelAddress(src.bounds().x1, y), ctx.srcA->image()->getPixelAddress(ctx.srcA->bounds().x1, ctx.srcA->bounds().y1 + y - src.bounds().y1),
+                         src.rowBytes() );
+        }
+        p.setDstImg( ctx.dst->image() );
+        p.setSrcImg(src.pixels(), src.bounds(), getPixelComponents(nComponents), nComponents, ctx.depth, src.rowBytes(), 2);
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+template <class PIX, int nComponents, int maxValue>
+struct PixelCopierPremultKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::PixelCopierPremult<PIX, nComponents, maxValue, PIX, nComponents, maxValue> p(*ctx.effect);
+
+        p.setDstImg( ctx.dst->image() );
+        p.setSrcImg( ctx.srcA->image() );
+        p.setPremultMaskMix(true, 3, 1.);
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+template <class PIX, int nComponents, int maxValue>
+struct PixelCopierUnPremultKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::PixelCopierUnPremult<PIX, nComponents, maxValue, PIX, nComponents, maxValue> p(*ctx.effect);
+
+        p.setDstImg( ctx.dst->image() );
+        p.setSrcImg( ctx.srcA->image() );
+        p.setPremultMaskMix(true, 3, 1.);
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+template <class PIX, int nComponents, int maxValue>
+struct PixelCopierPremultMaskMixKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::PixelCopierPremultMaskMix<PIX, nComponents, maxValue, PIX, nComponents, maxValue> p(*ctx.effect);
+
+        p.setDstImg( ctx.dst->image() );
+        p.setSrcImg( ctx.srcA->image() );
+        p.setOrigImg( ctx.srcB->image() );
+        p.setMaskImg(ctx.mask->image(), false);
+        p.doMasking(true);
+        p.setPremultMaskMix(true, 3, 0.75);
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+template <class PIX, int nComponents, int maxValue>
+struct PixelCopierMaskMixKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::PixelCopierMaskMix<PIX, nComponents, maxValue, true> p(*ctx.effect);
+
+        p.setDstImg( ctx.dst->image() );
+        p.setSrcImg( ctx.srcA->image() );
+        p.setOrigImg( ctx.srcB->image() );
+        p.setMaskImg(ctx.mask->image(), false);
+        p.doMasking(true);
+        p.setPremultMaskMix(false, 3, 0.75);
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+/** @brief convert the float source to the depth of the test */
+template <class PIX, int nComponents, int maxValue>
+struct PixelConverterKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::PixelConverter<float, nComponents, 1, PIX, nComponents, maxValue> p(*ctx.effect);
+
+        p.setDstImg( ctx.dst->image() );
+        p.setSrcImg( ctx.srcFloat->image() );
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+template <class PIX, int nComponents, int maxValue>
+struct ImageBlenderMaskedKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::ImageBlenderMasked<PIX, nComponents, maxValue, true> p(*ctx.effect);
+
+        p.setDstImg( ctx.dst->image() );
+        p.setFromImg( ctx.srcA->image() );
+        p.setToImg( ctx.srcB->image() );
+        p.setBlend(0.3f);
+        p.setMaskImg(ctx.mask->image(), false);
+        p.doMasking(true);
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+template <class PIX, int nComponents, int maxValue>
+struct ImageAccumulatorKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::ImageAccumulator<PIX, nComponents, maxValue> p(*ctx.effect);
+
+        p.setDstImg( ctx.dst->image() );
+        p.addSrcImg(ctx.srcA->image(), 0.5f);
+        p.addSrcImg(ctx.srcB->image(), 0.25f);
+        p.addSrcImg(ctx.srcA->image(), 0.125f);
+        p.addSrcImg(NULL, 0.125f);
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+/** @brief MergeImages2D::mergePixel() on each pixel, as in a plugin without a merge processor */
+template <OFX::MergeImages2D::MergingFunctionEnum f>
+struct MergePixelKernel
+{
+    template <class PIX, int nComponents, int maxValue>
+    struct Kernel
+    {
+        static double run(const KernelContext & ctx)
+        {
+            const OfxRectI & w = ctx.renderWindow;
+            const OFX::Image* a = ctx.srcA->image();
+            const OFX::Image* b = ctx.srcB->image();
+
+            for (int y = w.y1; y < w.y2; ++y) {
+                PIX* dstPix = (PIX*)ctx.dst->image()->getPixelAddress(w.x1, y);
+                for (int x = w.x1; x < w.x2; ++x, dstPix += nComponents) {
+                    float A[4], B[4], res[4];
+                    OFX::MergeImages2D::mergeLoadPixel<PIX, nComponents, maxValue>( (const PIX*)a->getPixelAddress(x, y), A );
+                    OFX::MergeImages2D::mergeLoadPixel<PIX, nComponents, maxValue>( (const PIX*)b->getPixelAddress(x, y), B );
+                    OFX::MergeImages2D::mergePixel<f, float, nComponents, 1>(true, A, B, res);
+                    for (int c = 0; c < nComponents; ++c) {
+                        dstPix[c] = ofxsClampIfInt<PIX, maxValue>(res[c] * maxValue, 0, maxValue);
+                    }
+                }
+            }
+
+            return getPixelCount(w);
+        }
+    };
+};
+
+/** @brief the merge processor for the operation of the context, masked and mixed */
+template <class PIX, int nComponents, int maxValue>
+struct MergeProcessorKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        std::auto_ptr<OFX::MergeImages2D::MergeProcessorBase> p( OFX::MergeImages2D::createMergeProcessor<PIX, nComponents, maxValue>(*ctx.effect, ctx.operation) );
+
+        p->setDstImg( ctx.dst->image() );
+        p->setSrcImg( ctx.srcA->image(), ctx.srcB->image() );
+        p->setMaskImg(ctx.mask->image(), false);
+        p->doMasking(true);
+        p->setValues(true, 0.75);
+        p->setRenderWindow(ctx.renderWindow);
+        p->process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+/** @brief three layers over a background, the second one masked */
+template <class PIX, int nComponents, int maxValue>
+struct MergeStackKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::MergeImages2D::MergeStackProcessor<PIX, nComponents, maxValue> p(*ctx.effect);
+
+        p.setDstImg( ctx.dst->image() );
+        p.setBackgroundImg( ctx.srcB->image() );
+        p.addLayer(ctx.srcA->image(), OFX::MergeImages2D::eMergeOver);
+        p.addLayer(ctx.srcB->image(), OFX::MergeImages2D::eMergeMultiply, true, 0.75, ctx.mask->image(), false);
+        p.addLayer(ctx.srcA->image(), OFX::MergeImages2D::eMergeScreen);
+        p.setRenderWindow(ctx.renderWindow);
+        p.process();
+
+        return getPixelCount(ctx.renderWindow);
+    }
+};
+
+/** @brief ofxsFilterInterpolate2D() on a scaled grid with a subpixel offset */
+template <OFX::FilterEnum filter>
+struct FilterInterpolate2DKernel
+{
+    template <class PIX, int nComponents, int maxValue>
+    struct Kernel
+    {
+        static double run(const KernelContext & ctx)
+        {
+            const OfxRectI & w = ctx.renderWindow;
+
+            for (int y = w.y1; y < w.y2; ++y) {
+                PIX* dstPix = (PIX*)ctx.dst->image()->getPixelAddress(w.x1, y);
+                for (int x = w.x1; x < w.x2; ++x, dstPix += nComponents) {
+                    float tmpPix[nComponents];
+                    ofxsFilterInterpolate2D<PIX, nComponents, filter, false>(x * 0.9 + 3.3, y * 0.9 + 2.7, ctx.srcA->image(), false, tmpPix);
+                    for (int c = 0; c < nComponents; ++c) {
+                        dstPix[c] = ofxsClampIfInt<PIX, maxValue>(tmpPix[c], 0, maxValue);
+                    }
+                }
+            }
+
+            return getPixelCount(w);
+        }
+    };
+};
+
+/** @brief ofxsFilterInterpolate2DSuper(), with a 2.5x downscale which needs supersampling */
+template <OFX::FilterEnum filter>
+struct FilterInterpolate2DSuperKernel
+{
+    template <class PIX, int nComponents, int maxValue>
+    struct Kernel
+    {
+        static double run(const KernelContext & ctx)
+        {
+            const OfxRectI & w = ctx.renderWindow;
+
+            for (int y = w.y1; y < w.y2; ++y) {
+                PIX* dstPix = (PIX*)ctx.dst->image()->getPixelAddress(w.x1, y);
+                for (int x = w.x1; x < w.x2; ++x, dstPix += nComponents) {
+                    float tmpPix[nComponents];
+                    ofxsFilterInterpolate2DSuper<PIX, nComponents, filter, false>(x * 2.5 + 0.3, y * 2.5 + 0.7, 2.5, 0., 0., 2.5, ctx.srcA->image(), false, tmpPix);
+                    for (int c = 0; c < nComponents; ++c) {
+                        dstPix[c] = ofxsClampIfInt<PIX, maxValue>(tmpPix[c], 0, maxValue);
+                    }
+                }
+            }
+
+            return getPixelCount(w);
+        }
+    };
+};
+
+/** @brief a 10 degree rotation around the center of the render window, with cubic filtering */
+template <class PIX, int nComponents, int maxValue>
+struct Transform3x3ProcessorKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        OFX::Transform3x3Processor<PIX, nComponents, maxValue, false, OFX::eFilterCubic, false> p(*ctx.effect);
+        const OfxRectI & w = ctx.renderWindow;
+        // the inverse transform, from destination to source pixel coordinates
+        const OFX::Matrix3x3 invtransform = OFX::ofxsMatRotationAroundPoint(-10. * M_PI / 180., (w.x1 + w.x2) / 2., (w.y1 + w.y2) / 2.);
+
+        p.setDstImg( ctx.dst->image() );
+        p.setSrcImg( ctx.srcA->image() );
+        p.setValues(&invtransform, NULL, 1, true, 0., 1.);
+        p.setRenderWindow(w);
+        p.process();
+
+        return getPixelCount(w);
+    }
+};
+
+/** @brief ofxsScalePixelData() from srcA to the half resolution image (float and half only) */
+template <class PIX, int nComponents, int maxValue>
+struct ScalePixelDataKernel
+{
+    static double run(const KernelContext & ctx)
+    {
+        const BenchImage & src = *ctx.srcA;
+        BenchImage & dst = *ctx.dstHalfRes;
+
+        OFX::ofxsScalePixelData(ctx.effect, dst.bounds(), src.bounds(), 1,
+                                src.pixels(), getPixelComponents(nComponents), ctx.depth, src.bounds(), src.rowBytes(),
+                                dst.pixels(), getPixelComponents(nComponents), ctx.depth, dst.bounds(), dst.rowBytes() );
+
+        return getPixelCount( dst.bounds() );
+    }
+};
+
+/** @brief the bulk conversions of OFX::Color::LutBase (float and half only), with the sRGB LUT */
+enum LutConversionEnum
+{
+    eLutToBytePackedDither = 0,
+    eLutToBytePackedNoDither,
+    eLutToBytePackedNoDitherMultiThread,
+    eLutToByteGrayscaleNoDither,
+    eLutToShortPacked,
+    eLutFromBytePacked,
+    eLutFromShortPacked,
+};
+
+template <LutConversionEnum conversion>
+struct LutKernel
+{
+    template <class PIX, int nComponents, int maxValue>
+    struct Kernel
+    {
+        static double run(const KernelContext & ctx)
+        {
+            const OFX::Color::LutBase* lut = OFX::Color::LutManager::sRGBLut<OFX::MultiThread::Mutex>();
+            const OFX::PixelComponentEnum comps = getPixelComponents(nComponents);
+            const BenchImage & src = *ctx.srcA;
+            // the conversions need a window inside the source bounds
+            OfxRectI w;
+            OFX::Coords::rectIntersection(ctx.renderWindow, src.bounds(), &w);
+
+            switch (conversion) {
+            case eLutToBytePackedDither:
+                lut->to_byte_packed_dither(src.pixels(), src.bounds(), comps, nComponents, ctx.depth, src.rowBytes(), w,
+                                           ctx.dstBytes->pixels(), ctx.dstBytes->bounds(), comps, nComponents, OFX::eBitDepthUByte, ctx.dstBytes->rowBytes() );
+                break;
+            case eLutToBytePackedNoDither:
+                lut->to_byte_packed_nodither(src.pixels(), src.bounds(), comps, nComponents, ctx.depth, src.rowBytes(), w,
+                                             ctx.dstBytes->pixels(), ctx.dstBytes->bounds(), comps, nComponents, OFX::eBitDepthUByte, ctx.dstBytes->rowBytes() );
+                break;
+            case eLutToBytePackedNoDitherMultiThread:
+                lut->to_byte_packed_nodither_multithread(src.pixels(), src.bounds(), comps, nComponents, ctx.depth, src.rowBytes(), w,
+                                                         ctx.dstBytes->pixels(), ctx.dstBytes->bounds(), comps, nComponents, OFX::eBitDepthUByte, ctx.dstBytes->rowBytes() );
+                break;
+            case eLutToByteGrayscaleNoDither:
+                lut->to_byte_grayscale_nodither(src.pixels(), src.bounds(), comps, nComponents, ctx.depth, src.rowBytes(), w,
+                                                ctx.dstGray->pixels(), ctx.dstGray->bounds(), OFX::ePixelComponentAlpha, 1, OFX::eBitDepthUByte, ctx.dstGray->rowBytes() );
+                break;
+            case eLutToShortPacked:
+                lut->to_short_packed(src.pixels(), src.bounds(), comps, nComponents, ctx.depth, src.rowBytes(), w,
+                                     ctx.dstShorts->pixels(), ctx.dstShorts->bounds(), comps, nComponents, OFX::eBitDepthUShort, ctx.dstShorts->rowBytes() );
+                break;
+            case eLutFromBytePacked:
+                lut->from_byte_packed(ctx.srcBytes->pixels(), ctx.srcBytes->bounds(), comps, nComponents, OFX::eBitDepthUByte, ctx.srcBytes->rowBytes(), w,
+                                      ctx.dst->pixels(), ctx.dst->bounds(), comps, nComponents, ctx.depth, ctx.dst->rowBytes() );
+                break;
+            case eLutFromShortPacked:
+                lut->from_short_packed(ctx.srcShorts->pixels(), ctx.srcShorts->bounds(), comps, nComponents, OFX::eBitDepthUShort, ctx.srcShorts->rowBytes(), w,
+                                       ctx.dst->pixels(), ctx.dst->bounds(), comps, nComponents, ctx.depth, ctx.dst->rowBytes() );
+                break;
+            }
+
+            return getPixelCount(w);
+        }
+    };
+};
+
+/** @brief which depths and component counts a kernel supports */
+enum KernelSupportEnum
+{
+    eKernelSupportAll = 0,     //!< all depths and component counts
+    eKernelSupportRGBA,        //!< RGBA only
+    eKernelSupportFloat,       //!< float and half only
+    eKernelSupportFloatColor,  //!< float and half, RGB and RGBA only
+};
+
+/** @brief a kernel of the benchmark */
+struct Kernel
+{
+    const char* name;
+    double (*run)(const KernelContext &);
+    KernelSupportEnum support;
+    KernelOutputEnum output;
+    bool perOperation; //!< run once per merge operation (see KernelContext::operation)
+};
+
+inline bool
+isKernelSupported(const Kernel & k,
+                  OFX::BitDepthEnum depth,
+                  int nComponents)
+{
+    const bool isFloat = (depth == OFX::eBitDepthFloat) || (depth == OFX::eBitDepthHalf);
+
+    switch (k.support) {
+    case eKernelSupportAll:
+
+        return true;
+    case eKernelSupportRGBA:
+
+        return nComponents == 4;
+    case eKernelSupportFloat:
+
+        return isFloat;
+    case eKernelSupportFloatColor:
+
+        return isFloat && nComponents != 1;
+    }
+
+    return false;
+}
+
+/** @brief all the kernels, terminated by a kernel with a NULL name */
+inline const Kernel*
+getKernels()
+{
+    using OFX::MergeImages2D::eMergeOver;
+    using OFX::MergeImages2D::eMergeMultiply;
+    using OFX::MergeImages2D::eMergeHue;
+    static const Kernel kernels[] = {
+        { "PixelCopier", &runKernel<PixelCopierKernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "PixelCopier/repeat", &runKernel<PixelCopierRepeatKernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "PixelCopierPremult", &runKernel<ColorKernel<PixelCopierPremultKernel>::Kernel>, eKernelSupportRGBA, eKernelOutputDst, false },
+        { "PixelCopierUnPremult", &runKernel<ColorKernel<PixelCopierUnPremultKernel>::Kernel>, eKernelSupportRGBA, eKernelOutputDst, false },
+        { "PixelCopierPremultMaskMix", &runKernel<ColorKernel<PixelCopierPremultMaskMixKernel>::Kernel>, eKernelSupportRGBA, eKernelOutputDst, false },
+        { "PixelCopierMaskMix", &runKernel<PixelCopierMaskMixKernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "PixelConverter/float", &runKernel<PixelConverterKernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "ImageBlenderMasked", &runKernel<ImageBlenderMaskedKernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "ImageAccumulator", &runKernel<ImageAccumulatorKernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "mergePixel/Over", &runKernel<MergePixelKernel<eMergeOver>::Kernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "mergePixel/Multiply", &runKernel<MergePixelKernel<eMergeMultiply>::Kernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "mergePixel/Hue", &runKernel<MergePixelKernel<eMergeHue>::Kernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "MergeProcessor", &runKernel<MergeProcessorKernel>, eKernelSupportAll, eKernelOutputDst, true },
+        { "MergeStackProcessor", &runKernel<MergeStackKernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "ofxsFilterInterpolate2D/Bilinear", &runKernel<FilterInterpolate2DKernel<OFX::eFilterBilinear>::Kernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "ofxsFilterInterpolate2D/Cubic", &runKernel<FilterInterpolate2DKernel<OFX::eFilterCubic>::Kernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "ofxsFilterInterpolate2DSuper/Cubic", &runKernel<FilterInterpolate2DSuperKernel<OFX::eFilterCubic>::Kernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "Transform3x3Processor/Cubic", &runKernel<Transform3x3ProcessorKernel>, eKernelSupportAll, eKernelOutputDst, false },
+        { "ofxsScalePixelData", &runKernel<ScalePixelDataKernel>, eKernelSupportFloat, eKernelOutputHalfRes, false },
+        { "Lut::to_byte_packed_dither", &runKernel<LutKernel<eLutToBytePackedDither>::Kernel>, eKernelSupportFloatColor, eKernelOutputBytes, false },
+        { "Lut::to_byte_packed_nodither", &runKernel<LutKernel<eLutToBytePackedNoDither>::Kernel>, eKernelSupportFloat, eKernelOutputBytes, false },
+        { "Lut::to_byte_packed_nodither_multithread", &runKernel<LutKernel<eLutToBytePackedNoDitherMultiThread>::Kernel>, eKernelSupportFloat, eKernelOutputBytes, false },
+        { "Lut::to_byte_grayscale_nodither", &runKernel<LutKernel<eLutToByteGrayscaleNoDither>::Kernel>, eKernelSupportFloatColor, eKernelOutputGray, false },
+        { "Lut::to_short_packed", &runKernel<LutKernel<eLutToShortPacked>::Kernel>, eKernelSupportFloat, eKernelOutputShorts, false },
+        { "Lut::from_byte_packed", &runKernel<LutKernel<eLutFromBytePacked>::Kernel>, eKernelSupportFloat, eKernelOutputDst, false },
+        { "Lut::from_short_packed", &runKernel<LutKernel<eLutFromShortPacked>::Kernel>, eKernelSupportFloat, eKernelOutputDst, false },
+        { NULL, NULL, eKernelSupportAll, eKernelOutputDst, false }
+    };
+
+    return kernels;
+}
+
+/** @brief all the images of a test, with the given size, depth and components */
+class KernelImages
+{
+public:
+    KernelImages(OFX::ImageEffect* effect,
+                 int width,
+                 int height,
+                 OFX::BitDepthEnum depth,
+                 int nComponents)
+        : _srcA(offset(width, height, -width / 8, -height / 16), nComponents, depth)
+        , _srcB(offset(width, height, width / 16, height / 8), nComponents, depth)
+        , _mask(offset(width, height, width / 32, -height / 32), 1, depth)
+        , _srcFloat(offset(width, height, -width / 8, -height / 16), nComponents, OFX::eBitDepthFloat)
+        , _srcBytes(offset(width, height, 0, 0), nComponents, OFX::eBitDepthUByte)
+        , _srcShorts(offset(width, height, 0, 0), nComponents, OFX::eBitDepthUShort)
+        , _dst(offset(width, height, 0, 0), nComponents, depth)
+        , _dstBytes(offset(width, height, 0, 0), nComponents, OFX::eBitDepthUByte)
+        , _dstShorts(offset(width, height, 0, 0), nComponents, OFX::eBitDepthUShort)
+        , _dstGray(offset(width, height, 0, 0), 1, OFX::eBitDepthUByte)
+        , _dstHalfRes(OFX::Coords::downscalePowerOfTwoSmallestEnclosing(offset(width, height, -width / 8, -height / 16), 1), nComponents, depth)
+    {
+        _srcA.fill(1, false);
+        _srcB.fill(2, false);
+        _mask.fill(3, true);
+        _srcFloat.fill(4, false);
+        _srcBytes.fill(5, false);
+        _srcShorts.fill(6, false);
+        _ctx.effect = effect;
+        _ctx.depth = depth;
+        _ctx.nComponents = nComponents;
+        _ctx.renderWindow = _dst.bounds();
+        _ctx.srcA = &_srcA;
+        _ctx.srcB = &_srcB;
+        _ctx.mask = &_mask;
+        _ctx.srcFloat = &_srcFloat;
+        _ctx.srcBytes = &_srcBytes;
+        _ctx.srcShorts = &_srcShorts;
+        _ctx.dst = &_dst;
+        _ctx.dstBytes = &_dstBytes;
+        _ctx.dstShorts = &_dstShorts;
+        _ctx.dstGray = &_dstGray;
+        _ctx.dstHalfRes = &_dstHalfRes;
+        _ctx.operation = OFX::MergeImages2D::eMergeOver;
+    }
+
+    KernelContext & context()
+    {
+        return _ctx;
+    }
+
+    /** @brief the image written by the kernel */
+    BenchImage & output(const Kernel & k)
+    {
+        switch (k.output) {
+        case eKernelOutputDst:
+
+            return _dst;
+        case eKernelOutputBytes:
+
+            return _dstBytes;
+        case eKernelOutputShorts:
+
+            return _dstShorts;
+        case eKernelOutputGray:
+
+            return _dstGray;
+        case eKernelOutputHalfRes:
+
+            return _dstHalfRes;
+        }
+
+        return _dst;
+    }
+
+private:
+    static OfxRectI offset(int width,
+                           int height,
+                           int dx,
+                           int dy)
+    {
+        OfxRectI r = { dx, dy, dx + width, dy + height };
+
+        return r;
+    }
+
+    BenchImage _srcA;
+    BenchImage _srcB;
+    BenchImage _mask;
+    BenchImage _srcFloat;
+    BenchImage _srcBytes;
+    BenchImage _srcShorts;
+    BenchImage _dst;
+    BenchImage _dstBytes;
+    BenchImage _dstShorts;
+    BenchImage _dstGray;
+    BenchImage _dstHalfRes;
+    KernelContext _ctx;
+};
+} // namespace Bench
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_bench_ofxsBenchKernels_h
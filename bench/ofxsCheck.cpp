@@ -0,0 +1,470 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Checks of the pixel kernels of the support library, run with the mock host of bench/host.
+ *
+ * Each kernel is run on small images with odd sizes and offset bounds (so that the SIMD loops have
+ * tails and unaligned starts), and a hash of its output is printed, one line per kernel, depth and
+ * component count. The Makefile builds this program twice, with and without OFXS_NO_SIMD, and
+ * compares the outputs of both: the SIMD paths must give exactly the same results as the scalar paths.
+ *
+ * The program also runs a few tests of its own, which are reported on stderr and in the exit status:
+ * - ofxsClampIfInt() rounds values in [0, maxValue] to the nearest integer;
+ * - the bulk Lut conversion of all float values to bytes is compared with the scalar conversion;
+ * - PixelPipelineProcessor is compared with the chain of copiers that it replaces;
+ * - MergeProcessor is compared with mergePixel() for every operator;
+ * - copyPixels() is checked against the black boundary, from sources with and without padded rows.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ofxsBenchKernels.h"
+#include "ofxsPixelPipeline.h"
+
+using namespace OFX::Bench;
+
+namespace {
+/** @brief check that ofxsClampIfInt() clamps values in [0, maxValue] and rounds them to the nearest integer,
+   and that ofxsMaskMixPix() stores the mixed values this way. Return the number of failures. */
+template <class PIX, int maxValue>
+int
+checkClampIfInt(const char* depthName)
+{
+    int errors = 0;
+
+    // every quarter of integer, from -maxValue/2 to 1.5*maxValue
+    for (int k = -2 * maxValue; k <= 6 * maxValue; ++k) {
+        const float v = k / 4.f;
+        const int expected = (v <= 0.f) ? 0 : ( (v >= maxValue) ? maxValue : (int)(v + 0.5) );
+        const int result = OFX::ofxsClampIfInt<PIX, maxValue>(v, 0, maxValue);
+        if ( (result != expected) && (errors++ < 10) ) {
+            std::fprintf(stderr, "ofxsClampIfInt<%s>(%g) gives %d instead of %d\n", depthName, v, result, expected);
+        }
+    }
+
+    // the effect value 100 mixed half-and-half with the source value 50
+    const float tmpPix[1] = { 100.f };
+    const PIX srcPix[1] = { PIX(50) };
+    PIX dstPix[1];
+    OFX::ofxsMaskMixPix<PIX, 1, maxValue, false>(tmpPix, 0, 0, srcPix, false, NULL, 0.5f, false, dstPix);
+    if (dstPix[0] != 75) {
+        std::fprintf(stderr, "ofxsMaskMixPix<%s>(100, 50, mix=0.5) gives %d instead of 75\n", depthName, (int)dstPix[0]);
+        ++errors;
+    }
+    if (errors) {
+        std::fprintf(stderr, "ofxsClampIfInt<%s>: %d wrong value(s)\n", depthName, errors);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/** @brief convert every float value (except NaNs) to bytes with Lut::to_byte_packed_nodither(), as Alpha and
+   as RGBA images, and compare with the scalar conversions: floatToInt<256>() for alpha, and
+   toColorSpaceUint8FromLinearFloatFast() for colors. Return the number of failures. */
+int
+checkLutToBytes()
+{
+    const OFX::Color::LutBase* lut = OFX::Color::LutManager::sRGBLut<OFX::MultiThread::Mutex>();
+    const int count = 1 << 16; // values per row
+    std::vector<float> src(count);
+    std::vector<unsigned char> dst(count);
+    int failures = 0;
+
+    for (int nComponents = 1; nComponents <= 4; nComponents += 3) {
+        const OFX::PixelComponentEnum comps = getPixelComponents(nComponents);
+        const OfxRectI bounds = { 0, 0, count / nComponents, 1 };
+        int errors = 0;
+
+        for (unsigned long long first = 0; first < (1ULL << 32); first += count) {
+            for (int i = 0; i < count; ++i) {
+                const unsigned int bits = (unsigned int)(first + i);
+                float v;
+                std::memcpy( &v, &bits, sizeof(v) );
+                // floatToInt() is undefined for NaNs
+                src[i] = (v != v) ? 0.f : v;
+            }
+            lut->to_byte_packed_nodither(&src[0], bounds, comps, nComponents, OFX::eBitDepthFloat, count * sizeof(float), bounds,
+                                         &dst[0], bounds, comps, nComponents, OFX::eBitDepthUByte, count);
+            for (int i = 0; i < count; ++i) {
+                const bool isAlpha = (nComponents == 1) || (i % nComponents == 3);
+                const unsigned char expected = isAlpha ? OFX::Color::floatToInt<256>(src[i]) : lut->toColorSpaceUint8FromLinearFloatFast(src[i]);
+                if ( (dst[i] != expected) && (errors++ < 10) ) {
+                    unsigned int bits;
+                    std::memcpy( &bits, &src[i], sizeof(bits) );
+                    std::fprintf(stderr, "Lut::to_byte_packed_nodither: %s value 0x%08x (%.9g) gives %d instead of %d\n",
+                                 isAlpha ? "alpha" : "color", bits, src[i], dst[i], expected);
+                }
+            }
+        }
+        if (errors) {
+            std::fprintf(stderr, "Lut::to_byte_packed_nodither: %d wrong value(s) with %d component(s)\n", errors, nComponents);
+            ++failures;
+        }
+    }
+
+    return failures;
+}
+
+/** @brief the effect of PixelPipelineProcessor, which does nothing */
+struct IdentityFunctor
+{
+    void operator()(float *,
+                    int,
+                    int,
+                    int)
+    {
+    }
+};
+
+/** @brief run PixelPipelineProcessor with an identity effect, masked and mixed, and compare it with the chain
+   it replaces: PixelCopierUnPremult to a float RGBA image, then ofxsPremultMaskMixPix() on each pixel.
+   The source partially overlaps the render window. Return 1 if any pixel differs. */
+template <class PIX, int srcNComponents, int dstNComponents, int maxValue>
+int
+checkPixelPipeline(OFX::ImageEffect* effect,
+                   OFX::BitDepthEnum depth,
+                   bool premult)
+{
+    const OfxRectI window = { 0, 0, 67, 13 };
+    const OfxRectI srcBounds = { -9, -2, 58, 11 };
+    const OfxRectI origBounds = { 5, 1, 72, 14 };
+    BenchImage src(srcBounds, srcNComponents, depth);
+    BenchImage orig(origBounds, dstNComponents, depth);
+    BenchImage mask(window, 1, depth);
+    BenchImage dst(window, dstNComponents, depth);
+    BenchImage unp(window, 4, OFX::eBitDepthFloat);
+    int errors = 0;
+
+    src.fill(1, false);
+    orig.fill(2, false);
+    mask.fill(3, true);
+
+    OFX::PixelPipelineProcessor<PIX, srcNComponents, maxValue, PIX, dstNComponents, maxValue, IdentityFunctor, true> p(*effect);
+    p.setDstImg( dst.image() );
+    p.setSrcImg( src.image() );
+    p.setOrigImg( orig.image() );
+    p.setMaskImg(mask.image(), false);
+    p.doMasking(true);
+    p.setPremultMaskMix(premult, 3, 0.75);
+    p.setRenderWindow(window);
+    p.process();
+
+    OFX::PixelCopierUnPremult<PIX, srcNComponents, maxValue, float, 4, 1> u(*effect);
+    u.setDstImg( unp.image() );
+    u.setSrcImg( src.image() );
+    u.setPremultMaskMix(premult, 3, 1.);
+    u.setRenderWindow(window);
+    u.process();
+
+    for (int y = window.y1; y < window.y2; ++y) {
+        for (int x = window.x1; x < window.x2; ++x) {
+            const float *unpPix = (const float *)unp.image()->getPixelAddress(x, y);
+            const PIX *origPix = (const PIX *)orig.image()->getPixelAddress(x, y);
+            const PIX *dstPix = (const PIX *)dst.image()->getPixelAddress(x, y);
+            PIX expected[dstNComponents];
+            OFX::ofxsPremultMaskMixPix<PIX, dstNComponents, maxValue, true>(unpPix, premult, 3, x, y, origPix, true, mask.image(), 0.75f, false, expected);
+            for (int c = 0; c < dstNComponents; ++c) {
+                if ( !(dstPix[c] == expected[c]) && (errors++ < 10) ) {
+                    std::fprintf(stderr, "PixelPipelineProcessor<%s, %d -> %d, premult=%d>: (%d,%d)[%d] is %g instead of %g\n",
+                                 getBitDepthName(depth), srcNComponents, dstNComponents, (int)premult, x, y, c, (double)dstPix[c], (double)expected[c]);
+                }
+            }
+        }
+    }
+    if (errors) {
+        std::fprintf(stderr, "PixelPipelineProcessor<%s, %d -> %d, premult=%d>: %d wrong value(s)\n",
+                     getBitDepthName(depth), srcNComponents, dstNComponents, (int)premult, errors);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+template <class PIX, int maxValue>
+int
+checkPixelPipelineForDepth(OFX::ImageEffect* effect,
+                           OFX::BitDepthEnum depth)
+{
+    int failures = 0;
+
+    for (int premult = 0; premult <= 1; ++premult) {
+        failures += checkPixelPipeline<PIX, 3, 3, maxValue>(effect, depth, premult != 0);
+        failures += checkPixelPipeline<PIX, 4, 4, maxValue>(effect, depth, premult != 0);
+        failures += checkPixelPipeline<PIX, 4, 3, maxValue>(effect, depth, premult != 0);
+    }
+
+    return failures;
+}
+
+/** @brief mergePixel<f, float, nComponents, 1>() for the operator given at run time. Return true if MergeProcessor
+   computes the operator in single precision (see MergeOp), where mergePixel() may use double precision. */
+template <int nComponents, int f = 0>
+struct MergePixelDispatch
+{
+    static bool run(OFX::MergeImages2D::MergingFunctionEnum operation,
+                    bool alphaMasking,
+                    const float A[4],
+                    const float B[4],
+                    float *res)
+    {
+        if (operation != f) {
+            return MergePixelDispatch<nComponents, f + 1>::run(operation, alphaMasking, A, B, res);
+        }
+        OFX::MergeImages2D::mergePixel<(OFX::MergeImages2D::MergingFunctionEnum)f, float, nComponents, 1>(alphaMasking, A, B, res);
+
+        return OFX::MergeImages2D::MergeOp<(OFX::MergeImages2D::MergingFunctionEnum)f>::kVectorized != 0;
+    }
+};
+
+template <int nComponents>
+struct MergePixelDispatch<nComponents, OFX::MergeImages2D::eMergeXOR + 1>
+{
+    static bool run(OFX::MergeImages2D::MergingFunctionEnum,
+                    bool,
+                    const float *,
+                    const float *,
+                    float *)
+    {
+        assert(false);
+
+        return false;
+    }
+};
+
+/** @brief run MergeProcessor with every operator, and compare it with mergePixel<f, float, nComponents, 1>() on the
+   normalized pixels of A and B, rounded by ofxsClampIfInt(). A and B overlap partially, and some pixels of the render
+   window are outside of both. The processor is run unmasked (where the result goes straight to the destination)
+   and with an inverted missing mask (where it is masked with a mask of 1).
+   The operators computed in single precision may differ by one unit of the destination (one integer step, or the
+   precision of half or float), the others must give exactly the same values. Return the number of failures. */
+template <class PIX, int nComponents, int maxValue>
+int
+checkMergeProcessor(OFX::ImageEffect* effect,
+                    OFX::BitDepthEnum depth)
+{
+    const OfxRectI window = { 0, 0, 67, 13 };
+    const OfxRectI boundsA = { -9, -2, 40, 11 };
+    const OfxRectI boundsB = { 20, 4, 72, 14 };
+    BenchImage srcA(boundsA, nComponents, depth);
+    BenchImage srcB(boundsB, nComponents, depth);
+    BenchImage dst(window, nComponents, depth);
+    int failures = 0;
+
+    srcA.fill(1, false);
+    srcB.fill(2, false);
+    for (int o = 0; o <= (int)OFX::MergeImages2D::eMergeXOR; ++o) {
+        const OFX::MergeImages2D::MergingFunctionEnum operation = (OFX::MergeImages2D::MergingFunctionEnum)o;
+        for (int run = 0; run < 4; ++run) {
+            const bool alphaMasking = (run & 1) != 0;
+            const bool masked = (run & 2) != 0;
+            std::auto_ptr<OFX::MergeImages2D::MergeProcessorBase> p( OFX::MergeImages2D::createMergeProcessor<PIX, nComponents, maxValue>(*effect, operation) );
+            int errors = 0;
+
+            dst.clear();
+            p->setDstImg( dst.image() );
+            p->setSrcImg( srcA.image(), srcB.image() );
+            p->setMaskImg(NULL, true);
+            p->doMasking(masked);
+            p->setValues(alphaMasking, 1.);
+            p->setRenderWindow(window);
+            p->process();
+
+            for (int y = window.y1; y < window.y2; ++y) {
+                for (int x = window.x1; x < window.x2; ++x) {
+                    const PIX *dstPix = (const PIX *)dst.image()->getPixelAddress(x, y);
+                    float A[4], B[4], res[4];
+                    OFX::MergeImages2D::mergeLoadPixel<PIX, nComponents, maxValue>( (const PIX *)srcA.image()->getPixelAddress(x, y), A );
+                    OFX::MergeImages2D::mergeLoadPixel<PIX, nComponents, maxValue>( (const PIX *)srcB.image()->getPixelAddress(x, y), B );
+                    const bool singlePrecision = MergePixelDispatch<nComponents>::run(operation, alphaMasking, A, B, res);
+                    for (int c = 0; c < nComponents; ++c) {
+                        const float expected = OFX::ofxsClampIfInt<PIX, maxValue>(res[c] * maxValue, 0, maxValue);
+                        const float result = dstPix[c];
+                        const float unit = (maxValue != 1) ? 1.f : ( (depth == OFX::eBitDepthHalf) ? 1e-3f : 1e-6f ) * std::max( 1.f, std::fabs(expected) );
+                        // all NaNs are equal
+                        const bool ok = (result == expected) || ( (result != result) && (expected != expected) ) ||
+                                        ( singlePrecision && std::fabs(result - expected) <= unit );
+                        if ( !ok && (errors++ < 5) ) {
+                            std::fprintf(stderr, "MergeProcessor<%s, %s, %d%s%s>: (%d,%d)[%d] is %g instead of %g\n",
+                                         OFX::MergeImages2D::getOperationString(operation).c_str(), getBitDepthName(depth), nComponents,
+                                         alphaMasking ? ", alpha masking" : "", masked ? ", masked" : "", x, y, c, result, expected);
+                        }
+                    }
+                }
+            }
+            if (errors) {
+                std::fprintf(stderr, "MergeProcessor<%s, %s, %d%s%s>: %d wrong value(s)\n",
+                             OFX::MergeImages2D::getOperationString(operation).c_str(), getBitDepthName(depth), nComponents,
+                             alphaMasking ? ", alpha masking" : "", masked ? ", masked" : "", errors);
+                ++failures;
+            }
+        }
+    }
+
+    return failures;
+}
+
+template <class PIX, int maxValue>
+int
+checkMergeProcessorForDepth(OFX::ImageEffect* effect,
+                            OFX::BitDepthEnum depth)
+{
+    return checkMergeProcessor<PIX, 1, maxValue>(effect, depth) +
+           checkMergeProcessor<PIX, 3, maxValue>(effect, depth) +
+           checkMergeProcessor<PIX, 4, maxValue>(effect, depth);
+}
+
+/** @brief copy a source with copyPixels() to render windows that are inside it, as wide as its padded rows,
+   and larger than it on all sides, and check that every pixel of the destination is the source pixel inside
+   the source bounds, and black outside (the padding is never read). Return the number of failures. */
+template <class PIX, int nComponents>
+int
+checkCopyPixels(OFX::ImageEffect* effect,
+                OFX::BitDepthEnum depth)
+{
+    const OfxRectI srcBounds = { 3, 2, 40, 9 };
+    const int paddings[] = { 0, 1, 5 };
+    const size_t pixelBytes = sizeof(PIX) * nComponents;
+    int failures = 0;
+
+    for (size_t p = 0; p < sizeof(paddings) / sizeof(paddings[0]); ++p) {
+        const int padding = paddings[p];
+        const OfxRectI windows[] = {
+            srcBounds,
+            { srcBounds.x1, srcBounds.y1, srcBounds.x2 + padding, srcBounds.y2 },
+            { srcBounds.x1 + 2, srcBounds.y1 + 1, srcBounds.x2 - 3, srcBounds.y2 - 1 },
+            { srcBounds.x1 - 4, srcBounds.y1 - 2, srcBounds.x2 + padding + 6, srcBounds.y2 + 3 },
+        };
+        BenchImage src(srcBounds, nComponents, depth, padding);
+        src.fill(1, false);
+
+        for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); ++w) {
+            const OfxRectI & window = windows[w];
+            BenchImage dst(window, nComponents, depth);
+            int errors = 0;
+
+            // pixels that are not written are visible
+            dst.fill(2, false);
+            OFX::copyPixels( *effect, window, src.image(), dst.image() );
+            for (int y = window.y1; y < window.y2; ++y) {
+                for (int x = window.x1; x < window.x2; ++x) {
+                    const PIX *srcPix = (const PIX *)src.image()->getPixelAddress(x, y);
+                    const PIX *dstPix = (const PIX *)dst.image()->getPixelAddress(x, y);
+                    const PIX black[nComponents] = { PIX() };
+                    if ( ( std::memcmp(dstPix, srcPix ? srcPix : black, pixelBytes) != 0 ) && (errors++ < 5) ) {
+                        std::fprintf(stderr, "copyPixels<%s, %d>: padding %d, window (%d,%d)-(%d,%d): (%d,%d)[0] is %g instead of %g\n",
+                                     getBitDepthName(depth), nComponents, padding, window.x1, window.y1, window.x2, window.y2,
+                                     x, y, (double)dstPix[0], (double)(srcPix ? srcPix[0] : PIX()) );
+                    }
+                }
+            }
+            if (errors) {
+                std::fprintf(stderr, "copyPixels<%s, %d>: padding %d, window (%d,%d)-(%d,%d): %d wrong pixel(s)\n",
+                             getBitDepthName(depth), nComponents, padding, window.x1, window.y1, window.x2, window.y2, errors);
+                ++failures;
+            }
+        }
+    }
+
+    return failures;
+}
+
+template <class PIX>
+int
+checkCopyPixelsForDepth(OFX::ImageEffect* effect,
+                        OFX::BitDepthEnum depth)
+{
+    return checkCopyPixels<PIX, 1>(effect, depth) +
+           checkCopyPixels<PIX, 3>(effect, depth) +
+           checkCopyPixels<PIX, 4>(effect, depth);
+}
+} // anon namespace
+
+int
+main(int /*argc*/,
+     char* /*argv*/[])
+{
+    static const int sizes[][2] = { { 38, 22 }, { 130, 66 } };
+    static const OFX::BitDepthEnum depths[] = { OFX::eBitDepthUByte, OFX::eBitDepthUShort, OFX::eBitDepthHalf, OFX::eBitDepthFloat };
+    static const int components[] = { 1, 3, 4 };
+    OFX::ImageEffect effect;
+    int failures = 0;
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d) {
+            for (size_t c = 0; c < sizeof(components) / sizeof(components[0]); ++c) {
+                KernelImages images(&effect, sizes[s][0], sizes[s][1], depths[d], components[c]);
+                KernelContext & ctx = images.context();
+
+                for (const Kernel* k = getKernels(); k->name; ++k) {
+                    if ( !isKernelSupported(*k, depths[d], components[c]) ) {
+                        continue;
+                    }
+                    for (int o = 0; o < (k->perOperation ? (int)OFX::MergeImages2D::eMergeXOR + 1 : 1); ++o) {
+                        std::string name = k->name;
+                        if (k->perOperation) {
+                            ctx.operation = (OFX::MergeImages2D::MergingFunctionEnum)o;
+                            name += "/" + OFX::MergeImages2D::getOperationString(ctx.operation);
+                        }
+                        BenchImage & output = images.output(*k);
+                        output.clear();
+                        // the dithered conversion uses std::rand()
+                        std::srand(1);
+                        k->run(ctx);
+                        std::printf( "%s %dx%d %s %d %016llx\n", name.c_str(), sizes[s][0], sizes[s][1],
+                                     getBitDepthName(depths[d]), components[c], output.hash() );
+                    }
+                }
+                ctx.operation = OFX::MergeImages2D::eMergeOver;
+            }
+        }
+    }
+
+    failures += checkClampIfInt<unsigned char, 255>("8u");
+    failures += checkClampIfInt<unsigned short, 65535>("16u");
+    failures += checkLutToBytes();
+    failures += checkPixelPipelineForDepth<unsigned char, 255>(&effect, OFX::eBitDepthUByte);
+    failures += checkPixelPipelineForDepth<unsigned short, 65535>(&effect, OFX::eBitDepthUShort);
+    failures += checkPixelPipelineForDepth<float, 1>(&effect, OFX::eBitDepthFloat);
+    failures += checkCopyPixelsForDepth<unsigned char>(&effect, OFX::eBitDepthUByte);
+    failures += checkCopyPixelsForDepth<unsigned short>(&effect, OFX::eBitDepthUShort);
+    failures += checkCopyPixelsForDepth<float>(&effect, OFX::eBitDepthFloat);
+    failures += checkMergeProcessorForDepth<unsigned char, 255>(&effect, OFX::eBitDepthUByte);
+    failures += checkMergeProcessorForDepth<unsigned short, 65535>(&effect, OFX::eBitDepthUShort);
+    failures += checkMergeProcessorForDepth<OFX::Half, 1>(&effect, OFX::eBitDepthHalf);
+    failures += checkMergeProcessorForDepth<float, 1>(&effect, OFX::eBitDepthFloat);
+
+    if (failures) {
+        std::fprintf(stderr, "%d test(s) failed\n", failures);
+
+        return 1;
+    }
+
+    return 0;
+}
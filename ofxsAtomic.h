@@ -0,0 +1,142 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Minimal atomic operations.
+ *
+ * The support library is C++98, so std::atomic is not available. These wrap the
+ * compiler intrinsics, and are only meant for simple counters, flags and pointers
+ * that are published once.
+ */
+
+#ifndef openfx_supportext_ofxsAtomic_h
+#define openfx_supportext_ofxsAtomic_h
+
+#include "ofxsMacros.h"
+
+#if COMPILER(MSVC)
+#include <intrin.h>
+#pragma intrinsic(_InterlockedExchangeAdd)
+#pragma intrinsic(_InterlockedCompareExchangePointer)
+#pragma intrinsic(_ReadWriteBarrier)
+#endif
+
+namespace OFX {
+namespace Atomic {
+
+/// atomically add v to *p, and return the previous value of *p
+inline int
+fetchAndAdd(volatile int* p,
+            int v)
+{
+#if COMPILER(MSVC)
+    return _InterlockedExchangeAdd( (volatile long*)p, v );
+#elif COMPILER(GCC) || COMPILER(CLANG)
+    return __sync_fetch_and_add(p, v);
+#else
+#error "OFX::Atomic::fetchAndAdd is not implemented for this compiler"
+#endif
+}
+
+/// atomically set *p to newValue if it is oldValue, and return true if it was.
+/// This is a full barrier: what was written before is visible to the threads that read newValue.
+template <class T>
+inline bool
+compareAndSwapPointer(T* volatile* p,
+                      T* oldValue,
+                      T* newValue)
+{
+#if COMPILER(MSVC)
+    return _InterlockedCompareExchangePointer( (void* volatile*)p, (void*)newValue, (void*)oldValue ) == (void*)oldValue;
+#elif COMPILER(GCC) || COMPILER(CLANG)
+    return __sync_bool_compare_and_swap(p, oldValue, newValue);
+#else
+#error "OFX::Atomic::compareAndSwapPointer is not implemented for this compiler"
+#endif
+}
+
+/// read *p with acquire semantics: if it was published by compareAndSwapPointer(), what was written
+/// before is visible
+template <class T>
+inline T*
+loadPointerAcquire(T* volatile const* p)
+{
+#if COMPILER(MSVC)
+    // volatile reads have acquire semantics with MSVC
+    T* v = *p;
+    _ReadWriteBarrier();
+
+    return v;
+#elif defined(__ATOMIC_ACQUIRE)
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#elif COMPILER(GCC) || COMPILER(CLANG)
+    T* v = *p;
+    __sync_synchronize();
+
+    return v;
+#else
+#error "OFX::Atomic::loadPointerAcquire is not implemented for this compiler"
+#endif
+}
+
+/// read *p with acquire semantics: if it was written by storeRelease(), what was written before is visible
+inline int
+loadAcquire(volatile const int* p)
+{
+#if COMPILER(MSVC)
+    // volatile reads have acquire semantics with MSVC
+    int v = *p;
+    _ReadWriteBarrier();
+
+    return v;
+#elif defined(__ATOMIC_ACQUIRE)
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#elif COMPILER(GCC) || COMPILER(CLANG)
+    int v = *p;
+    __sync_synchronize();
+
+    return v;
+#else
+#error "OFX::Atomic::loadAcquire is not implemented for this compiler"
+#endif
+}
+
+/// write v to *p with release semantics: what was written before is visible to the threads that
+/// read v with loadAcquire()
+inline void
+storeRelease(volatile int* p,
+             int v)
+{
+#if COMPILER(MSVC)
+    // volatile writes have release semantics with MSVC
+    _ReadWriteBarrier();
+    *p = v;
+#elif defined(__ATOMIC_RELEASE)
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#elif COMPILER(GCC) || COMPILER(CLANG)
+    __sync_synchronize();
+    *p = v;
+#else
+#error "OFX::Atomic::storeRelease is not implemented for this compiler"
+#endif
+}
+
+} // namespace Atomic
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsAtomic_h
@@ -24,12 +24,186 @@
 #define IO_ofxsCopier_h
 
 #include <cstring>
+#include <limits>
 #include <algorithm>
 
 #include "ofxsPixelProcessor.h"
 #include "ofxsMaskMix.h"
+#include "ofxsMaskMixRow.h"
+#include "ofxsSimd.h"
+#include "ofxsHalf.h"
 
 namespace OFX {
+/** @brief vectorized kernels for the contiguous source spans of the (un)premult copiers.
+   Each function returns false if there is no vectorized version for these types, in which case
+   the scalar code must be used. */
+template <class SRCPIX, int srcNComponents, int srcMaxValue, class DSTPIX, int dstNComponents, int dstMaxValue
+#ifdef OFXS_USE_SSE2
+          , bool supported = (OFX::Simd::PixelIO<SRCPIX, srcMaxValue>::supported && OFX::Simd::PixelIO<DSTPIX, dstMaxValue>::supported &&
+                              (srcNComponents == 3 || srcNComponents == 4) && (dstNComponents == 3 || dstNComponents == 4))
+#else
+          , bool supported = false
+#endif
+          >
+struct PixelCopierSimd
+{
+    enum { kSupported = 0 };
+
+    static bool unPremultRow(const SRCPIX * /*srcPix*/, int /*n*/, bool /*premult*/, DSTPIX * /*dstPix*/) { return false; }
+
+    static bool premultRow(const SRCPIX * /*srcPix*/, int /*n*/, bool /*premult*/, DSTPIX * /*dstPix*/) { return false; }
+
+    static bool premultMaskMixPix(const SRCPIX * /*srcPix*/, bool /*premult*/, float /*alpha*/, const DSTPIX * /*origPix*/, DSTPIX * /*dstPix*/) { return false; }
+};
+
+#ifdef OFXS_USE_SSE2
+template <class SRCPIX, int srcNComponents, int srcMaxValue, class DSTPIX, int dstNComponents, int dstMaxValue>
+struct PixelCopierSimd<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue, true>
+{
+    enum { kSupported = 1 };
+
+    // load a source pixel, normalized to [0,1], with alpha = 1 if there is no alpha (as in ofxsToRGBA())
+    static __m128 loadNormalized(const SRCPIX *srcPix)
+    {
+        // divide rather than multiply by the inverse, to get the same results as the scalar code
+        __m128 u = _mm_div_ps( OFX::Simd::loadPixel<SRCPIX, srcMaxValue, srcNComponents>(srcPix), _mm_set1_ps( (float)srcMaxValue ) );
+
+        return (srcNComponents == 3) ? OFX::Simd::setAlpha( u, _mm_set1_ps(1.f) ) : u;
+    }
+
+    // same as ofxsUnPremult() followed by the denormalization to dstMaxValue
+    static bool unPremultRow(const SRCPIX *srcPix,
+                             int n,
+                             bool premult,
+                             DSTPIX *dstPix)
+    {
+        const __m128 srcMax = _mm_set1_ps( (float)srcMaxValue );
+        const __m128 dstMax = _mm_set1_ps( (float)dstMaxValue );
+        const __m128 one = _mm_set1_ps(1.f);
+        // same threshold as ofxsUnPremult()
+        const __m128 threshold = _mm_set1_ps( (float)(SRCPIX)(std::numeric_limits<float>::min() * srcMaxValue) );
+
+        for (int i = 0; i < n; ++i, srcPix += srcNComponents, dstPix += dstNComponents) {
+            __m128 p = OFX::Simd::loadPixel<SRCPIX, srcMaxValue, srcNComponents>(srcPix);
+            __m128 u;
+            if (premult && srcNComponents == 4) {
+                // divide color by alpha if it is not zero, else by srcMaxValue
+                __m128 a = OFX::Simd::splatAlpha(p);
+                __m128 d = OFX::Simd::select(_mm_cmpgt_ps(a, threshold), a, srcMax);
+                u = _mm_div_ps( p, OFX::Simd::setAlpha(d, srcMax) );
+            } else {
+                u = _mm_div_ps(p, srcMax);
+                if (srcNComponents == 3) {
+                    u = OFX::Simd::setAlpha(u, one);
+                }
+            }
+            OFX::Simd::storePixel<DSTPIX, dstMaxValue, dstNComponents>( dstPix, _mm_mul_ps(u, dstMax) );
+        }
+
+        return true;
+    }
+
+    // same as ofxsPremult() on the normalized source pixel
+    static __m128 premultPix(const SRCPIX *srcPix,
+                             bool premult)
+    {
+        __m128 u = loadNormalized(srcPix);
+
+        if (premult) {
+            u = _mm_mul_ps( u, OFX::Simd::setAlpha( OFX::Simd::splatAlpha(u), _mm_set1_ps(1.f) ) );
+        }
+
+        return _mm_mul_ps( u, _mm_set1_ps( (float)dstMaxValue ) );
+    }
+
+    static bool premultRow(const SRCPIX *srcPix,
+                           int n,
+                           bool premult,
+                           DSTPIX *dstPix)
+    {
+        for (int i = 0; i < n; ++i, srcPix += srcNComponents, dstPix += dstNComponents) {
+            OFX::Simd::storePixel<DSTPIX, dstMaxValue, dstNComponents>( dstPix, premultPix(srcPix, premult) );
+        }
+
+        return true;
+    }
+
+    // same as ofxsPremultMaskMixPix(), with the mask already applied to alpha
+    static bool premultMaskMixPix(const SRCPIX *srcPix,
+                                  bool premult,
+                                  float alpha,
+                                  const DSTPIX *origPix,
+                                  DSTPIX *dstPix)
+    {
+        __m128 v = _mm_mul_ps( premultPix(srcPix, premult), _mm_set1_ps(alpha) );
+
+        if (origPix) {
+            __m128 o = OFX::Simd::loadPixel<DSTPIX, dstMaxValue, dstNComponents>(origPix);
+            v = _mm_add_ps( v, _mm_mul_ps(_mm_set1_ps(1.f - alpha), o) );
+        }
+        OFX::Simd::storePixel<DSTPIX, dstMaxValue, dstNComponents>(dstPix, v);
+
+        return true;
+    }
+};
+#endif // ifdef OFXS_USE_SSE2
+
+// Fills and copies of more than OFXS_NON_TEMPORAL_THRESHOLD bytes use non-temporal stores, so that
+// they do not evict the data of the other render threads from the shared cache.
+#ifndef OFXS_NON_TEMPORAL_THRESHOLD
+#define OFXS_NON_TEMPORAL_THRESHOLD (16 * 1024 * 1024)
+#endif
+
+/// should a fill or a copy of nBytes in total use non-temporal stores?
+inline bool
+ofxsUseNonTemporalStores(size_t nBytes)
+{
+#ifdef OFXS_USE_SSE2
+    return nBytes >= (size_t)OFXS_NON_TEMPORAL_THRESHOLD;
+#else
+    (void)nBytes;
+
+    return false;
+#endif
+}
+
+/// set nBytes of dst to zero (i.e. black and transparent for all bit depths)
+inline void
+ofxsZeroBytes(void *dst,
+              size_t nBytes,
+              bool nonTemporal)
+{
+#ifdef OFXS_USE_SSE2
+    if (nonTemporal) {
+        OFX::Simd::streamZero(dst, nBytes);
+
+        return;
+    }
+#else
+    (void)nonTemporal;
+#endif
+    std::memset(dst, 0, nBytes);
+}
+
+/// copy nBytes from src to dst
+inline void
+ofxsCopyBytes(void *dst,
+              const void *src,
+              size_t nBytes,
+              bool nonTemporal)
+{
+#ifdef OFXS_USE_SSE2
+    if (nonTemporal) {
+        OFX::Simd::streamCopy(dst, src, nBytes);
+
+        return;
+    }
+#else
+    (void)nonTemporal;
+#endif
+    std::memcpy(dst, src, nBytes);
+}
+
 // Base class for the RGBA and the Alpha processor
 
 template <class PIX, int nComponents>
@@ -41,6 +215,7 @@ public:
     PixelCopier(OFX::ImageEffect &instance)
         : OFX::PixelProcessorFilterBase(instance)
     {
+        setPixelCost(OFX::ePixelProcessorCostCheap);
     }
 
     // and do some processing
@@ -48,7 +223,25 @@ public:
     {
         assert(_srcBounds.x1 < _srcBounds.x2 && _srcBounds.y1 < _srcBounds.y2); // image should be non-empty
 
-        int rowBytes = sizeof(PIX) * nComponents * (procWindow.x2 - procWindow.x1);
+        const size_t pixelBytes = sizeof(PIX) * nComponents;
+        const size_t rowBytes = pixelBytes * (procWindow.x2 - procWindow.x1);
+        const int srcHeight = _srcBounds.y2 - _srcBounds.y1;
+        // a large render: do not pollute the cache with destination rows that are not read back
+        const bool nonTemporal = ofxsUseNonTemporalStores( pixelBytes * (_renderWindow.x2 - _renderWindow.x1) * (_renderWindow.y2 - _renderWindow.y1) );
+
+        if ( (rowBytes == (size_t)_dstRowBytes) && (rowBytes == (size_t)_srcRowBytes) &&
+             (procWindow.x1 == _srcBounds.x1) && (procWindow.x2 == _srcBounds.x2) &&
+             (_srcBounds.y1 <= procWindow.y1) && (procWindow.y2 <= _srcBounds.y2) ) {
+            // the source and destination rows are contiguous in memory, without padding (the source rows
+            // are exactly the rows of the render window): copy them all at once
+            ofxsCopyBytes(getDstPixelAddress(procWindow.x1, procWindow.y1), getSrcPixelAddress(procWindow.x1, procWindow.y1),
+                          rowBytes * (procWindow.y2 - procWindow.y1), nonTemporal);
+
+            return;
+        }
+        // the last row built, and the source row it was built from
+        const PIX *prevSrcRow = 0;
+        const PIX *prevDstRow = 0;
 
         for (int dsty = procWindow.y1; dsty < procWindow.y2; ++dsty) {
             if ( _effect.abort() ) {
@@ -69,104 +262,106 @@ public:
                 }
             } else if (_srcBoundary == 2) {
                 if (srcy < _srcBounds.y1 || _srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
+                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, srcHeight);
                 }
             }
 
-            if ( (srcy < _srcBounds.y1) || (_srcBounds.y2 <= srcy) || (_srcBounds.y2 <= _srcBounds.y1)) {
+            if ( (srcy < _srcBounds.y1) || (_srcBounds.y2 <= srcy) ) {
                 assert(_srcBoundary == 0);
-                std::memset(dstPix, 0, rowBytes);
+                ofxsZeroBytes(dstPix, rowBytes, nonTemporal);
+                prevSrcRow = 0;
+                continue;
+            }
+
+            const PIX *srcRow = (const PIX *) getSrcPixelAddress(_srcBounds.x1, srcy);
+            assert(srcRow);
+            if ( (_srcBoundary == 2) && (procWindow.y1 <= dsty - srcHeight) ) {
+                // vertical repeat: the row one period above was already built
+                std::memcpy(dstPix, getDstPixelAddress(procWindow.x1, dsty - srcHeight), rowBytes);
+            } else if (srcRow == prevSrcRow) {
+                // nearest, above or below the source: same row as the previous one
+                std::memcpy(dstPix, prevDstRow, rowBytes);
             } else {
-                int x1 = std::max(_srcBounds.x1, procWindow.x1);
-                int x2 = std::min(_srcBounds.x2, procWindow.x2);
-                // start of line may be black
-                if (procWindow.x1 < x1) {
-                    if (_srcBoundary != 1 && _srcBoundary != 2) {
-                        std::memset( dstPix, 0, sizeof(PIX) * nComponents * (x1 - procWindow.x1) );
-                        dstPix += nComponents * (x1 - procWindow.x1);
-                    } else if (_srcBoundary == 1) {
-                        const PIX *srcPix = (const PIX *) getSrcPixelAddress(x1, srcy);
-                        assert(srcPix);
-#                     ifdef DEBUG
-                        for (int c = 0; c < nComponents; ++c) {
-                            assert(srcPix[c] == srcPix[c]); // check for NaN
-                        }
-#                     endif
-                        for (int x = procWindow.x1; x < x1; ++x) {
-                            std::copy(srcPix, srcPix + nComponents, dstPix);
-                            dstPix += nComponents;
-                        }
-                    } else if (_srcBoundary == 2) {
-                        int srcx = procWindow.x1;
-                        if (srcx < _srcBounds.x1 || _srcBounds.x2 <= srcx) {
-                            srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
-                        }
+                buildRow(srcRow, procWindow.x1, procWindow.x2, nonTemporal, dstPix);
+            }
+            prevSrcRow = srcRow;
+            prevDstRow = dstPix;
+        }
+    }
 
-                        const PIX *srcPix = (const PIX *) getSrcPixelAddress(srcx, srcy);
-                        assert(srcPix);
-                        for (int x = procWindow.x1; x < x1; ++x) {
-#                         ifdef DEBUG
-                            for (int c = 0; c < nComponents; ++c) {
-                                assert(srcPix[c] == srcPix[c]); // check for NaN
-                            }
-#                         endif
-                            std::copy(srcPix, srcPix + nComponents, dstPix);
-                            dstPix += nComponents;
-                            ++srcx;
-                            if (_srcBounds.x2 <= srcx) {
-                                srcx -= (_srcBounds.y2 - _srcBounds.y1);
-                                srcPix -= (_srcBounds.y2 - _srcBounds.y1)*nComponents;
-                            }
-                        }
-                    }
-                }
-                // then, copy the relevant fraction of src
-                if ( (x1 < x2) && (procWindow.x1 <= x1) && (x2 <= procWindow.x2) ) {
-                    const PIX *srcPix = (const PIX *) getSrcPixelAddress(x1, srcy);
-                    assert(srcPix);
-#                 ifdef DEBUG
-                    for (int c = 0; c < nComponents * (x2 - x1); ++c) {
-                        assert(srcPix[c] == srcPix[c]); // check for NaN
-                    }
-#                 endif
-                    std::memcpy( dstPix, srcPix, sizeof(PIX) * nComponents * (x2 - x1) );
-                    dstPix += nComponents * (x2 - x1);
-                }
-                // end of line may be black
-                if (x2 < procWindow.x2) {
-                    if (_srcBoundary != 1 && _srcBoundary != 2) {
-                        std::memset( dstPix, 0, sizeof(PIX) * nComponents * (procWindow.x2 - x2) );
-                    } else if (_srcBoundary == 1) {
-                        const PIX *srcPix = (const PIX *) getSrcPixelAddress(x2-1, srcy);
-                        assert(srcPix);
-                        for (int x = x2; x < procWindow.x2; ++x) {
-                            std::memcpy( dstPix, srcPix, sizeof(PIX) * nComponents );
-                            dstPix += nComponents;
-                        }
-                    } else if (_srcBoundary == 2) {
-                        int srcx = x2;
-                        while (_srcBounds.x2 <= srcx) {
-                            srcx -= (_srcBounds.x2 - _srcBounds.x1);
-                        }
+private:
+    /** @brief fill the n pixels of dstPix from the first period pixels, which are already set, by memcpy of
+       doubling size */
+    static void replicatePixels(PIX *dstPix,
+                                int period,
+                                int n)
+    {
+        const size_t total = sizeof(PIX) * nComponents * n;
+        size_t done = sizeof(PIX) * nComponents * period;
 
-                        const PIX *srcPix = (const PIX *) getSrcPixelAddress(srcx, srcy);
-                        assert(srcPix);
-                        for (int x = x2; x < procWindow.x2; ++x) {
-#                         ifdef DEBUG
-                            for (int c = 0; c < nComponents; ++c) {
-                                assert(srcPix[c] == srcPix[c]); // check for NaN
-                            }
-#                         endif
-                            std::copy(srcPix, srcPix + nComponents, dstPix);
-                            dstPix += nComponents;
-                            ++srcx;
-                            if (_srcBounds.x2 <= srcx) {
-                                srcx -= (_srcBounds.y2 - _srcBounds.y1);
-                                srcPix -= (_srcBounds.y2 - _srcBounds.y1)*nComponents;
-                            }
-                        }
-                    }
-                }
+        while (done < total) {
+            size_t count = std::min(done, total - done);
+            std::memcpy( (char *)dstPix + done, dstPix, count );
+            done += count;
+        }
+    }
+
+    /** @brief build the row [x1,x2) of the destination from srcRow, the source row, with the boundary conditions.
+       With Nearest and Repeat, the row is read back to replicate pixels or rows, so nonTemporal is only used for Black. */
+    void buildRow(const PIX *srcRow,
+                  int x1,
+                  int x2,
+                  bool nonTemporal,
+                  PIX *dstPix) const
+    {
+        const size_t pixelBytes = sizeof(PIX) * nComponents;
+
+        if (_srcBoundary == 2) {
+            // repeat: copy the first period from the source row, then replicate it
+            const int period = _srcBounds.x2 - _srcBounds.x1;
+            const int n = x2 - x1;
+            const int srcx = positive_modulo(x1 - _srcBounds.x1, period);
+            const int first = std::min(period - srcx, n);
+            std::memcpy(dstPix, srcRow + nComponents * srcx, pixelBytes * first);
+            if (first < n) {
+                std::memcpy( dstPix + nComponents * first, srcRow, pixelBytes * std::min(srcx, n - first) );
+            }
+            replicatePixels(dstPix, period, n);
+
+            return;
+        }
+
+        // the part of the row that is inside the source
+        const int sx1 = std::min(std::max(_srcBounds.x1, x1), x2);
+        const int sx2 = std::max(std::min(_srcBounds.x2, x2), sx1);
+        // start of line may be black, or the first pixel
+        if (x1 < sx1) {
+            if (_srcBoundary == 1) {
+                std::memcpy(dstPix, srcRow, pixelBytes);
+                replicatePixels(dstPix, 1, sx1 - x1);
+            } else {
+                ofxsZeroBytes( dstPix, pixelBytes * (sx1 - x1), nonTemporal );
+            }
+            dstPix += nComponents * (sx1 - x1);
+        }
+        // then, copy the relevant fraction of src
+        if (sx1 < sx2) {
+            const PIX *srcPix = srcRow + nComponents * (sx1 - _srcBounds.x1);
+#         ifdef DEBUG
+            for (int c = 0; c < nComponents * (sx2 - sx1); ++c) {
+                assert(srcPix[c] == srcPix[c]); // check for NaN
+            }
+#         endif
+            ofxsCopyBytes( dstPix, srcPix, pixelBytes * (sx2 - sx1), nonTemporal && (_srcBoundary == 0) );
+            dstPix += nComponents * (sx2 - sx1);
+        }
+        // end of line may be black, or the last pixel
+        if (sx2 < x2) {
+            if (_srcBoundary == 1) {
+                std::memcpy(dstPix, srcRow + nComponents * (_srcBounds.x2 - _srcBounds.x1 - 1), pixelBytes);
+                replicatePixels(dstPix, 1, x2 - sx2);
+            } else {
+                ofxsZeroBytes( dstPix, pixelBytes * (x2 - sx2), nonTemporal );
             }
         }
     }
@@ -185,6 +380,7 @@ public:
         : OFX::PixelProcessorFilterBase(instance)
     {
         assert(nComponents == 4);
+        setPixelCost(OFX::ePixelProcessorCostCheap);
     }
 
     // and do some processing
@@ -196,51 +392,26 @@ public:
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if (srcy < _srcBounds.y1 || _srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
             PIX *dstPix = (PIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
 
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-
-                int srcx = dstx;
-
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
-                    }
-                } else if (_srcBoundary == 2) {
-                    if (srcx < _srcBounds.x1 || _srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
+            OFX::PixelRowSegment seg;
+            for (int dstx = procWindow.x1; dstx < procWindow.x2; dstx = seg.x2) {
+                getSrcRowSegment(dstx, dsty, procWindow.x2, &seg);
+                // srcPix is NULL on black segments
+                const PIX *srcPix = (const PIX *) seg.pix;
+                const int srcStep = (seg.kind == OFX::ePixelRowSegmentPixels) ? nComponents : 0;
+                for (; dstx < seg.x2; ++dstx, srcPix += srcStep) {
+                    // origPix is at dstx,dsty
+                    if (srcPix) {
+                        std::copy(srcPix, srcPix + nComponents - 1, dstPix);
+                        dstPix[nComponents - 1] = maxValue;
+                    } else {
+                        std::fill(dstPix, dstPix + nComponents, 0); // no src pixel here, be black and transparent
                     }
+                    // increment the dst pixel
+                    dstPix += nComponents;
                 }
-
-                // origPix is at dstx,dsty
-                const PIX *srcPix = (const PIX *) getSrcPixelAddress(srcx, srcy);
-                if (srcPix) {
-                    std::copy(srcPix, srcPix + nComponents - 1, dstPix);
-                    dstPix[nComponents - 1] = maxValue;
-                } else {
-                    std::fill(dstPix, dstPix + nComponents, 0); // no src pixel here, be black and transparent
-                }
-                // increment the dst pixel
-                dstPix += nComponents;
             }
         }
     }
@@ -261,61 +432,34 @@ public:
     // and do some processing
     void multiThreadProcessImages(OfxRectI procWindow)
     {
-        float tmpPix[nComponents];
+        // the source row, which is masked and mixed with the original image all at once
+        float *tmpRow = getScratchArena().allocateArray<float>( nComponents * (procWindow.x2 - procWindow.x1) );
 
         for (int dsty = procWindow.y1; dsty < procWindow.y2; ++dsty) {
             if ( _effect.abort() ) {
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if (srcy < _srcBounds.y1 || _srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
             PIX *dstPix = (PIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
 
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-
-                int srcx = dstx;
-
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
-                    }
-                } else if (_srcBoundary == 2) {
-                    if (srcx < _srcBounds.x1 || _srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
+            OFX::PixelRowSegment seg;
+            float *tmpPix = tmpRow;
+            for (int dstx = procWindow.x1; dstx < procWindow.x2; dstx = seg.x2) {
+                getSrcRowSegment(dstx, dsty, procWindow.x2, &seg);
+                // srcPix is NULL on black segments
+                const PIX *srcPix = (const PIX *) seg.pix;
+                const int srcStep = (seg.kind == OFX::ePixelRowSegmentPixels) ? nComponents : 0;
+                for (; dstx < seg.x2; ++dstx, srcPix += srcStep, tmpPix += nComponents) {
+                    if (srcPix) {
+                        std::copy(srcPix, srcPix + nComponents, tmpPix);
+                    } else {
+                        std::fill(tmpPix, tmpPix + nComponents, 0.); // no src pixel here, be black and transparent
                     }
                 }
-
-                // origPix is at dstx,dsty
-                const PIX *origPix = (const PIX *)  (_origImg ? _origImg->getPixelAddress(dstx, dsty) : 0);
-                const PIX *srcPix = (const PIX *) getSrcPixelAddress(srcx, srcy);
-                if (srcPix) {
-                    std::copy(srcPix, srcPix + nComponents, tmpPix);
-                } else {
-                    std::fill(tmpPix, tmpPix + nComponents, 0.); // no src pixel here, be black and transparent
-                }
-                // dstx,dsty are the mask image coordinates (no boundary conditions)
-                ofxsMaskMixPix<PIX, nComponents, maxValue, masked>(tmpPix, dstx, dsty, origPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
-                // increment the dst pixel
-                dstPix += nComponents;
             }
+            // the original image and the mask are at dstx,dsty (no boundary conditions)
+            ofxsMaskMixRow<PIX, nComponents, maxValue, masked>(tmpRow, procWindow.x1, procWindow.x2, dsty, _origImg, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
         }
     }
 };
@@ -344,49 +488,30 @@ public:
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if (srcy < _srcBounds.y1 || _srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
             DSTPIX *dstPix = (DSTPIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
 
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-
-                int srcx = dstx;
-
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
-                    }
-                } else if (_srcBoundary == 2) {
-                    if (srcx < _srcBounds.x1 || _srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
-                    }
+            OFX::PixelRowSegment seg;
+            for (int dstx = procWindow.x1; dstx < procWindow.x2; dstx = seg.x2) {
+                getSrcRowSegment(dstx, dsty, procWindow.x2, &seg);
+                // srcPix is NULL on black segments
+                const SRCPIX *srcPix = (const SRCPIX *) seg.pix;
+                const int srcStep = (seg.kind == OFX::ePixelRowSegmentPixels) ? srcNComponents : 0;
+                if ( (seg.kind == OFX::ePixelRowSegmentPixels) &&
+                     PixelCopierSimd<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue>::unPremultRow(srcPix, seg.x2 - seg.x1, _premult, dstPix) ) {
+                    // the vectorized kernel did the whole span
+                    dstPix += dstNComponents * (seg.x2 - seg.x1);
+                    continue;
                 }
-
-                const SRCPIX *srcPix = (const SRCPIX *) getSrcPixelAddress(srcx, srcy);
-                ofxsUnPremult<SRCPIX, srcNComponents, srcMaxValue>(srcPix, unpPix, _premult, _premultChannel);
-                for (int c = 0; c < dstNComponents; ++c) {
-                    float v = unpPix[c] * dstMaxValue;
-                    dstPix[c] = ofxsClampIfInt<DSTPIX,dstMaxValue>(v, 0, dstMaxValue);
+                for (; dstx < seg.x2; ++dstx, srcPix += srcStep) {
+                    ofxsUnPremult<SRCPIX, srcNComponents, srcMaxValue>(srcPix, unpPix, _premult, _premultChannel);
+                    for (int c = 0; c < dstNComponents; ++c) {
+                        float v = unpPix[c] * dstMaxValue;
+                        dstPix[c] = ofxsClampIfInt<DSTPIX,dstMaxValue>(v, 0, dstMaxValue);
+                    }
+                    // increment the dst pixel
+                    dstPix += dstNComponents;
                 }
-                // increment the dst pixel
-                dstPix += dstNComponents;
             }
         }
     }
@@ -414,71 +539,52 @@ public:
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if (srcy < _srcBounds.y1 || _srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-
             DSTPIX *dstPix = (DSTPIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
 
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-
-                int srcx = dstx;
-
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
-                    }
-                } else if (_srcBoundary == 2) {
-                    if (srcx < _srcBounds.x1 || _srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
-                    }
+            OFX::PixelRowSegment seg;
+            for (int dstx = procWindow.x1; dstx < procWindow.x2; dstx = seg.x2) {
+                getSrcRowSegment(dstx, dsty, procWindow.x2, &seg);
+                // srcPix is NULL on black segments
+                const SRCPIX *srcPix = (const SRCPIX *) seg.pix;
+                const int srcStep = (seg.kind == OFX::ePixelRowSegmentPixels) ? srcNComponents : 0;
+                if ( (seg.kind == OFX::ePixelRowSegmentPixels) &&
+                     PixelCopierSimd<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue>::premultRow(srcPix, seg.x2 - seg.x1, _premult, dstPix) ) {
+                    // the vectorized kernel did the whole span
+                    dstPix += dstNComponents * (seg.x2 - seg.x1);
+                    continue;
                 }
-
-                const SRCPIX *srcPix = (const SRCPIX *) getSrcPixelAddress(srcx, srcy);
-                if (!srcPix) {
-                    // no source, be black and transparent
-                    for (int c = 0; c < dstNComponents; ++c) {
-                        dstPix[c] = DSTPIX();
-                    }
-                } else {
-                    float unpPix[4];
-                    if (srcNComponents == 1) {
-                        unpPix[0] = 0.f;
-                        unpPix[1] = 0.f;
-                        unpPix[2] = 0.f;
-                        unpPix[3] = srcPix[0] / (float)srcMaxValue;
+                for (; dstx < seg.x2; ++dstx, srcPix += srcStep) {
+                    if (!srcPix) {
+                        // no source, be black and transparent
+                        for (int c = 0; c < dstNComponents; ++c) {
+                            dstPix[c] = DSTPIX();
+                        }
                     } else {
-                        unpPix[0] = srcPix[0] / (float)srcMaxValue;
-                        unpPix[1] = srcPix[1] / (float)srcMaxValue;
-                        unpPix[2] = srcPix[2] / (float)srcMaxValue;
-                        unpPix[3] = (srcNComponents == 4) ? (srcPix[3] / (float)srcMaxValue) : 1.0f;
-                    }
-                    float pPix[dstNComponents];
-                    // unpPix is in [0, 1]
-                    // premultiply and denormalize in [0, maxValue]
-                    // if premult is false, just denormalize
-                    ofxsPremult<DSTPIX, dstNComponents, dstMaxValue>(unpPix, pPix, _premult, _premultChannel);
-                    for (int c = 0; c < dstNComponents; ++c) {
-                        dstPix[c] = ofxsClampIfInt<DSTPIX,dstMaxValue>(pPix[c], 0, dstMaxValue);
+                        float unpPix[4];
+                        if (srcNComponents == 1) {
+                            unpPix[0] = 0.f;
+                            unpPix[1] = 0.f;
+                            unpPix[2] = 0.f;
+                            unpPix[3] = srcPix[0] / (float)srcMaxValue;
+                        } else {
+                            unpPix[0] = srcPix[0] / (float)srcMaxValue;
+                            unpPix[1] = srcPix[1] / (float)srcMaxValue;
+                            unpPix[2] = srcPix[2] / (float)srcMaxValue;
+                            unpPix[3] = (srcNComponents == 4) ? (srcPix[3] / (float)srcMaxValue) : 1.0f;
+                        }
+                        float pPix[dstNComponents];
+                        // unpPix is in [0, 1]
+                        // premultiply and denormalize in [0, maxValue]
+                        // if premult is false, just denormalize
+                        ofxsPremult<DSTPIX, dstNComponents, dstMaxValue>(unpPix, pPix, _premult, _premultChannel);
+                        for (int c = 0; c < dstNComponents; ++c) {
+                            dstPix[c] = ofxsClampIfInt<DSTPIX,dstMaxValue>(pPix[c], 0, dstMaxValue);
+                        }
                     }
+                    // increment the dst pixel
+                    dstPix += dstNComponents;
                 }
-                // increment the dst pixel
-                dstPix += dstNComponents;
             }
         }
     }
@@ -513,52 +619,55 @@ public:
                 break;
             }
 
-            int srcy = dsty;
-
-            if (_srcBoundary == 1) {
-                if (_srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y2 - 1;
-                }
-                if (srcy < _srcBounds.y1) {
-                    srcy = _srcBounds.y1;
-                }
-            } else if (_srcBoundary == 2) {
-                if (srcy < _srcBounds.y1 || _srcBounds.y2 <= srcy) {
-                    srcy = _srcBounds.y1 + positive_modulo(srcy - _srcBounds.y1, _srcBounds.y2 - _srcBounds.y1);
-                }
-            }
-            
             DSTPIX *dstPix = (DSTPIX *) getDstPixelAddress(procWindow.x1, dsty);
             assert(dstPix);
 
-            for (int dstx = procWindow.x1; dstx < procWindow.x2; ++dstx) {
-
-                int srcx = dstx;
-
-                if (_srcBoundary == 1) {
-                    if (_srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x2 - 1;
-                    }
-                    if (srcx < _srcBounds.x1) {
-                        srcx = _srcBounds.x1;
+            OFX::PixelRowSegment seg;
+            for (int dstx = procWindow.x1; dstx < procWindow.x2; dstx = seg.x2) {
+                getSrcRowSegment(dstx, dsty, procWindow.x2, &seg);
+                // srcPix is NULL on black segments
+                const SRCPIX *srcPix = (const SRCPIX *) seg.pix;
+                const int srcStep = (seg.kind == OFX::ePixelRowSegmentPixels) ? srcNComponents : 0;
+                for (; dstx < seg.x2; ++dstx, srcPix += srcStep) {
+                    // origPix is at dstx,dsty
+                    const DSTPIX *origPix = (const DSTPIX *)  (_origImg ? _origImg->getPixelAddress(dstx, dsty) : 0);
+                    if ( PixelCopierSimd<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue>::kSupported && (seg.kind != OFX::ePixelRowSegmentBlack) &&
+                         PixelCopierSimd<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue>::premultMaskMixPix(srcPix, _premult, getMaskMix(dstx, dsty), origPix, dstPix) ) {
+                        dstPix += dstNComponents;
+                        continue;
                     }
-                } else if (_srcBoundary == 2) {
-                    if (srcx < _srcBounds.x1 || _srcBounds.x2 <= srcx) {
-                        srcx = _srcBounds.x1 + positive_modulo(srcx - _srcBounds.x1, _srcBounds.x2 - _srcBounds.x1);
+                    for (int c = 0; c < srcNComponents; ++c) {
+                        unpPix[c] = (srcPix ? (srcPix[c] / (float)srcMaxValue) : 0.f);
                     }
+                    // dstx,dsty are the mask image coordinates (no boundary conditions)
+                    ofxsPremultMaskMixPix<DSTPIX, dstNComponents, dstMaxValue, true>(unpPix, _premult, _premultChannel, dstx, dsty, origPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
+                    // increment the dst pixel
+                    dstPix += dstNComponents;
                 }
-                 // origPix is at dstx,dsty
-                const DSTPIX *origPix = (const DSTPIX *)  (_origImg ? _origImg->getPixelAddress(dstx, dsty) : 0);
-                const SRCPIX *srcPix = (const SRCPIX *) getSrcPixelAddress(srcx, srcy);
-                for (int c = 0; c < srcNComponents; ++c) {
-                    unpPix[c] = (srcPix ? (srcPix[c] / (float)srcMaxValue) : 0.f);
+            }
+        }
+    }
+
+private:
+    // the mix factor at (x,y), taking the mask into account, as in ofxsMaskMixPix()
+    float getMaskMix(int x,
+                     int y) const
+    {
+        float maskScale = 1.f;
+
+        if (_doMasking) {
+            const DSTPIX *maskPix = _maskImg ? (const DSTPIX *)_maskImg->getPixelAddress(x, y) : 0;
+            if (!maskPix) {
+                maskScale = _maskInvert ? 1.f : 0.f;
+            } else {
+                maskScale = *maskPix / float(dstMaxValue);
+                if (_maskInvert) {
+                    maskScale = 1.f - maskScale;
                 }
-                // dstx,dsty are the mask image coordinates (no boundary conditions)
-                ofxsPremultMaskMixPix<DSTPIX, dstNComponents, dstMaxValue, true>(unpPix, _premult, _premultChannel, dstx, dsty, origPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
-                // increment the dst pixel
-                dstPix += dstNComponents;
             }
         }
+
+        return maskScale * (float)_mix;
     }
 };
 
@@ -573,12 +682,22 @@ public:
         : OFX::PixelProcessorFilterBase(instance)
         , _nComponents(comps)
     {
+        setPixelCost(OFX::ePixelProcessorCostCheap);
     }
 
     // and do some processing
     void multiThreadProcessImages(OfxRectI procWindow)
     {
-        int rowSize =  _nComponents * (procWindow.x2 - procWindow.x1);
+        const size_t pixelBytes = sizeof(PIX) * _nComponents;
+        const size_t rowBytes = pixelBytes * (procWindow.x2 - procWindow.x1);
+        const bool nonTemporal = ofxsUseNonTemporalStores( pixelBytes * (_renderWindow.x2 - _renderWindow.x1) * (_renderWindow.y2 - _renderWindow.y1) );
+
+        if (rowBytes == (size_t)_dstRowBytes) {
+            // the rows are contiguous in memory: fill them all at once
+            ofxsZeroBytes(getDstPixelAddress(procWindow.x1, procWindow.y1), rowBytes * (procWindow.y2 - procWindow.y1), nonTemporal);
+
+            return;
+        }
 
         for (int y = procWindow.y1; y < procWindow.y2; ++y) {
             if ( _effect.abort() ) {
@@ -591,7 +710,7 @@ public:
                 // coverity[dead_error_line]
                 continue;
             }
-            std::fill(dstPix, dstPix + rowSize, PIX());
+            ofxsZeroBytes(dstPix, rowBytes, nonTemporal);
         }
     }
 private:
@@ -608,13 +727,24 @@ fillBlackNTForDepth(const OfxRectI & renderWindow,
                     int dstRowBytes)
 {
     assert(dstPixelData);
+    if ( (renderWindow.x2 <= renderWindow.x1) || (renderWindow.y2 <= renderWindow.y1) ) {
+        return;
+    }
     // do the rendering
     int dstRowElements = dstRowBytes / sizeof(PIX);
     PIX* dstPixels = (PIX*)dstPixelData + (size_t)(renderWindow.y1 - dstBounds.y1) * dstRowElements + (renderWindow.x1 - dstBounds.x1) * dstPixelComponentCount;
-    int rowElements = dstPixelComponentCount * (renderWindow.x2 - renderWindow.x1);
+    const size_t rowBytes = sizeof(PIX) * dstPixelComponentCount * (renderWindow.x2 - renderWindow.x1);
+    const size_t nRows = renderWindow.y2 - renderWindow.y1;
+    const bool nonTemporal = ofxsUseNonTemporalStores(rowBytes * nRows);
 
+    if (rowBytes == (size_t)dstRowBytes) {
+        // the rows are contiguous in memory: fill them all at once
+        ofxsZeroBytes(dstPixels, rowBytes * nRows, nonTemporal);
+
+        return;
+    }
     for (int y = renderWindow.y1; y < renderWindow.y2; ++y, dstPixels += dstRowElements) {
-        std::fill(dstPixels, dstPixels + rowElements, PIX()); // no src pixel here, be black and transparent
+        ofxsZeroBytes(dstPixels, rowBytes, nonTemporal); // no src pixel here, be black and transparent
     }
 }
 
@@ -1095,6 +1225,69 @@ copyPixels(OFX::ImageEffect &instance,
     return copyPixels(instance, renderWindow, srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes, dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
 }
 
+/** @brief copy srcImg to dstImg on the part of renderWindow that is outside of innerWindow
+   (at most four rectangles). If srcImg is NULL, that part is filled with black. */
+inline void
+copyPixelsOutside(OFX::ImageEffect &instance,
+                  const OfxRectI & renderWindow,
+                  const OfxRectI & innerWindow,
+                  const OFX::Image* srcImg,
+                  OFX::Image* dstImg)
+{
+    OfxRectI inner;
+    inner.x1 = std::max(innerWindow.x1, renderWindow.x1);
+    inner.x2 = std::min(innerWindow.x2, renderWindow.x2);
+    inner.y1 = std::max(innerWindow.y1, renderWindow.y1);
+    inner.y2 = std::min(innerWindow.y2, renderWindow.y2);
+    if ( (inner.x2 <= inner.x1) || (inner.y2 <= inner.y1) ) {
+        inner.x1 = inner.x2 = renderWindow.x1;
+        inner.y1 = inner.y2 = renderWindow.y1;
+    }
+    OfxRectI parts[4] = { renderWindow, renderWindow, inner, inner };
+    parts[0].y2 = inner.y1; // below
+    parts[1].y1 = inner.y2; // above
+    parts[2].x1 = renderWindow.x1; // left
+    parts[2].x2 = inner.x1;
+    parts[3].x1 = inner.x2; // right
+    parts[3].x2 = renderWindow.x2;
+    for (int i = 0; i < 4; ++i) {
+        if ( (parts[i].x2 <= parts[i].x1) || (parts[i].y2 <= parts[i].y1) ) {
+            continue;
+        }
+        if (srcImg) {
+            copyPixels(instance, parts[i], srcImg, dstImg);
+        } else {
+            fillBlack(instance, parts[i], dstImg);
+        }
+    }
+}
+
+/** @brief cull the render window of a masked effect.
+
+   The effect only needs to be rendered where the mask is active (see ofxsMaskGetActiveBounds()):
+   this returns the bounding box of that part of renderWindow in processWindow, and copies srcImg
+   (the image used by ofxsMaskMixPix() where the mask is 0, usually the original image) to dstImg
+   on the rest of renderWindow. The processors are then run on processWindow only.
+
+   Returns false if the mask is active nowhere: dstImg is then a copy of srcImg on renderWindow
+   and there is nothing left to render.
+ */
+inline bool
+copyPixelsOutsideMask(OFX::ImageEffect &instance,
+                      const OfxRectI & renderWindow,
+                      const OFX::Image* maskImg, //!< the mask image, or NULL if the mask is not connected
+                      bool maskInvert,
+                      const OFX::Image* srcImg,
+                      OFX::Image* dstImg,
+                      OfxRectI* processWindow)
+{
+    const bool active = ofxsMaskGetActiveBounds(maskImg, maskInvert, renderWindow, processWindow);
+
+    copyPixelsOutside(instance, renderWindow, *processWindow, srcImg, dstImg);
+
+    return active;
+}
+
 // pixel copiers, threaded versions
 template<class PIX,int nComponents, int maxValue>
 void
@@ -1223,13 +1416,9 @@ copyPixelsOpaque(OFX::ImageEffect &instance,
             break;
         }
         case OFX::eBitDepthHalf: {
-            // the unsigned short representation of 1.h is 15360
-            // #include <OpenEXR/half.h>
-            // half one(1.);
-            // cout << "the unsigned short representation of 1.h is " << one.bits() << endl;
-            copyPixelsOpaqueForDepth<unsigned short, 15360>(instance, renderWindow,
-                                                            srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
-                                                            dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+            copyPixelsOpaqueForDepth<OFX::Half, 1>(instance, renderWindow,
+                                                   srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                   dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
             break;
         }
         case OFX::eBitDepthFloat: {
@@ -0,0 +1,249 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Half float (16 bits IEEE 754) pixels, as found in eBitDepthHalf images.
+ *
+ * OFXS_USE_F16C is defined when the F16C conversion instructions can be used without a runtime check
+ * (compile with -mf16c, or /arch:AVX2 with MSVC). The scalar code gives the same results.
+ */
+
+#ifndef openfx_supportext_ofxsHalf_h
+#define openfx_supportext_ofxsHalf_h
+
+#include <cstddef>
+#include <cstring>
+
+#include "ofxsSimd.h"
+
+#if defined(OFXS_USE_SSE2) && ( defined(__F16C__) || defined(__AVX2__) )
+#define OFXS_USE_F16C 1
+#include <immintrin.h>
+#endif
+
+namespace OFX {
+/** @brief A half float. It converts implicitly from and to float, so that it can be used as the PIX type
+   of the pixel processors, with a maxValue of 1 (like float).
+
+   The conversion from float rounds to the nearest half (ties to even), values too large become infinite.
+ */
+class Half
+{
+public:
+    Half()
+        : _bits(0)
+    {
+    }
+
+    Half(float f)
+        : _bits( floatToBits(f) )
+    {
+    }
+
+    operator float() const
+    {
+        return bitsToFloat(_bits);
+    }
+
+    unsigned short bits() const
+    {
+        return _bits;
+    }
+
+    static Half fromBits(unsigned short bits)
+    {
+        Half h;
+
+        h._bits = bits;
+
+        return h;
+    }
+
+    static unsigned short floatToBits(float f)
+    {
+        unsigned int x;
+
+        std::memcpy(&x, &f, sizeof(x));
+        const unsigned short sign = (unsigned short)( (x >> 16) & 0x8000 );
+        const unsigned int absx = x & 0x7fffffff;
+
+        if (absx >= 0x47800000) {
+            // NaN (keep the top of the payload, and make it quiet), infinity, or too large (>= 2^16)
+            if (absx > 0x7f800000) {
+                return (unsigned short)( sign | 0x7e00 | ( (absx >> 13) & 0x3ff ) );
+            }
+
+            return (unsigned short)(sign | 0x7c00);
+        }
+        if (absx >= 0x38800000) {
+            // normal half: rebias the exponent, and round the mantissa.
+            // A carry from the mantissa correctly goes to the exponent, up to infinity.
+            unsigned int h = (absx - 0x38000000) >> 13;
+            const unsigned int rem = absx & 0x1fff;
+            if ( (rem > 0x1000) || ( (rem == 0x1000) && (h & 1) ) ) {
+                ++h;
+            }
+
+            return (unsigned short)(sign | h);
+        }
+        if (absx <= 0x33000000) {
+            // <= 2^-25, rounds to zero
+            return sign;
+        }
+        // denormal half: the value is m * 2^-24
+        const unsigned int m = (absx & 0x7fffff) | 0x800000;
+        const int shift = 126 - (int)(absx >> 23);
+        unsigned int h = m >> shift;
+        const unsigned int rem = m & ( (1u << shift) - 1 );
+        const unsigned int halfway = 1u << (shift - 1);
+        if ( (rem > halfway) || ( (rem == halfway) && (h & 1) ) ) {
+            ++h;
+        }
+
+        return (unsigned short)(sign | h);
+    }
+
+    static float bitsToFloat(unsigned short h)
+    {
+        const unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+        const unsigned int exponent = (h >> 10) & 0x1f;
+        const unsigned int mantissa = h & 0x3ff;
+        unsigned int x;
+
+        if (exponent == 0) {
+            // zero or denormal: mantissa * 2^-24 is exact in float
+            float f = mantissa * 5.9604644775390625e-8f;
+
+            return sign ? -f : f;
+        } else if (exponent == 0x1f) {
+            // infinity or NaN (made quiet)
+            x = sign | 0x7f800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+        } else {
+            x = sign | ( (exponent + 112) << 23 ) | (mantissa << 13);
+        }
+        float f;
+        std::memcpy(&f, &x, sizeof(f));
+
+        return f;
+    }
+
+private:
+    unsigned short _bits;
+};
+
+/// convert n half floats to float
+inline void
+ofxsHalfToFloat(const Half *src,
+                size_t n,
+                float *dst)
+{
+    size_t i = 0;
+
+#ifdef OFXS_USE_F16C
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128( (const __m128i *)(src + i) );
+        _mm_storeu_ps( dst + i, _mm_cvtph_ps(h) );
+        _mm_storeu_ps( dst + i + 4, _mm_cvtph_ps( _mm_srli_si128(h, 8) ) );
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = src[i];
+    }
+}
+
+/// convert n floats to half floats
+inline void
+ofxsFloatToHalf(const float *src,
+                size_t n,
+                Half *dst)
+{
+    size_t i = 0;
+
+#ifdef OFXS_USE_F16C
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_cvtps_ph(_mm_loadu_ps(src + i), 0);
+        __m128i hi = _mm_cvtps_ph(_mm_loadu_ps(src + i + 4), 0);
+        _mm_storeu_si128( (__m128i *)(dst + i), _mm_unpacklo_epi64(lo, hi) );
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = src[i];
+    }
+}
+
+#ifdef OFXS_USE_F16C
+namespace Simd {
+/// half float pixels, converted with F16C. Like float, they are not clamped.
+template <>
+struct PixelIO<Half, 1>
+{
+    enum { supported = 1 };
+
+    static __m128 load4(const Half *p)
+    {
+        return _mm_cvtph_ps( _mm_loadl_epi64( (const __m128i *)p ) );
+    }
+
+    static __m128 load3(const Half *p)
+    {
+        Half tmp[4] = { p[0], p[1], p[2], Half() };
+
+        return load4(tmp);
+    }
+
+    static void store4(Half *p,
+                       __m128 v)
+    {
+        _mm_storel_epi64( (__m128i *)p, _mm_cvtps_ph(v, 0) );
+    }
+
+    static void store3(Half *p,
+                       __m128 v)
+    {
+        Half tmp[4];
+
+        store4(tmp, v);
+        p[0] = tmp[0];
+        p[1] = tmp[1];
+        p[2] = tmp[2];
+    }
+
+    static void load16(const Half *p,
+                       __m128 v[4])
+    {
+        __m128i lo = _mm_loadu_si128( (const __m128i *)p );
+        __m128i hi = _mm_loadu_si128( (const __m128i *)(p + 8) );
+
+        v[0] = _mm_cvtph_ps(lo);
+        v[1] = _mm_cvtph_ps( _mm_srli_si128(lo, 8) );
+        v[2] = _mm_cvtph_ps(hi);
+        v[3] = _mm_cvtph_ps( _mm_srli_si128(hi, 8) );
+    }
+
+    static void store16(Half *p,
+                        const __m128 v[4])
+    {
+        _mm_storeu_si128( (__m128i *)p, _mm_unpacklo_epi64( _mm_cvtps_ph(v[0], 0), _mm_cvtps_ph(v[1], 0) ) );
+        _mm_storeu_si128( (__m128i *)(p + 8), _mm_unpacklo_epi64( _mm_cvtps_ph(v[2], 0), _mm_cvtps_ph(v[3], 0) ) );
+    }
+};
+} // namespace Simd
+#endif // ifdef OFXS_USE_F16C
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsHalf_h
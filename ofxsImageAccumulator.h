@@ -0,0 +1,275 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Weighted accumulation of several images in a single pass, for frame blending and temporal averaging.
+ */
+
+#ifndef openfx_supportext_ofxsImageAccumulator_h
+#define openfx_supportext_ofxsImageAccumulator_h
+
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+#include "ofxsPixelProcessor.h"
+#include "ofxsMaskMix.h"
+#include "ofxsSimd.h"
+#include "ofxsHalf.h"
+
+namespace OFX {
+/** @brief SIMD kernels for ImageAccumulator. The primary template is used when there is no
+   SIMD version (kSupported is 0): the values are processed one by one.
+ */
+template <class PIX, int maxValue,
+          bool supported =
+#ifdef OFXS_USE_SSE2
+              Simd::PixelIO<PIX, maxValue>::supported != 0
+#else
+              false
+#endif
+          >
+struct ImageAccumulatorSimd
+{
+    enum { kSupported = 0 };
+
+    static int accumulateRow(const PIX *,
+                             int,
+                             float,
+                             float *)
+    {
+        return 0;
+    }
+
+    static int storeRow(const float *,
+                        int,
+                        float,
+                        PIX *)
+    {
+        return 0;
+    }
+};
+
+#ifdef OFXS_USE_SSE2
+template <class PIX, int maxValue>
+struct ImageAccumulatorSimd<PIX, maxValue, true>
+{
+    enum { kSupported = 1 };
+
+    /** @brief add weight * src to the beginning of count values of acc, and return the number of values done */
+    static int accumulateRow(const PIX *srcPix,
+                             int count,
+                             float weight,
+                             float *acc)
+    {
+        const __m128 w = _mm_set1_ps(weight);
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m128 v[4];
+            Simd::PixelIO<PIX, maxValue>::load16(srcPix + i, v);
+            for (int k = 0; k < 4; ++k) {
+                _mm_storeu_ps( acc + i + 4 * k, _mm_add_ps( _mm_loadu_ps(acc + i + 4 * k), _mm_mul_ps(v[k], w) ) );
+            }
+        }
+
+        return i;
+    }
+
+    /** @brief store acc * scale (clamped and rounded, see ofxsClampIfInt()) on the beginning of count values,
+       and return the number of values done */
+    static int storeRow(const float *acc,
+                        int count,
+                        float scale,
+                        PIX *dstPix)
+    {
+        const __m128 s = _mm_set1_ps(scale);
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m128 v[4];
+            Simd::PixelIO<float, 1>::load16(acc + i, v);
+            for (int k = 0; k < 4; ++k) {
+                v[k] = _mm_mul_ps(v[k], s);
+            }
+            Simd::PixelIO<PIX, maxValue>::store16(dstPix + i, v);
+        }
+
+        return i;
+    }
+};
+#endif // ifdef OFXS_USE_SSE2
+
+/** @brief A processor that computes the weighted sum of N source images in a single pass.
+
+   The sum is accumulated in floats, in the value range of PIX (not normalized), one chunk of a row at a
+   time, so that each source pixel is read once and the sum stays in the cache. The sources may have
+   different bounds: they are black and transparent outside. A NULL source is black.
+
+   The destination image (if set) receives the sum multiplied by the output scale (e.g. 1/N for an
+   average), clamped and converted to PIX. The sum can also be kept in a float accumulation buffer
+   (setAccumulationBuffer()), in which case it may be added to the previous contents of the buffer:
+   a sliding window of frames is then updated by adding the frames that enter the window with a
+   positive weight and the frames that leave it with the opposite weight, in a single pass. With
+   integer sources and integer weights the running sum is exact, with float sources it may drift
+   slowly, and should be recomputed from scratch from time to time.
+
+   The weights usually come from sampling the shutter interval (see OFX::shutterRange()).
+   All sources and the destination must have the same components and bit depth.
+ */
+template <class PIX, int nComponents, int maxValue>
+class ImageAccumulator
+    : public OFX::PixelProcessor
+{
+public:
+    enum { kChunkSize = 256 };
+
+    // ctor
+    ImageAccumulator(OFX::ImageEffect &instance)
+        : OFX::PixelProcessor(instance)
+        , _srcImgs()
+        , _weights()
+        , _accData(0)
+        , _accBounds()
+        , _accAdd(false)
+        , _outputScale(1.f)
+    {
+        _accBounds.x1 = _accBounds.y1 = _accBounds.x2 = _accBounds.y2 = 0;
+    }
+
+    /** @brief add a source image (which may be NULL) with its weight */
+    void addSrcImg(const OFX::Image *v,
+                   float weight)
+    {
+        assert( !v || (v->getPixelComponentCount() == nComponents && v->getPixelDepth() != OFX::eBitDepthNone) );
+        _srcImgs.push_back(v);
+        _weights.push_back(weight);
+    }
+
+    /** @brief remove all source images */
+    void clearSrcImgs()
+    {
+        _srcImgs.clear();
+        _weights.clear();
+    }
+
+    /** @brief set the float buffer in which the sum is kept, with nComponents values per pixel of bounds, row by row.
+       It must contain the render window. If add is true, the sum is added to the contents of the buffer. */
+    void setAccumulationBuffer(float *data,
+                               const OfxRectI & bounds,
+                               bool add)
+    {
+        _accData = data;
+        _accBounds = bounds;
+        _accAdd = add;
+    }
+
+    /** @brief set the factor applied to the sum before it is stored in the destination image */
+    void setOutputScale(float v)
+    {
+        _outputScale = v;
+    }
+
+    // and do some processing
+    void multiThreadProcessImages(OfxRectI procWindow)
+    {
+        assert( !_accData ||
+                (_accBounds.x1 <= procWindow.x1 && procWindow.x2 <= _accBounds.x2 &&
+                 _accBounds.y1 <= procWindow.y1 && procWindow.y2 <= _accBounds.y2) );
+        // without an accumulation buffer, the sum of each chunk is kept here
+        float *chunkAcc = _accData ? 0 : getScratchArena().allocateArray<float>(kChunkSize * nComponents);
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) getDstPixelAddress(procWindow.x1, y);
+            float *accRow = _accData ? ( _accData + ( (size_t)(y - _accBounds.y1) * (_accBounds.x2 - _accBounds.x1) +
+                                                     (procWindow.x1 - _accBounds.x1) ) * nComponents ) : 0;
+            for (int x1 = procWindow.x1; x1 < procWindow.x2; x1 += kChunkSize) {
+                const int x2 = std::min(x1 + kChunkSize, procWindow.x2);
+                float *acc = accRow ? accRow + (x1 - procWindow.x1) * nComponents : chunkAcc;
+                accumulateChunk(x1, x2, y, acc, !accRow || !_accAdd);
+                if (dstPix) {
+                    storeChunk(acc, x2 - x1, dstPix + (x1 - procWindow.x1) * nComponents);
+                }
+            }
+        }
+    }
+
+private:
+    /** @brief accumulate the weighted sources on pixels [x1,x2) of row y into acc, which is cleared first if clear is true */
+    void accumulateChunk(int x1,
+                         int x2,
+                         int y,
+                         float *acc,
+                         bool clear) const
+    {
+        typedef ImageAccumulatorSimd<PIX, maxValue> Kernel;
+
+        if (clear) {
+            std::fill(acc, acc + (x2 - x1) * nComponents, 0.f);
+        }
+        OFX::PixelRowSegment seg;
+        for (size_t s = 0; s < _srcImgs.size(); ++s) {
+            const float w = _weights[s];
+            if (!_srcImgs[s] || (w == 0.f) ) {
+                continue;
+            }
+            for (int x = x1; x < x2; x = seg.x2) {
+                // no boundary conditions: black outside
+                OFX::getPixelRowSegment(_srcImgs[s], 0, x, y, x2, &seg);
+                if (!seg.pix) {
+                    continue;
+                }
+                const PIX *srcPix = (const PIX *)seg.pix;
+                float *a = acc + (x - x1) * nComponents;
+                const int count = (seg.x2 - x) * nComponents;
+                int i = Kernel::kSupported ? Kernel::accumulateRow(srcPix, count, w, a) : 0;
+                for (; i < count; ++i) {
+                    a[i] += srcPix[i] * w;
+                }
+            }
+        }
+    }
+
+    /** @brief store the n pixels of acc, multiplied by the output scale, to dstPix */
+    void storeChunk(const float *acc,
+                    int n,
+                    PIX *dstPix) const
+    {
+        typedef ImageAccumulatorSimd<PIX, maxValue> Kernel;
+        const int count = n * nComponents;
+        int i = Kernel::kSupported ? Kernel::storeRow(acc, count, _outputScale, dstPix) : 0;
+
+        for (; i < count; ++i) {
+            dstPix[i] = ofxsClampIfInt<PIX, maxValue>(acc[i] * _outputScale, 0, maxValue);
+        }
+    }
+
+    std::vector<const OFX::Image *> _srcImgs;
+    std::vector<float> _weights;
+    float *_accData;
+    OfxRectI _accBounds;
+    bool _accAdd;
+    float _outputScale;
+};
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsImageAccumulator_h
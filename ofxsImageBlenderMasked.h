@@ -21,6 +21,7 @@
 
 #include "ofxsProcessing.H"
 #include "ofxsMaskMix.h"
+#include "ofxsMaskMixRow.h"
 #include "ofxsImageBlender.H"
 
 namespace OFX {
@@ -55,12 +56,127 @@ public:
     }
 };
 
+/** @brief SIMD kernels for ImageBlenderMasked. The primary template is used when there is no
+   SIMD version (kSupported is 0): the values are processed one by one.
+ */
+template <class PIX, int maxValue,
+          bool supported =
+#ifdef OFXS_USE_SSE2
+              Simd::PixelIO<PIX, maxValue>::supported != 0
+#else
+              false
+#endif
+          >
+struct ImageBlenderSimd
+{
+    enum { kSupported = 0 };
+
+    static int lerpRow(const PIX *,
+                       const PIX *,
+                       int,
+                       float,
+                       PIX *)
+    {
+        return 0;
+    }
+
+    static int scaleRow(const PIX *,
+                        int,
+                        float,
+                        PIX *)
+    {
+        return 0;
+    }
+};
+
+#ifdef OFXS_USE_SSE2
+template <class PIX, int maxValue>
+struct ImageBlenderSimd<PIX, maxValue, true>
+{
+    enum { kSupported = 1 };
+
+    /// store 16 values converted by PIX(v): integer types are truncated, not rounded
+    static void store16(PIX *p,
+                        const __m128 v[4])
+    {
+        if (maxValue == 1) {
+            Simd::PixelIO<PIX, maxValue>::store16(p, v);
+
+            return;
+        }
+        __m128i i[4];
+        for (int k = 0; k < 4; ++k) {
+            i[k] = _mm_cvttps_epi32(v[k]);
+        }
+        if (sizeof(PIX) == 1) {
+            _mm_storeu_si128( (__m128i *)p, _mm_packus_epi16( _mm_packs_epi32(i[0], i[1]), _mm_packs_epi32(i[2], i[3]) ) );
+        } else {
+            // no unsigned saturating pack in SSE2: pack in the signed range, and shift back
+            const __m128i bias = _mm_set1_epi32(32768);
+            const __m128i sign = _mm_set1_epi16(-32768);
+            __m128i lo = _mm_packs_epi32( _mm_sub_epi32(i[0], bias), _mm_sub_epi32(i[1], bias) );
+            __m128i hi = _mm_packs_epi32( _mm_sub_epi32(i[2], bias), _mm_sub_epi32(i[3], bias) );
+            _mm_storeu_si128( (__m128i *)p, _mm_xor_si128(lo, sign) );
+            _mm_storeu_si128( (__m128i *)(p + 8), _mm_xor_si128(hi, sign) );
+        }
+    }
+
+    /** @brief compute (to - from) * blend + from on the beginning of count values, and return the number of values done */
+    static int lerpRow(const PIX *fromPix,
+                       const PIX *toPix,
+                       int count,
+                       float blend,
+                       PIX *dstPix)
+    {
+        typedef Simd::PixelIO<PIX, maxValue> IO;
+        const __m128 b = _mm_set1_ps(blend);
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m128 f[4], t[4];
+            IO::load16(fromPix + i, f);
+            IO::load16(toPix + i, t);
+            for (int k = 0; k < 4; ++k) {
+                t[k] = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(t[k], f[k]), b), f[k]);
+            }
+            store16(dstPix + i, t);
+        }
+
+        return i;
+    }
+
+    /** @brief compute src * scale on the beginning of count values, and return the number of values done */
+    static int scaleRow(const PIX *srcPix,
+                        int count,
+                        float scale,
+                        PIX *dstPix)
+    {
+        typedef Simd::PixelIO<PIX, maxValue> IO;
+        const __m128 s = _mm_set1_ps(scale);
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m128 v[4];
+            IO::load16(srcPix + i, v);
+            for (int k = 0; k < 4; ++k) {
+                v[k] = _mm_mul_ps(v[k], s);
+            }
+            store16(dstPix + i, v);
+        }
+
+        return i;
+    }
+};
+#endif // ifdef OFXS_USE_SSE2
+
 /** @brief templated class to blend between two images */
 template <class PIX, int nComponents, int maxValue, bool masked>
 class ImageBlenderMasked
     : public ImageBlenderMaskedBase
 {
 public:
+    enum { kChunkSize = 256 };
+
     // ctor
     ImageBlenderMasked(OFX::ImageEffect &instance)
         : ImageBlenderMaskedBase(instance)
@@ -77,10 +193,6 @@ public:
     // and do some processing
     void multiThreadProcessImages(OfxRectI procWindow)
     {
-        float tmpPix[nComponents];
-        float blend = _blend;
-        float blendComp = 1.0f - blend;
-
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
@@ -88,40 +200,81 @@ public:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                PIX *fromPix = (PIX *)  (_fromImg ? _fromImg->getPixelAddress(x, y) : 0);
-                PIX *toPix   = (PIX *)  (_toImg   ? _toImg->getPixelAddress(x, y)   : 0);
-
-                if ( masked && (fromPix || toPix) ) {
-                    for (int c = 0; c < nComponents; ++c) {
-                        // all images are supposed to be black and transparent outside o
-                        tmpPix[c] = toPix ? (float)toPix[c] : 0.f;
-                    }
-                    ofxsMaskMixPix<PIX, nComponents, maxValue, masked>(tmpPix, x, y, fromPix, _doMasking, _maskImg, blend, _maskInvert, dstPix);
-                } else if (fromPix && toPix) {
-                    assert(!masked);
-                    for (int c = 0; c < nComponents; ++c) {
-                        dstPix[c] = Lerp(fromPix[c], toPix[c], blend);
-                    }
-                } else if (fromPix) {
-                    assert(!masked);
-                    for (int c = 0; c < nComponents; ++c) {
-                        dstPix[c] = PIX(fromPix[c] * blendComp);
-                    }
-                } else if (toPix) {
-                    assert(!masked);
-                    for (int c = 0; c < nComponents; ++c) {
-                        dstPix[c] = PIX(toPix[c] * blend);
-                    }
-                } else {
-                    // everything is black and transparent
-                    for (int c = 0; c < nComponents; ++c) {
-                        dstPix[c] = PIX(0);
-                    }
+            if (masked) {
+                blendMaskedRow(procWindow.x1, procWindow.x2, y, dstPix);
+            } else {
+                blendRow(procWindow.x1, procWindow.x2, y, dstPix);
+            }
+        }
+    }
+
+private:
+    /** @brief blend the pixels [x1,x2) of row y, by intervals on which from and to exist or not.
+       All images are supposed to be black and transparent outside of their bounds. */
+    void blendRow(int x1,
+                  int x2,
+                  int y,
+                  PIX *dstPix)
+    {
+        typedef ImageBlenderSimd<PIX, maxValue> Kernel;
+        const float blend = _blend;
+        const float blendComp = 1.0f - blend;
+        OFX::PixelRowSegment fromSeg, toSeg;
+
+        for (int x = x1; x < x2; x = toSeg.x2) {
+            OFX::getPixelRowSegment(_fromImg, 0, x, y, x2, &fromSeg);
+            OFX::getPixelRowSegment(_toImg, 0, x, y, fromSeg.x2, &toSeg);
+            const PIX *fromPix = (const PIX *)fromSeg.pix;
+            const PIX *toPix = (const PIX *)toSeg.pix;
+            const int count = (toSeg.x2 - x) * nComponents;
+            int i = 0;
+            if (fromPix && toPix) {
+                i = Kernel::kSupported ? Kernel::lerpRow(fromPix, toPix, count, blend, dstPix) : 0;
+                for (; i < count; ++i) {
+                    dstPix[i] = Lerp(fromPix[i], toPix[i], blend);
                 }
+            } else if (fromPix) {
+                i = Kernel::kSupported ? Kernel::scaleRow(fromPix, count, blendComp, dstPix) : 0;
+                for (; i < count; ++i) {
+                    dstPix[i] = PIX(fromPix[i] * blendComp);
+                }
+            } else if (toPix) {
+                i = Kernel::kSupported ? Kernel::scaleRow(toPix, count, blend, dstPix) : 0;
+                for (; i < count; ++i) {
+                    dstPix[i] = PIX(toPix[i] * blend);
+                }
+            } else {
+                // everything is black and transparent
+                std::fill( dstPix, dstPix + count, PIX(0) );
+            }
+            dstPix += count;
+        }
+    }
+
+    /** @brief same as blendRow(), but the to image is masked and mixed with the from image by ofxsMaskMixRow() */
+    void blendMaskedRow(int x1,
+                        int x2,
+                        int y,
+                        PIX *dstPix)
+    {
+        float tmpRow[kChunkSize * nComponents];
+        OFX::PixelRowSegment toSeg;
 
-                dstPix += nComponents;
+        for (int cx1 = x1; cx1 < x2; cx1 += kChunkSize) {
+            const int cx2 = std::min(cx1 + kChunkSize, x2);
+            for (int x = cx1; x < cx2; x = toSeg.x2) {
+                OFX::getPixelRowSegment(_toImg, 0, x, y, cx2, &toSeg);
+                float *tmpPix = tmpRow + (x - cx1) * nComponents;
+                const int count = (toSeg.x2 - x) * nComponents;
+                if (toSeg.pix) {
+                    std::copy( (const PIX *)toSeg.pix, (const PIX *)toSeg.pix + count, tmpPix );
+                } else {
+                    std::fill(tmpPix, tmpPix + count, 0.f);
+                }
             }
+            // where there is neither from nor to, the result is 0
+            ofxsMaskMixRow<PIX, nComponents, maxValue, masked>(tmpRow, cx1, cx2, y, _fromImg, _doMasking, _maskImg, _blend, _maskInvert, dstPix);
+            dstPix += (cx2 - cx1) * nComponents;
         }
     }
 };
@@ -58,31 +58,6 @@ static const o32_host_order_t o32_host_order = {
     { 0, 1, 2, 3 }
 };
 #define O32_HOST_ORDER (o32_host_order.value)
-unsigned short
-LutBase::hipart(const float f)
-{
-    union
-    {
-        float f;
-        unsigned short us[2];
-    }
-
-    tmp;
-
-    tmp.us[0] = tmp.us[1] = 0;
-    tmp.f = f;
-
-    if (O32_HOST_ORDER == O32_BIG_ENDIAN) {
-        return tmp.us[0];
-    } else if (O32_HOST_ORDER == O32_LITTLE_ENDIAN) {
-        return tmp.us[1];
-    } else {
-        assert( (O32_HOST_ORDER == O32_LITTLE_ENDIAN) || (O32_HOST_ORDER == O32_BIG_ENDIAN) );
-
-        return 0;
-    }
-}
-
 float
 LutBase::index_to_float(const unsigned short i)
 {
@@ -121,7 +96,7 @@ LutBase::index_to_float(const unsigned short i)
 ///initialize the singleton
 LutManager LutManager::m_instance = LutManager();
 LutManager::LutManager()
-    : luts()
+    : _head(NULL)
 {
 }
 
@@ -131,8 +106,12 @@ LutManager::~LutManager()
     ////This is because the Lut holds a OFX::MultiThread::Mutex and it can't be deleted
     //// by this singleton because it makes their destruction time uncertain regarding to
     ///the host multi-thread suite.
-    for (LutsMap::iterator it = luts.begin(); it != luts.end(); ++it) {
-        delete it->second;
+    LutEntry* e = _head;
+    while (e) {
+        LutEntry* next = e->next;
+        delete e->lut;
+        delete e;
+        e = next;
     }
 }
 
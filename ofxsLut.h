@@ -24,17 +24,20 @@
 #define openfx_supportext_ofxsLut_h
 
 #include <string>
-#include <map>
 #include <cmath>
 #include <cassert>
+#include <algorithm>
 #include <cstring> // for memcpy
 #include <cstdlib> // for rand
 #include <memory> // for auto_ptr
 
 #include "ofxCore.h"
+#include "ofxsAtomic.h"
 #include "ofxsImageEffect.h"
 #include "ofxsMacros.h"
 #include "ofxsPixelProcessor.h"
+#include "ofxsHalf.h"
+#include "ofxsSimd.h"
 
 namespace OFX {
 namespace Color {
@@ -152,6 +155,11 @@ public:
         return _name;
     }
 
+    /* @brief Initializes the look-up tables, if they are not yet.
+     * It is thread-safe, and only costs an atomic read once the tables are initialized.
+     */
+    virtual void validate() const = 0;
+
     /* @brief Converts a float ranging in [0 - 1.f] in the desired color-space to linear color-space also ranging in [0 - 1.f]
      * This function is not fast!
      * @see fromColorSpaceFloatToLinearFloatFast(float)
@@ -195,7 +203,7 @@ public:
      */
     virtual float fromColorSpaceUint16ToLinearFloatFast(unsigned short v) const = 0;
 
-    /* @brief convert from float to byte with dithering (error diffusion).
+    /* @brief convert from float (or half) to byte with dithering (error diffusion).
        It uses random numbers for error diffusion, and thus the result is different at each function call. */
     virtual void to_byte_packed_dither(const void* pixelData,
                                        const OfxRectI & bounds,
@@ -211,7 +219,7 @@ public:
                                        OFX::BitDepthEnum dstBitDepth,
                                        int dstRowBytes) const = 0;
 
-    /* @brief convert from float to byte without dithering. */
+    /* @brief convert from float (or half) to byte without dithering. */
     virtual void to_byte_packed_nodither(const void* pixelData,
                                          const OfxRectI & bounds,
                                          OFX::PixelComponentEnum pixelComponents,
@@ -241,7 +249,7 @@ public:
                                             OFX::BitDepthEnum dstBitDepth,
                                             int dstRowBytes) const = 0;
 
-    /* @brief convert from float to short without dithering. */
+    /* @brief convert from float (or half) to short without dithering. */
     virtual void to_short_packed(const void* pixelData,
                                  const OfxRectI & bounds,
                                  OFX::PixelComponentEnum pixelComponents,
@@ -255,6 +263,7 @@ public:
                                  int dstPixelComponentCount,
                                  OFX::BitDepthEnum dstBitDepth,
                                  int dstRowBytes) const = 0;
+    /* @brief convert from byte to float (or half). */
     virtual void from_byte_packed(const void* pixelData,
                                   const OfxRectI & bounds,
                                   OFX::PixelComponentEnum pixelComponents,
@@ -268,6 +277,7 @@ public:
                                   int dstPixelComponentCount,
                                   OFX::BitDepthEnum dstBitDepth,
                                   int dstRowBytes) const = 0;
+    /* @brief convert from short to float (or half). */
     virtual void from_short_packed(const void* pixelData,
                                    const OfxRectI & bounds,
                                    OFX::PixelComponentEnum pixelComponents,
@@ -282,11 +292,411 @@ public:
                                    OFX::BitDepthEnum dstBitDepth,
                                    int dstRowBytes) const = 0;
 
+    /* @brief The same conversions as above, with the same arguments and results, but the render window is
+     * split in bands of rows which are converted in parallel, using the OFX multi-thread suite.
+     * Small render windows are converted on the calling thread.
+     */
+    void to_byte_packed_dither_multithread(const void* pixelData,
+                                           const OfxRectI & bounds,
+                                           OFX::PixelComponentEnum pixelComponents,
+                                           int pixelComponentCount,
+                                           OFX::BitDepthEnum bitDepth,
+                                           int rowBytes,
+                                           const OfxRectI & renderWindow,
+                                           void* dstPixelData,
+                                           const OfxRectI & dstBounds,
+                                           OFX::PixelComponentEnum dstPixelComponents,
+                                           int dstPixelComponentCount,
+                                           OFX::BitDepthEnum dstBitDepth,
+                                           int dstRowBytes) const
+    {
+        multiThreadConvert(&LutBase::to_byte_packed_dither, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                           renderWindow,
+                           dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    }
+
+    void to_byte_packed_nodither_multithread(const void* pixelData,
+                                             const OfxRectI & bounds,
+                                             OFX::PixelComponentEnum pixelComponents,
+                                             int pixelComponentCount,
+                                             OFX::BitDepthEnum bitDepth,
+                                             int rowBytes,
+                                             const OfxRectI & renderWindow,
+                                             void* dstPixelData,
+                                             const OfxRectI & dstBounds,
+                                             OFX::PixelComponentEnum dstPixelComponents,
+                                             int dstPixelComponentCount,
+                                             OFX::BitDepthEnum dstBitDepth,
+                                             int dstRowBytes) const
+    {
+        multiThreadConvert(&LutBase::to_byte_packed_nodither, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                           renderWindow,
+                           dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    }
+
+    void to_byte_grayscale_nodither_multithread(const void* pixelData,
+                                                const OfxRectI & bounds,
+                                                OFX::PixelComponentEnum pixelComponents,
+                                                int pixelComponentCount,
+                                                OFX::BitDepthEnum bitDepth,
+                                                int rowBytes,
+                                                const OfxRectI & renderWindow,
+                                                void* dstPixelData,
+                                                const OfxRectI & dstBounds,
+                                                OFX::PixelComponentEnum dstPixelComponents,
+                                                int dstPixelComponentCount,
+                                                OFX::BitDepthEnum dstBitDepth,
+                                                int dstRowBytes) const
+    {
+        multiThreadConvert(&LutBase::to_byte_grayscale_nodither, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                           renderWindow,
+                           dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    }
+
+    void to_short_packed_multithread(const void* pixelData,
+                                     const OfxRectI & bounds,
+                                     OFX::PixelComponentEnum pixelComponents,
+                                     int pixelComponentCount,
+                                     OFX::BitDepthEnum bitDepth,
+                                     int rowBytes,
+                                     const OfxRectI & renderWindow,
+                                     void* dstPixelData,
+                                     const OfxRectI & dstBounds,
+                                     OFX::PixelComponentEnum dstPixelComponents,
+                                     int dstPixelComponentCount,
+                                     OFX::BitDepthEnum dstBitDepth,
+                                     int dstRowBytes) const
+    {
+        multiThreadConvert(&LutBase::to_short_packed, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                           renderWindow,
+                           dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    }
+
+    void from_byte_packed_multithread(const void* pixelData,
+                                      const OfxRectI & bounds,
+                                      OFX::PixelComponentEnum pixelComponents,
+                                      int pixelComponentCount,
+                                      OFX::BitDepthEnum bitDepth,
+                                      int rowBytes,
+                                      const OfxRectI & renderWindow,
+                                      void* dstPixelData,
+                                      const OfxRectI & dstBounds,
+                                      OFX::PixelComponentEnum dstPixelComponents,
+                                      int dstPixelComponentCount,
+                                      OFX::BitDepthEnum dstBitDepth,
+                                      int dstRowBytes) const
+    {
+        multiThreadConvert(&LutBase::from_byte_packed, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                           renderWindow,
+                           dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    }
+
+    void from_short_packed_multithread(const void* pixelData,
+                                       const OfxRectI & bounds,
+                                       OFX::PixelComponentEnum pixelComponents,
+                                       int pixelComponentCount,
+                                       OFX::BitDepthEnum bitDepth,
+                                       int rowBytes,
+                                       const OfxRectI & renderWindow,
+                                       void* dstPixelData,
+                                       const OfxRectI & dstBounds,
+                                       OFX::PixelComponentEnum dstPixelComponents,
+                                       int dstPixelComponentCount,
+                                       OFX::BitDepthEnum dstBitDepth,
+                                       int dstRowBytes) const
+    {
+        multiThreadConvert(&LutBase::from_short_packed, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                           renderWindow,
+                           dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    }
+
 protected:
+    /** @brief to_byte_packed_dither(), drawing the random numbers from the generator state *randState (see randomInt())
+       rather than from std::rand(), which may not be called from several threads. */
+    virtual void to_byte_packed_dither_r(const void* pixelData,
+                                         const OfxRectI & bounds,
+                                         OFX::PixelComponentEnum pixelComponents,
+                                         int pixelComponentCount,
+                                         OFX::BitDepthEnum bitDepth,
+                                         int rowBytes,
+                                         const OfxRectI & renderWindow,
+                                         void* dstPixelData,
+                                         const OfxRectI & dstBounds,
+                                         OFX::PixelComponentEnum dstPixelComponents,
+                                         int dstPixelComponentCount,
+                                         OFX::BitDepthEnum dstBitDepth,
+                                         int dstRowBytes,
+                                         unsigned int* randState) const = 0;
+
+    /// a random number in [0,32767], from std::rand() if randState is NULL, else from the same generator as rand_r()
+    static int randomInt(unsigned int* randState)
+    {
+        if (!randState) {
+            return std::rand();
+        }
+        *randState = *randState * 1103515245u + 12345u;
+
+        return (int)( (*randState / 65536u) % 32768u );
+    }
+
+    /// one of the bulk conversion functions above
+    typedef void (LutBase::*BulkConversion)(const void*, const OfxRectI &, OFX::PixelComponentEnum, int, OFX::BitDepthEnum, int,
+                                            const OfxRectI &,
+                                            void*, const OfxRectI &, OFX::PixelComponentEnum, int, OFX::BitDepthEnum, int) const;
+
+    /** @brief applies a bulk conversion to bands of rows of the render window, one per thread */
+    class BulkConversionProcessor
+        : public OFX::MultiThread::Processor
+    {
+        const LutBase &_lut;
+        BulkConversion _f;
+        const void* _pixelData;
+        OfxRectI _bounds;
+        OFX::PixelComponentEnum _pixelComponents;
+        int _pixelComponentCount;
+        OFX::BitDepthEnum _bitDepth;
+        int _rowBytes;
+        OfxRectI _renderWindow;
+        void* _dstPixelData;
+        OfxRectI _dstBounds;
+        OFX::PixelComponentEnum _dstPixelComponents;
+        int _dstPixelComponentCount;
+        OFX::BitDepthEnum _dstBitDepth;
+        int _dstRowBytes;
+
+    public:
+        BulkConversionProcessor(const LutBase &lut,
+                                BulkConversion f,
+                                const void* pixelData,
+                                const OfxRectI & bounds,
+                                OFX::PixelComponentEnum pixelComponents,
+                                int pixelComponentCount,
+                                OFX::BitDepthEnum bitDepth,
+                                int rowBytes,
+                                const OfxRectI & renderWindow,
+                                void* dstPixelData,
+                                const OfxRectI & dstBounds,
+                                OFX::PixelComponentEnum dstPixelComponents,
+                                int dstPixelComponentCount,
+                                OFX::BitDepthEnum dstBitDepth,
+                                int dstRowBytes)
+            : _lut(lut)
+            , _f(f)
+            , _pixelData(pixelData)
+            , _bounds(bounds)
+            , _pixelComponents(pixelComponents)
+            , _pixelComponentCount(pixelComponentCount)
+            , _bitDepth(bitDepth)
+            , _rowBytes(rowBytes)
+            , _renderWindow(renderWindow)
+            , _dstPixelData(dstPixelData)
+            , _dstBounds(dstBounds)
+            , _dstPixelComponents(dstPixelComponents)
+            , _dstPixelComponentCount(dstPixelComponentCount)
+            , _dstBitDepth(dstBitDepth)
+            , _dstRowBytes(dstRowBytes)
+        {
+        }
+
+        void multiThreadFunction(unsigned int threadId,
+                                 unsigned int nThreads)
+        {
+            OfxRectI win;
+
+            if ( !OFX::PixelProcessor::getStripe(_renderWindow, threadId, nThreads, &win) ) {
+                return;
+            }
+            if (_f == &LutBase::to_byte_packed_dither) {
+                // std::rand() may not be called from several threads: each band has its own generator,
+                // seeded from its first row
+                unsigned int randState = (unsigned int)win.y1;
+                _lut.to_byte_packed_dither_r(_pixelData, _bounds, _pixelComponents, _pixelComponentCount, _bitDepth, _rowBytes,
+                                             win,
+                                             _dstPixelData, _dstBounds, _dstPixelComponents, _dstPixelComponentCount, _dstBitDepth, _dstRowBytes,
+                                             &randState);
+            } else {
+                (_lut.*_f)(_pixelData, _bounds, _pixelComponents, _pixelComponentCount, _bitDepth, _rowBytes,
+                           win,
+                           _dstPixelData, _dstBounds, _dstPixelComponents, _dstPixelComponentCount, _dstBitDepth, _dstRowBytes);
+            }
+        }
+    };
+
+    /** @brief apply f with several threads, if the render window is large enough */
+    void multiThreadConvert(BulkConversion f,
+                            const void* pixelData,
+                            const OfxRectI & bounds,
+                            OFX::PixelComponentEnum pixelComponents,
+                            int pixelComponentCount,
+                            OFX::BitDepthEnum bitDepth,
+                            int rowBytes,
+                            const OfxRectI & renderWindow,
+                            void* dstPixelData,
+                            const OfxRectI & dstBounds,
+                            OFX::PixelComponentEnum dstPixelComponents,
+                            int dstPixelComponentCount,
+                            OFX::BitDepthEnum dstBitDepth,
+                            int dstRowBytes) const
+    {
+        if ( (renderWindow.x2 <= renderWindow.x1) || (renderWindow.y2 <= renderWindow.y1) ) {
+            return;
+        }
+        // the tables are filled once, before the threads use them
+        validate();
+        // as in PixelProcessor::getNumThreads(), with stripe scheduling and the cost of a normal pixel
+        const double nPixels = (double)(renderWindow.x2 - renderWindow.x1) * (renderWindow.y2 - renderWindow.y1);
+        const unsigned int nCPUs = OFX::PixelProcessor::getNumThreadsForPixels( nPixels, 1.,
+                                                                                std::min( OFX::MultiThread::getNumCPUs(), (unsigned int)(renderWindow.y2 - renderWindow.y1) ) );
+        if (nCPUs <= 1) {
+            (this->*f)(pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                       renderWindow,
+                       dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+
+            return;
+        }
+        BulkConversionProcessor processor(*this, f, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                                          renderWindow,
+                                          dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+        processor.multiThread(nCPUs);
+    }
+
+    /// number of floats in the stack buffer used to convert half images, a multiple of 3 and 4
+    enum { kHalfChunkSize = 1536 };
+
+    /** @brief apply f, which converts from float, to a half source image: each row is converted to float first,
+       by segments of kHalfChunkSize values. */
+    void convertFromHalfByRows(BulkConversion f,
+                               const void* pixelData,
+                               const OfxRectI & bounds,
+                               OFX::PixelComponentEnum pixelComponents,
+                               int pixelComponentCount,
+                               OFX::BitDepthEnum bitDepth,
+                               int rowBytes,
+                               const OfxRectI & renderWindow,
+                               void* dstPixelData,
+                               const OfxRectI & dstBounds,
+                               OFX::PixelComponentEnum dstPixelComponents,
+                               int dstPixelComponentCount,
+                               OFX::BitDepthEnum dstBitDepth,
+                               int dstRowBytes) const
+    {
+        assert(bitDepth == eBitDepthHalf);
+        assert(pixelComponentCount > 0 && pixelComponentCount <= 4);
+        if ( (renderWindow.x2 <= renderWindow.x1) || (renderWindow.y2 <= renderWindow.y1) ) {
+            return;
+        }
+        float row[kHalfChunkSize];
+        const int chunkPixels = kHalfChunkSize / pixelComponentCount;
+        for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
+            for (int x = renderWindow.x1; x < renderWindow.x2; x += chunkPixels) {
+                const OfxRectI chunkWindow = { x, y, std::min(x + chunkPixels, renderWindow.x2), y + 1 };
+                const int chunkSize = (chunkWindow.x2 - chunkWindow.x1) * pixelComponentCount;
+                const OFX::Half *src_pixels = (const OFX::Half*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, x, y);
+                assert(src_pixels);
+                ofxsHalfToFloat(src_pixels, chunkSize, row);
+                (this->*f)(row, chunkWindow, pixelComponents, pixelComponentCount, eBitDepthFloat, chunkSize * sizeof(float),
+                           chunkWindow,
+                           dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+            }
+        }
+    }
+
+    /** @brief apply f, which converts to float, to a half destination image: each row is converted to float, then to half,
+       by segments of kHalfChunkSize values. */
+    void convertToHalfByRows(BulkConversion f,
+                             const void* pixelData,
+                             const OfxRectI & bounds,
+                             OFX::PixelComponentEnum pixelComponents,
+                             int pixelComponentCount,
+                             OFX::BitDepthEnum bitDepth,
+                             int rowBytes,
+                             const OfxRectI & renderWindow,
+                             void* dstPixelData,
+                             const OfxRectI & dstBounds,
+                             OFX::PixelComponentEnum dstPixelComponents,
+                             int dstPixelComponentCount,
+                             OFX::BitDepthEnum dstBitDepth,
+                             int dstRowBytes) const
+    {
+        assert(dstBitDepth == eBitDepthHalf);
+        assert(dstPixelComponentCount > 0 && dstPixelComponentCount <= 4);
+        if ( (renderWindow.x2 <= renderWindow.x1) || (renderWindow.y2 <= renderWindow.y1) ) {
+            return;
+        }
+        float row[kHalfChunkSize];
+        const int chunkPixels = kHalfChunkSize / dstPixelComponentCount;
+        for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
+            for (int x = renderWindow.x1; x < renderWindow.x2; x += chunkPixels) {
+                const OfxRectI chunkWindow = { x, y, std::min(x + chunkPixels, renderWindow.x2), y + 1 };
+                const int chunkSize = (chunkWindow.x2 - chunkWindow.x1) * dstPixelComponentCount;
+                (this->*f)(pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                           chunkWindow,
+                           row, chunkWindow, dstPixelComponents, dstPixelComponentCount, eBitDepthFloat, chunkSize * sizeof(float));
+                OFX::Half *dst_pixels = (OFX::Half*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, x, y);
+                assert(dst_pixels);
+                ofxsFloatToHalf(row, chunkSize, dst_pixels);
+            }
+        }
+    }
 
     static float index_to_float(const unsigned short i);
-    static unsigned short hipart(const float f);
+
+    /// the 16 high bits of the IEEE representation of f (sign, exponent and 7 bits of mantissa), which index the look-up tables
+    static unsigned short hipart(const float f)
+    {
+        unsigned int bits;
+
+        std::memcpy( &bits, &f, sizeof(bits) );
+
+        return (unsigned short)(bits >> 16);
+    }
+};
+
+#ifdef OFXS_USE_SSE2
+/** @brief SIMD kernels for the bulk conversions of Lut.
+   The look-up tables are read with scalar loads, four at a time, since SSE2 has no gather.
+ */
+struct LutSimd
+{
+    /** @brief convert the beginning of count float values, with nComponents (1, 3 or 4) components per pixel,
+       to bytes: the colors with the table toFunc_hipart_to_uint8xx (see toColorSpaceUint8FromLinearFloatFast()),
+       and the alpha linearly (see floatToInt<256>()). Return the number of values done. */
+    static int toUint8Row(const unsigned short *table,
+                          const float *src,
+                          int count,
+                          int nComponents,
+                          unsigned char *dst)
+    {
+        // the lanes holding alpha: all of them for Alpha images, lane 3 for RGBA images, none for RGB images
+        const __m128i alphaMask = (nComponents == 1) ? _mm_set1_epi32(-1) : ( (nComponents == 4) ? _mm_set_epi32(-1, 0, 0, 0) : _mm_setzero_si128() );
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 scale = _mm_set1_ps(255.f);
+        const __m128i round = _mm_set1_epi32(0x80);
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m128i q[4];
+            for (int k = 0; k < 4; ++k) {
+                const __m128 v = _mm_loadu_ps(src + i + 4 * k);
+                // the index in the table is the high half of each float
+                union { __m128i v; int i[4]; } index;
+                index.v = _mm_srli_epi32(_mm_castps_si128(v), 16);
+                __m128i color = _mm_set_epi32(table[index.i[3]], table[index.i[2]], table[index.i[1]], table[index.i[0]]);
+                // uint8xxToChar()
+                color = _mm_srli_epi32(_mm_add_epi32(color, round), 8);
+                // floatToInt<256>(): NaN gives 0. The product is rounded as in floatToInt(), which adds 0.5 in double precision
+                const __m128i alpha = Simd::roundPositive( _mm_mul_ps(_mm_min_ps(_mm_max_ps(v, zero), one), scale) );
+                q[k] = _mm_or_si128( _mm_and_si128(alphaMask, alpha), _mm_andnot_si128(alphaMask, color) );
+            }
+            // saturating narrowing to bytes (all values are already within [0,255])
+            _mm_storeu_si128( (__m128i *)(dst + i), _mm_packus_epi16( _mm_packs_epi32(q[0], q[1]), _mm_packs_epi32(q[2], q[3]) ) );
+        }
+
+        return i;
+    }
 };
+#endif // ifdef OFXS_USE_SSE2
 
 /**
  * @brief A Lut (look-up table) used to speed-up color-spaces conversions.
@@ -300,8 +710,8 @@ class Lut
     /// and never change afterwards
     mutable unsigned short toFunc_hipart_to_uint8xx[0x10000];                 /// contains  2^16 = 65536 values between 0-255
     mutable float fromFunc_uint8_to_float[256];                 /// values between 0-1.f
-    mutable bool _init;                 ///< false if the tables are not yet initialized
-    mutable std::auto_ptr<MUTEX> _lock;                 ///< protects _init
+    mutable volatile int _init;                 ///< 0 if the tables are not yet initialized, published with release semantics
+    mutable std::auto_ptr<MUTEX> _lock;                 ///< protects the initialization of the tables
 
     friend class LutManager;
     ///private constructor, used by LutManager
@@ -309,7 +719,7 @@ class Lut
         fromColorSpaceFunctionV1 fromFunc,
         toColorSpaceFunctionV1 toFunc)
         : LutBase(name,fromFunc,toFunc)
-          , _init(false)
+          , _init(0)
           , _lock( new MUTEX() )
     {
     }
@@ -348,17 +758,17 @@ class Lut
 public:
 
     //Called by all public members
-    void validate() const
+    virtual void validate() const OVERRIDE FINAL
     {
-        _lock->lock();
-
-        if (_init) {
-            _lock->unlock();
-
+        // once the tables are filled, the lock is not needed
+        if ( OFX::Atomic::loadAcquire(&_init) ) {
             return;
         }
-        fillTables();
-        _init = true;
+        _lock->lock();
+        if (!_init) {
+            fillTables();
+            OFX::Atomic::storeRelease(&_init, 1);
+        }
         _lock->unlock();
     }
 
@@ -464,6 +874,52 @@ public:
                                        OFX::BitDepthEnum dstBitDepth,
                                        int dstRowBytes) const OVERRIDE FINAL
     {
+        to_byte_packed_dither_r(pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                                renderWindow,
+                                dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes,
+                                NULL);
+    }
+
+protected:
+    virtual void to_byte_packed_dither_r(const void* pixelData,
+                                         const OfxRectI & bounds,
+                                         OFX::PixelComponentEnum pixelComponents,
+                                         int pixelComponentCount,
+                                         OFX::BitDepthEnum bitDepth,
+                                         int rowBytes,
+                                         const OfxRectI & renderWindow,
+                                         void* dstPixelData,
+                                         const OfxRectI & dstBounds,
+                                         OFX::PixelComponentEnum dstPixelComponents,
+                                         int dstPixelComponentCount,
+                                         OFX::BitDepthEnum dstBitDepth,
+                                         int dstRowBytes,
+                                         unsigned int* randState) const OVERRIDE FINAL
+    {
+        if (bitDepth == eBitDepthHalf) {
+            // as in convertFromHalfByRows(), passing randState along
+            assert(pixelComponentCount > 0 && pixelComponentCount <= 4);
+            if ( (renderWindow.x2 <= renderWindow.x1) || (renderWindow.y2 <= renderWindow.y1) ) {
+                return;
+            }
+            float row[kHalfChunkSize];
+            const int chunkPixels = kHalfChunkSize / pixelComponentCount;
+            for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
+                for (int x = renderWindow.x1; x < renderWindow.x2; x += chunkPixels) {
+                    const OfxRectI chunkWindow = { x, y, std::min(x + chunkPixels, renderWindow.x2), y + 1 };
+                    const int chunkSize = (chunkWindow.x2 - chunkWindow.x1) * pixelComponentCount;
+                    const OFX::Half *src_pixels = (const OFX::Half*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, x, y);
+                    assert(src_pixels);
+                    ofxsHalfToFloat(src_pixels, chunkSize, row);
+                    to_byte_packed_dither_r(row, chunkWindow, pixelComponents, pixelComponentCount, eBitDepthFloat, chunkSize * sizeof(float),
+                                            chunkWindow,
+                                            dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes,
+                                            randState);
+                }
+            }
+
+            return;
+        }
         assert(bitDepth == eBitDepthFloat && dstBitDepth == eBitDepthUByte && pixelComponents == dstPixelComponents);
         assert(bounds.x1 <= renderWindow.x1 && renderWindow.x2 <= bounds.x2 &&
                bounds.y1 <= renderWindow.y1 && renderWindow.y2 <= bounds.y2 &&
@@ -481,15 +937,15 @@ public:
         assert(dstPixelComponentCount == 3 || dstPixelComponentCount == 4);
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            int xstart = renderWindow.x1 + std::rand() % (renderWindow.x2 - renderWindow.x1);
+            int xstart = renderWindow.x1 + randomInt(randState) % (renderWindow.x2 - renderWindow.x1);
             unsigned error[3] = {
                 0x80, 0x80, 0x80
             };
-            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, xstart, y);
-            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, xstart, y);
+            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, xstart, y);
+            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, xstart, y);
 
             /* go forward from starting point to end of line: */
-            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x2, y, false);
 
             while (src_pixels < src_end) {
                 for (int k = 0; k < 3; ++k) {
@@ -505,11 +961,11 @@ public:
                 src_pixels += nComponents;
             }
 
-            if (xstart > 0) {
+            if (xstart > renderWindow.x1) {
                 /* go backward from starting point to start of line: */
-                src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, xstart - 1, y);
-                src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-                dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, xstart - 1, y);
+                src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, xstart - 1, y);
+                src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+                dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, xstart - 1, y);
 
                 for (int i = 0; i < 3; ++i) {
                     error[i] = 0x80;
@@ -530,7 +986,9 @@ public:
                 }
             }
         }
-    } // to_byte_packed_dither
+    } // to_byte_packed_dither_r
+
+public:
 
     virtual void to_byte_packed_nodither(const void* pixelData,
                                          const OfxRectI & bounds,
@@ -546,6 +1004,11 @@ public:
                                          OFX::BitDepthEnum dstBitDepth,
                                          int dstRowBytes) const OVERRIDE FINAL
     {
+        if (bitDepth == eBitDepthHalf) {
+            return convertFromHalfByRows(&LutBase::to_byte_packed_nodither, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                                         renderWindow,
+                                         dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+        }
         assert(bitDepth == eBitDepthFloat && dstBitDepth == eBitDepthUByte);
         assert(pixelComponents == ePixelComponentRGBA || pixelComponents == ePixelComponentRGB || pixelComponents == ePixelComponentAlpha);
         assert(dstPixelComponents == ePixelComponentRGBA || dstPixelComponents == ePixelComponentRGB || dstPixelComponents == ePixelComponentAlpha);
@@ -559,10 +1022,29 @@ public:
         const int dstComponents = dstPixelComponentCount;
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
+
+            if (srcComponents == dstComponents) {
+                // same components: each value is converted independently
+                const int count = (renderWindow.x2 - renderWindow.x1) * srcComponents;
+#ifdef OFXS_USE_SSE2
+                int i = LutSimd::toUint8Row(toFunc_hipart_to_uint8xx, src_pixels, count, srcComponents, dst_pixels);
+#else
+                int i = 0;
+#endif
+                for (; i < count; ++i) {
+                    if ( (srcComponents == 1) || (i % srcComponents == 3) ) {
+                        // alpha channel: no colorspace conversion
+                        dst_pixels[i] = floatToInt<256>(src_pixels[i]);
+                    } else {
+                        dst_pixels[i] = toColorSpaceUint8FromLinearFloatFast(src_pixels[i]);
+                    }
+                }
+                continue;
+            }
 
+            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x2, y, false);
             unsigned char tmpPixel[4] = {0, 0, 0, 0};
             while (src_pixels != src_end) {
                 if (srcComponents == 1) {
@@ -605,6 +1087,11 @@ public:
                                             OFX::BitDepthEnum dstBitDepth,
                                             int dstRowBytes) const OVERRIDE FINAL
     {
+        if (bitDepth == eBitDepthHalf) {
+            return convertFromHalfByRows(&LutBase::to_byte_grayscale_nodither, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                                         renderWindow,
+                                         dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+        }
         assert(bitDepth == eBitDepthFloat && dstBitDepth == eBitDepthUByte &&
                (pixelComponents == ePixelComponentRGB || pixelComponents == ePixelComponentRGBA) &&
                dstPixelComponents == ePixelComponentAlpha &&
@@ -619,9 +1106,9 @@ public:
         const int srcComponents = pixelComponentCount;
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
+            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x2, y, false);
 
             while (src_pixels != src_end) {
                 float l = 0.2126 * src_pixels[0] + 0.7152 * src_pixels[1] + 0.0722 * src_pixels[2]; // Rec.709 luminance formula
@@ -646,6 +1133,11 @@ public:
                                  OFX::BitDepthEnum dstBitDepth,
                                  int dstRowBytes) const OVERRIDE FINAL
     {
+        if (bitDepth == eBitDepthHalf) {
+            return convertFromHalfByRows(&LutBase::to_short_packed, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                                         renderWindow,
+                                         dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+        }
         assert(bitDepth == eBitDepthFloat && dstBitDepth == eBitDepthUShort && pixelComponents == dstPixelComponents && pixelComponentCount == dstPixelComponentCount);
         assert(bounds.x1 <= renderWindow.x1 && renderWindow.x2 <= bounds.x2 &&
                bounds.y1 <= renderWindow.y1 && renderWindow.y2 <= bounds.y2 &&
@@ -656,9 +1148,9 @@ public:
         const int nComponents = pixelComponentCount;
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            unsigned char *dst_pixels = (unsigned char*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const float *src_pixels = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            unsigned short *dst_pixels = (unsigned short*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
+            const float *src_end = (const float*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x2, y, false);
 
             while (src_pixels != src_end) {
                 if (nComponents == 1) {
@@ -693,6 +1185,11 @@ public:
                                   OFX::BitDepthEnum dstBitDepth,
                                   int dstRowBytes) const OVERRIDE FINAL
     {
+        if (dstBitDepth == eBitDepthHalf) {
+            return convertToHalfByRows(&LutBase::from_byte_packed, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                                       renderWindow,
+                                       dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+        }
         assert(bitDepth == eBitDepthUByte && dstBitDepth == eBitDepthFloat && pixelComponents == dstPixelComponents && pixelComponentCount == dstPixelComponentCount);
         assert(bounds.x1 <= renderWindow.x1 && renderWindow.x2 <= bounds.x2 &&
                bounds.y1 <= renderWindow.y1 && renderWindow.y2 <= bounds.y2 &&
@@ -703,14 +1200,14 @@ public:
         const int nComponents = pixelComponentCount;
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const unsigned char *src_pixels = (const unsigned char*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            float *dst_pixels = (float*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const unsigned char *src_end = (const unsigned char*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const unsigned char *src_pixels = (const unsigned char*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            float *dst_pixels = (float*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
+            const unsigned char *src_end = (const unsigned char*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x2, y, false);
 
 
             while (src_pixels != src_end) {
                 if (nComponents == 1) {
-                    *dst_pixels++ = intToFloat<256>(*src_pixels++);
+                    dst_pixels[0] = intToFloat<256>(src_pixels[0]);
                 } else {
                     for (int k = 0; k < 3; ++k) {
                         dst_pixels[k] = fromColorSpaceUint8ToLinearFloatFast(src_pixels[k]);
@@ -740,6 +1237,11 @@ public:
                                    OFX::BitDepthEnum dstBitDepth,
                                    int dstRowBytes) const OVERRIDE FINAL
     {
+        if (dstBitDepth == eBitDepthHalf) {
+            return convertToHalfByRows(&LutBase::from_short_packed, pixelData, bounds, pixelComponents, pixelComponentCount, bitDepth, rowBytes,
+                                       renderWindow,
+                                       dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+        }
         assert(bitDepth == eBitDepthUShort && dstBitDepth == eBitDepthFloat && pixelComponents == dstPixelComponents && pixelComponentCount == dstPixelComponentCount);
         assert(bounds.x1 <= renderWindow.x1 && renderWindow.x2 <= bounds.x2 &&
                bounds.y1 <= renderWindow.y1 && renderWindow.y2 <= bounds.y2 &&
@@ -750,14 +1252,14 @@ public:
         const int nComponents = pixelComponentCount;
 
         for (int y = renderWindow.y1; y < renderWindow.y2; ++y) {
-            const unsigned short *src_pixels = (const unsigned short*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, 0, y);
-            float *dst_pixels = (float*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponents, dstBitDepth, dstRowBytes, 0, y);
-            const unsigned short *src_end = (const unsigned short*)OFX::getPixelAddress(pixelData, bounds, pixelComponents, bitDepth, rowBytes, renderWindow.x2, y, false);
+            const unsigned short *src_pixels = (const unsigned short*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x1, y);
+            float *dst_pixels = (float*)OFX::getPixelAddress(dstPixelData, dstBounds, dstPixelComponentCount, dstBitDepth, dstRowBytes, renderWindow.x1, y);
+            const unsigned short *src_end = (const unsigned short*)OFX::getPixelAddress(pixelData, bounds, pixelComponentCount, bitDepth, rowBytes, renderWindow.x2, y, false);
 
 
             while (src_pixels != src_end) {
                 if (nComponents == 1) {
-                    *dst_pixels++ = intToFloat<65536>(*src_pixels++);
+                    dst_pixels[0] = intToFloat<65536>(src_pixels[0]);
                 } else {
                     for (int k = 0; k < 3; ++k) {
                         dst_pixels[k] = fromColorSpaceUint16ToLinearFloatFast(src_pixels[k]);
@@ -944,10 +1446,15 @@ void lab_to_rgb( float l, float a, float b, float *r, float *g, float *b_ );
 
 // a Singleton that holds precomputed LUTs for the whole application.
 // The m_instance member is static and is thus built before the first call to Instance().
+// The luts are kept in a list to which entries are only ever prepended, with an atomic compare-and-swap
+// on its head: lookups take no lock, and each lut is created and initialized once.
 class LutManager
 {
-    //each lut with a ref count mapped against their name
-    typedef std::map<std::string,const LutBase * > LutsMap;
+    struct LutEntry
+    {
+        const LutBase* lut;
+        LutEntry* next;
+    };
 
 public:
     static LutManager &Instance()
@@ -958,28 +1465,41 @@ public:
     /**
      * @brief Returns a pointer to a lut with the given name and the given from and to functions.
      * If a lut with the same name didn't already exist, then it will create one.
-     * WARNING : NOT THREAD-SAFE
+     * It is thread-safe: if several threads ask for the same new lut, only one is created, and
+     * its tables are initialized before it is returned.
      **/
     template <class MUTEX>
     static const LutBase* getLut(const std::string & name,
                                  fromColorSpaceFunctionV1 fromFunc,
                                  toColorSpaceFunctionV1 toFunc)
     {
-        LutsMap::iterator found = LutManager::m_instance.luts.find(name);
-
-        if ( found != LutManager::m_instance.luts.end() ) {
-            return found->second;
-        } else {
-            Lut<MUTEX>* lut = new Lut<MUTEX>(name,fromFunc,toFunc);
-            lut->validate();
-            std::pair<LutsMap::iterator,bool> ret =
-                LutManager::m_instance.luts.insert( std::make_pair( name, lut ) );
-            assert(ret.second);
-
-            return ret.first->second;
+        LutEntry* head = OFX::Atomic::loadPointerAcquire(&m_instance._head);
+        const LutBase* lut = findLut(head, NULL, name);
+
+        if (!lut) {
+            LutEntry* entry = new LutEntry;
+            entry->lut = new Lut<MUTEX>(name,fromFunc,toFunc);
+            for (;;) {
+                entry->next = head;
+                if ( OFX::Atomic::compareAndSwapPointer(&m_instance._head, head, entry) ) {
+                    lut = entry->lut;
+                    break;
+                }
+                // another thread added luts: if one of them has the same name, use it instead
+                LutEntry* newHead = OFX::Atomic::loadPointerAcquire(&m_instance._head);
+                lut = findLut(newHead, head, name);
+                if (lut) {
+                    delete entry->lut;
+                    delete entry;
+                    break;
+                }
+                head = newHead;
+            }
         }
+        // the tables are filled by the first thread that gets here, the others wait for it
+        lut->validate();
 
-        return NULL;
+        return lut;
     }
 
     ///buit-ins color-spaces
@@ -1044,7 +1564,22 @@ private:
     }
 
     LutManager(const LutManager &)
+        : _head(NULL)
+    {
+    }
+
+    /// the lut with the given name in the entries from first to last (excluded)
+    static const LutBase* findLut(const LutEntry* first,
+                                  const LutEntry* last,
+                                  const std::string & name)
     {
+        for (const LutEntry* e = first; e != last; e = e->next) {
+            if (e->lut->getName() == name) {
+                return e->lut;
+            }
+        }
+
+        return NULL;
     }
 
     static LutManager m_instance;
@@ -1056,7 +1591,7 @@ private:
     ///the host multi-thread suite.
     ~LutManager();
 
-    LutsMap luts;
+    LutEntry* volatile _head;
 };
 
 
@@ -172,7 +172,8 @@ ofxsClampIfInt(float v,
         return v;
     }
 
-    return ofxsClamp(v, min, max) * maxValue + 0.5;
+    // v is in [0, maxValue]: clamp it and round it to the nearest integer
+    return ofxsClamp(v, min, max) + 0.5;
 }
 
 
@@ -0,0 +1,621 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * OFX Masking/Mixing of rows of pixels, and mask analysis
+ */
+
+#ifndef Misc_ofxsMaskMixRow_h
+#define Misc_ofxsMaskMixRow_h
+
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include <ofxsImageEffect.h>
+
+#include "ofxsHalf.h"
+#include "ofxsMaskMix.h"
+#include "ofxsPixelProcessor.h"
+#include "ofxsSimd.h"
+
+namespace OFX {
+/** @brief kind of a run of mask values (see ofxsMaskRun()) */
+enum MaskRunEnum
+{
+    eMaskRunZero = 0, ///< the mask is 0
+    eMaskRunOne,      ///< the mask is maxValue
+    eMaskRunPartial,  ///< other values, which may include short runs of 0 or maxValue
+};
+
+/** @brief get the length of the run of mask values that starts at maskPix[0] (n > 0), and its kind.
+
+   Partial runs absorb runs of 0 or maxValue shorter than kMaskRunMinLength, so that noisy masks
+   do not produce many tiny runs.
+ */
+template <class PIX, int maxValue>
+int
+ofxsMaskRun(const PIX *maskPix,
+            int n,
+            MaskRunEnum *kind)
+{
+    const int kMaskRunMinLength = 16;
+    const PIX zero = PIX(0);
+    const PIX one = PIX(maxValue);
+    int i = 1;
+
+    assert(n > 0);
+    if ( (maskPix[0] == zero) || (maskPix[0] == one) ) {
+        const PIX v = maskPix[0];
+        while ( i < n && (maskPix[i] == v) ) {
+            ++i;
+        }
+        *kind = (v == zero) ? eMaskRunZero : eMaskRunOne;
+
+        return i;
+    }
+    while (i < n) {
+        if ( (maskPix[i] != zero) && (maskPix[i] != one) ) {
+            ++i;
+            continue;
+        }
+        // a run of 0 or maxValue: stop here if it is long enough
+        const PIX v = maskPix[i];
+        int j = i + 1;
+        while ( j < n && j - i < kMaskRunMinLength && (maskPix[j] == v) ) {
+            ++j;
+        }
+        if (j - i >= kMaskRunMinLength) {
+            break;
+        }
+        i = j;
+    }
+    *kind = eMaskRunPartial;
+
+    return i;
+}
+
+/** @brief SIMD kernels for ofxsMaskMixRow(). The primary template is used when there is no
+   SIMD version (kSupported is 0): the pixels are processed one by one.
+ */
+template <class PIX, int nComponents, int maxValue,
+          bool supported =
+#ifdef OFXS_USE_SSE2
+              Simd::PixelIO<PIX, maxValue>::supported != 0
+#else
+              false
+#endif
+          >
+struct MaskMixSimd
+{
+    enum { kSupported = 0 };
+
+    static int storeRow(const float *,
+                        int,
+                        PIX *)
+    {
+        return 0;
+    }
+
+    static int mixRow(const float *,
+                      int,
+                      const PIX *,
+                      const PIX *,
+                      float,
+                      bool,
+                      PIX *)
+    {
+        return 0;
+    }
+};
+
+#ifdef OFXS_USE_SSE2
+template <class PIX, int nComponents, int maxValue>
+struct MaskMixSimd<PIX, nComponents, maxValue, true>
+{
+    enum { kSupported = 1 };
+
+    /** @brief clamp and convert the beginning of a row of n pixels, and return the number of pixels done */
+    static int storeRow(const float *tmpPix,
+                        int n,
+                        PIX *dstPix)
+    {
+        // the row is a flat array of values, converted 16 at a time
+        const int count = n * nComponents;
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m128 v[4];
+            Simd::PixelIO<float, 1>::load16(tmpPix + i, v);
+            Simd::PixelIO<PIX, maxValue>::store16(dstPix + i, v);
+        }
+
+        return i / nComponents;
+    }
+
+    /** @brief mix the beginning of a row of n pixels with srcPix (which may be NULL), by the factors given
+       by maskPix (which may be NULL: the factor is mix), and return the number of pixels done. */
+    static int mixRow(const float *tmpPix,
+                      int n,
+                      const PIX *srcPix,
+                      const PIX *maskPix,
+                      float mix,
+                      bool maskInvert,
+                      PIX *dstPix)
+    {
+        typedef Simd::PixelIO<PIX, maxValue> IO;
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 vmix = _mm_set1_ps(mix);
+        int i = 0;
+
+        if (nComponents == 1) {
+            // four pixels at a time. Divide by maxValue, like ofxsMaskMixPix(), to get exactly the same results
+            const __m128 vmax = _mm_set1_ps( (float)maxValue );
+            for (; i + 4 <= n; i += 4) {
+                __m128 a = vmix;
+                if (maskPix) {
+                    __m128 m = _mm_div_ps(IO::load4(maskPix + i), vmax);
+                    if (maskInvert) {
+                        m = _mm_sub_ps(one, m);
+                    }
+                    a = _mm_mul_ps(m, vmix);
+                }
+                __m128 v = _mm_mul_ps(Simd::PixelIO<float, 1>::load4(tmpPix + i), a);
+                if (srcPix) {
+                    v = _mm_add_ps( v, _mm_mul_ps( _mm_sub_ps(one, a), IO::load4(srcPix + i) ) );
+                }
+                IO::store4(dstPix + i, v);
+            }
+
+            return i;
+        }
+        if ( (nComponents != 3) && (nComponents != 4) ) {
+            return 0;
+        }
+        for (; i < n; ++i, tmpPix += nComponents, dstPix += nComponents) {
+            float alpha = mix;
+            if (maskPix) {
+                float maskScale = maskPix[i] / float(maxValue);
+                if (maskInvert) {
+                    maskScale = 1.f - maskScale;
+                }
+                alpha = maskScale * mix;
+            }
+            const __m128 a = _mm_set1_ps(alpha);
+            __m128 v = _mm_mul_ps(Simd::loadPixel<float, 1, nComponents>(tmpPix), a);
+            if (srcPix) {
+                v = _mm_add_ps( v, _mm_mul_ps( _mm_sub_ps(one, a), Simd::loadPixel<PIX, maxValue, nComponents>(srcPix + i * nComponents) ) );
+            }
+            Simd::storePixel<PIX, maxValue, nComponents>(dstPix, v);
+        }
+
+        return n;
+    }
+};
+#endif // ifdef OFXS_USE_SSE2
+
+/** @brief mix n pixels with the same factor alpha (see ofxsMaskMixRow()).
+   The source is copied where alpha is 0, and the effect result is stored where alpha is 1.
+   dstPix may be srcPix. */
+template <class PIX, int nComponents, int maxValue>
+void
+ofxsMaskMixConstantRow(const float *tmpPix,
+                       int n,
+                       const PIX *srcPix,
+                       float alpha,
+                       PIX *dstPix)
+{
+    typedef MaskMixSimd<PIX, nComponents, maxValue> Kernel;
+    int i = 0;
+
+    if (alpha == 0.f) {
+        if (srcPix == dstPix) {
+            // nothing to do
+        } else if (srcPix) {
+            std::memcpy( dstPix, srcPix, n * nComponents * sizeof(PIX) );
+        } else {
+            std::fill( dstPix, dstPix + n * nComponents, PIX() );
+        }
+
+        return;
+    }
+    if (alpha == 1.f) {
+        i = Kernel::kSupported ? Kernel::storeRow(tmpPix, n, dstPix) : 0;
+        for (int c = i * nComponents; c < n * nComponents; ++c) {
+            dstPix[c] = ofxsClampIfInt<PIX, maxValue>(tmpPix[c], 0, maxValue);
+        }
+
+        return;
+    }
+    i = Kernel::kSupported ? Kernel::mixRow(tmpPix, n, srcPix, 0, alpha, false, dstPix) : 0;
+    for (int c = i * nComponents; c < n * nComponents; ++c) {
+        float v = tmpPix[c] * alpha + (srcPix ? (1.f - alpha) * srcPix[c] : 0.f);
+        dstPix[c] = ofxsClampIfInt<PIX, maxValue>(v, 0, maxValue);
+    }
+}
+
+/** @brief mix n pixels by the mask values in maskPix (see ofxsMaskMixRow()).
+   The mask is split into runs of 0, maxValue and other values (see ofxsMaskRun()): only the
+   pixels in partial runs are actually mixed. */
+template <class PIX, int nComponents, int maxValue>
+void
+ofxsMaskMixMaskedRow(const float *tmpPix,
+                     int n,
+                     const PIX *srcPix,
+                     const PIX *maskPix,
+                     float mix,
+                     bool maskInvert,
+                     PIX *dstPix)
+{
+    typedef MaskMixSimd<PIX, nComponents, maxValue> Kernel;
+    // the factors on runs of 0 and maxValue, computed as in ofxsMaskMixPix()
+    const float alphaZero = (maskInvert ? 1.f : 0.f) * mix;
+    const float alphaOne = (maskInvert ? 0.f : 1.f) * mix;
+
+    for (int i = 0; i < n;) {
+        MaskRunEnum kind;
+        const int len = ofxsMaskRun<PIX, maxValue>(maskPix + i, n - i, &kind);
+        const int off = i * nComponents;
+        const PIX *src = srcPix ? srcPix + off : 0;
+        if (kind != eMaskRunPartial) {
+            ofxsMaskMixConstantRow<PIX, nComponents, maxValue>(tmpPix + off, len, src, (kind == eMaskRunZero) ? alphaZero : alphaOne, dstPix + off);
+        } else {
+            int j = Kernel::kSupported ? Kernel::mixRow(tmpPix + off, len, src, maskPix + i, mix, maskInvert, dstPix + off) : 0;
+            for (; j < len; ++j) {
+                float maskScale = maskPix[i + j] / float(maxValue);
+                if (maskInvert) {
+                    maskScale = 1.f - maskScale;
+                }
+                const float alpha = maskScale * mix;
+                for (int c = j * nComponents; c < (j + 1) * nComponents; ++c) {
+                    float v = tmpPix[off + c] * alpha + (src ? (1.f - alpha) * src[c] : 0.f);
+                    dstPix[off + c] = ofxsClampIfInt<PIX, maxValue>(v, 0, maxValue);
+                }
+            }
+        }
+        i += len;
+    }
+}
+
+/** @brief mask and mix the pixels [x1,x2) of row y at once.
+
+   The result is the same as calling ofxsMaskMixPix() on each pixel, with srcPix taken from srcImg
+   (black and transparent outside of srcImg, or if srcImg is NULL). tmpRow holds the x2-x1 effect
+   pixels, not normalized (within [0,maxValue]), and dstRow points to the destination pixel at (x1,y).
+
+   Long runs of 0 or 1 in the mask are not mixed at all: where the mix factor is 0 the source pixels are
+   copied, and where it is 1 the effect pixels are stored directly, so that masked renders cost
+   about the same as unmasked ones.
+ */
+template <class PIX, int nComponents, int maxValue, bool masked>
+void
+ofxsMaskMixRow(const float *tmpRow, //!< effect pixels
+               int x1, //!< first pixel of the row (PIXEL coordinates)
+               int x2, //!< end of the row
+               int y,
+               const OFX::Image *srcImg, //!< the background image (the output is srcImg where maskImg=0, else it is tmpRow)
+               bool domask, //!< apply the mask?
+               const OFX::Image *maskImg, //!< the mask image (ignored if masked=false or domask=false), which must be Alpha
+               float mix, //!< mix factor between the output and srcImg
+               bool maskInvert, //<! invert mask behavior
+               PIX *dstRow) //!< destination pixel at (x1,y)
+{
+    assert(!domask || !maskImg || maskImg->getPixelComponents() == ePixelComponentAlpha);
+    const bool useMask = masked && domask;
+    OFX::PixelRowSegment srcSeg, maskSeg;
+
+    for (int x = x1; x < x2; x = srcSeg.x2) {
+        // the source and the mask have no boundary conditions: black outside
+        OFX::getPixelRowSegment(srcImg, 0, x, y, x2, &srcSeg);
+        if (useMask) {
+            OFX::getPixelRowSegment(maskImg, 0, x, y, srcSeg.x2, &maskSeg);
+            srcSeg.x2 = maskSeg.x2;
+        }
+        const int off = (x - x1) * nComponents;
+        const int n = srcSeg.x2 - x;
+        const PIX *srcPix = (const PIX *)srcSeg.pix;
+        if (!useMask) {
+            ofxsMaskMixConstantRow<PIX, nComponents, maxValue>(tmpRow + off, n, srcPix, mix, dstRow + off);
+        } else if (maskSeg.pix) {
+            ofxsMaskMixMaskedRow<PIX, nComponents, maxValue>(tmpRow + off, n, srcPix, (const PIX *)maskSeg.pix, mix, maskInvert, dstRow + off);
+        } else {
+            // no mask pixels: as in ofxsMaskMixPix()
+            ofxsMaskMixConstantRow<PIX, nComponents, maxValue>(tmpRow + off, n, srcPix, (maskInvert ? 1.f : 0.f) * mix, dstRow + off);
+        }
+    }
+}
+
+/** @brief index of the first of the n pixels that differs (bitwise) from v, or n if they are all equal to v */
+template <class PIX>
+int
+ofxsMaskFindFirstNot(const PIX *maskPix,
+                     int n,
+                     PIX v)
+{
+    int i = 0;
+
+#ifdef OFXS_USE_SSE2
+    if ( (sizeof(PIX) == 1) || (sizeof(PIX) == 2) || (sizeof(PIX) == 4) ) {
+        // compare 16 bytes at a time with v repeated
+        const int perVector = 16 / (int)sizeof(PIX);
+        PIX pattern[16 / sizeof(PIX)];
+        std::fill(pattern, pattern + perVector, v);
+        const __m128i vv = _mm_loadu_si128( (const __m128i *)pattern );
+        for (; i + perVector <= n; i += perVector) {
+            __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128( (const __m128i *)(maskPix + i) ), vv);
+            if (_mm_movemask_epi8(eq) != 0xffff) {
+                break;
+            }
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if ( std::memcmp( &maskPix[i], &v, sizeof(PIX) ) != 0 ) {
+            return i;
+        }
+    }
+
+    return n;
+}
+
+/** @brief index of the last of the n pixels that differs (bitwise) from v, or -1 if they are all equal to v */
+template <class PIX>
+int
+ofxsMaskFindLastNot(const PIX *maskPix,
+                    int n,
+                    PIX v)
+{
+    int i = n;
+
+#ifdef OFXS_USE_SSE2
+    if ( (sizeof(PIX) == 1) || (sizeof(PIX) == 2) || (sizeof(PIX) == 4) ) {
+        const int perVector = 16 / (int)sizeof(PIX);
+        PIX pattern[16 / sizeof(PIX)];
+        std::fill(pattern, pattern + perVector, v);
+        const __m128i vv = _mm_loadu_si128( (const __m128i *)pattern );
+        for (; i - perVector >= 0; i -= perVector) {
+            __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128( (const __m128i *)(maskPix + i - perVector) ), vv);
+            if (_mm_movemask_epi8(eq) != 0xffff) {
+                break;
+            }
+        }
+    }
+#endif
+    while (--i >= 0) {
+        if ( std::memcmp( &maskPix[i], &v, sizeof(PIX) ) != 0 ) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/** @brief occupancy of the tiles of a window by the active part of a mask (see ofxsMaskGetActiveBounds()) */
+struct MaskTileOccupancy
+{
+    OfxRectI window;      ///< the window covered by the tiles
+    int tileSize;         ///< the width and height of the tiles, in pixels
+    int nTilesX;
+    int nTilesY;
+    std::vector<unsigned char> occupied; ///< nTilesX * nTilesY flags, row by row from window.y1: 1 if the mask is active on the tile
+
+    explicit MaskTileOccupancy(int size = 64)
+        : tileSize(size)
+        , nTilesX(0)
+        , nTilesY(0)
+        , occupied()
+    {
+        assert(size > 0);
+        window.x1 = window.y1 = window.x2 = window.y2 = 0;
+    }
+
+    /** @brief reset to an empty occupancy of w */
+    void reset(const OfxRectI & w)
+    {
+        window = w;
+        nTilesX = (w.x2 > w.x1) ? (w.x2 - w.x1 + tileSize - 1) / tileSize : 0;
+        nTilesY = (w.y2 > w.y1) ? (w.y2 - w.y1 + tileSize - 1) / tileSize : 0;
+        occupied.assign( (size_t)nTilesX * nTilesY, 0 );
+    }
+
+    /** @brief is the mask active on some pixel of rect (which is clipped to the window)? */
+    bool isOccupied(const OfxRectI & rect) const
+    {
+        const int x1 = std::max(rect.x1, window.x1);
+        const int x2 = std::min(rect.x2, window.x2);
+        const int y1 = std::max(rect.y1, window.y1);
+        const int y2 = std::min(rect.y2, window.y2);
+
+        if ( (x2 <= x1) || (y2 <= y1) ) {
+            return false;
+        }
+        for (int ty = (y1 - window.y1) / tileSize; ty <= (y2 - 1 - window.y1) / tileSize; ++ty) {
+            for (int tx = (x1 - window.x1) / tileSize; tx <= (x2 - 1 - window.x1) / tileSize; ++tx) {
+                if (occupied[(size_t)ty * nTilesX + tx]) {
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+};
+
+/** @brief mark the tiles of row y (within tiles->window) on which the mask is active.
+   The active pixels of the row are in [first, last], and the pixels of [x1,x2) differ from inactive
+   where the mask is active. maskPix is the mask pixel at x1, or NULL if [x1,x2) is outside the mask. */
+template <class PIX>
+void
+ofxsMaskMarkTiles(const PIX *maskPix,
+                  int x1,
+                  int x2,
+                  PIX inactive,
+                  int first,
+                  int last,
+                  int y,
+                  MaskTileOccupancy *tiles)
+{
+    const int size = tiles->tileSize;
+    unsigned char *row = &tiles->occupied[(size_t)( (y - tiles->window.y1) / size ) * tiles->nTilesX];
+    const int tx1 = (first - tiles->window.x1) / size;
+    const int tx2 = (last - tiles->window.x1) / size;
+
+    row[tx1] = 1;
+    row[tx2] = 1;
+    for (int tx = tx1 + 1; tx < tx2; ++tx) {
+        if (row[tx]) {
+            continue;
+        }
+        // the tile is active if it is outside [x1,x2) (the mask is active outside the mask bounds), or if it has a pixel that is not inactive
+        const int tileX1 = tiles->window.x1 + tx * size;
+        const int tileX2 = tileX1 + size;
+        if ( !maskPix || (tileX1 < x1) || (x2 < tileX2) ||
+             (ofxsMaskFindFirstNot<PIX>(maskPix + (tileX1 - x1), size, inactive) < size) ) {
+            row[tx] = 1;
+        }
+    }
+}
+
+/** @brief same as ofxsMaskGetActiveBounds(), for a mask of type PIX */
+template <class PIX, int maxValue>
+bool
+ofxsMaskGetActiveBoundsForDepth(const OFX::Image *maskImg,
+                                bool maskInvert,
+                                const OfxRectI & window,
+                                OfxRectI *bounds,
+                                MaskTileOccupancy *tiles)
+{
+    // the mask value where the effect is not applied: the mix factor is 0 there
+    const PIX inactive = maskInvert ? PIX(maxValue) : PIX(0);
+    const OfxRectI maskBounds = maskImg->getBounds();
+
+    bounds->x1 = window.x2;
+    bounds->x2 = window.x1;
+    bounds->y1 = window.y2;
+    bounds->y2 = window.y1;
+    for (int y = window.y1; y < window.y2; ++y) {
+        // the pixels of [x1,x2) are in the mask, the others are 0 (active if maskInvert)
+        const bool inMask = (maskBounds.y1 <= y) && (y < maskBounds.y2);
+        const int x1 = inMask ? std::max(window.x1, maskBounds.x1) : window.x2;
+        const int x2 = inMask ? std::min(window.x2, maskBounds.x2) : window.x2;
+        const PIX *maskPix = (x1 < x2) ? (const PIX *)maskImg->getPixelAddress(x1, y) : 0;
+        int first, last;
+        if (maskInvert && ( (x1 >= x2) || (window.x1 < x1) || (x2 < window.x2) )) {
+            // some pixels are outside the mask
+            first = (x1 >= x2 || window.x1 < x1) ? window.x1 : x1 + ofxsMaskFindFirstNot<PIX>(maskPix, x2 - x1, inactive);
+            last = (x1 >= x2 || x2 < window.x2) ? window.x2 - 1 : x1 + ofxsMaskFindLastNot<PIX>(maskPix, x2 - x1, inactive);
+        } else if (maskPix) {
+            first = x1 + ofxsMaskFindFirstNot<PIX>(maskPix, x2 - x1, inactive);
+            if (first == x2) {
+                continue;
+            }
+            last = x1 + ofxsMaskFindLastNot<PIX>(maskPix, x2 - x1, inactive);
+        } else {
+            continue;
+        }
+        bounds->x1 = std::min(bounds->x1, first);
+        bounds->x2 = std::max(bounds->x2, last + 1);
+        bounds->y1 = std::min(bounds->y1, y);
+        bounds->y2 = y + 1;
+        if (tiles) {
+            ofxsMaskMarkTiles<PIX>(maskPix, x1, x2, inactive, first, last, y, tiles);
+        }
+    }
+    if ( (bounds->x2 <= bounds->x1) || (bounds->y2 <= bounds->y1) ) {
+        bounds->x1 = bounds->x2 = bounds->y1 = bounds->y2 = 0;
+
+        return false;
+    }
+
+    return true;
+}
+
+/** @brief get the bounding box of the pixels of window where the mask is active, i.e. where ofxsMaskMixPix()
+   uses the effect result: where the mask is not 0 (or not 1, if maskInvert is true).
+   Outside of the mask bounds or if maskImg is NULL, the mask is 0.
+
+   Returns false if the mask is active nowhere (bounds is then empty): if masking is enabled, the effect
+   is then an identity on window, and the render window can be shrunk to bounds.
+
+   If tiles is not NULL, it is reset to window and the tiles on which the mask is active are marked.
+ */
+inline bool
+ofxsMaskGetActiveBounds(const OFX::Image *maskImg, //!< the mask image, which must be Alpha
+                        bool maskInvert, //!< invert mask behavior
+                        const OfxRectI & window,
+                        OfxRectI *bounds,
+                        MaskTileOccupancy *tiles = 0)
+{
+    assert(!maskImg || maskImg->getPixelComponents() == ePixelComponentAlpha);
+    if (tiles) {
+        tiles->reset(window);
+    }
+    if ( (window.x2 <= window.x1) || (window.y2 <= window.y1) ) {
+        bounds->x1 = bounds->x2 = bounds->y1 = bounds->y2 = 0;
+
+        return false;
+    }
+    if (!maskImg) {
+        if (!maskInvert) {
+            bounds->x1 = bounds->x2 = bounds->y1 = bounds->y2 = 0;
+
+            return false;
+        }
+        *bounds = window;
+        if (tiles) {
+            tiles->occupied.assign(tiles->occupied.size(), 1);
+        }
+
+        return true;
+    }
+    switch ( maskImg->getPixelDepth() ) {
+    case OFX::eBitDepthUByte:
+        return ofxsMaskGetActiveBoundsForDepth<unsigned char, 255>(maskImg, maskInvert, window, bounds, tiles);
+
+    case OFX::eBitDepthUShort:
+        return ofxsMaskGetActiveBoundsForDepth<unsigned short, 65535>(maskImg, maskInvert, window, bounds, tiles);
+
+    case OFX::eBitDepthHalf:
+        return ofxsMaskGetActiveBoundsForDepth<OFX::Half, 1>(maskImg, maskInvert, window, bounds, tiles);
+
+    case OFX::eBitDepthFloat:
+        return ofxsMaskGetActiveBoundsForDepth<float, 1>(maskImg, maskInvert, window, bounds, tiles);
+
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+
+        return true;
+    }
+}
+
+/** @brief is the effect an identity on window because of the mask?
+   This is the case if masking is enabled, and the mask is 0 everywhere on window (or 1, if maskInvert is true).
+   It may be used in isIdentity(), with the mask image fetched at the identity time. */
+inline bool
+ofxsMaskIsIdentity(bool domask, //!< apply the mask?
+                   const OFX::Image *maskImg, //!< the mask image, or NULL if the mask is not connected
+                   bool maskInvert, //!< invert mask behavior
+                   const OfxRectI & window)
+{
+    OfxRectI bounds;
+
+    return domask && !ofxsMaskGetActiveBounds(maskImg, maskInvert, window, &bounds);
+}
+} // OFX
+
+#endif // ifndef Misc_ofxsMaskMixRow_h
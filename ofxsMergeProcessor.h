@@ -0,0 +1,1392 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Image-level merge of two images, with one of the operators of ofxsMerging.h.
+ */
+
+#ifndef openfx_supportext_ofxsMergeProcessor_h
+#define openfx_supportext_ofxsMergeProcessor_h
+
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <memory> // for auto_ptr
+#include <algorithm>
+
+#include "ofxsAtomic.h"
+#include "ofxsPixelProcessor.h"
+#include "ofxsMaskMix.h"
+#include "ofxsMaskMixRow.h"
+#include "ofxsMerging.h"
+#include "ofxsSimd.h"
+#include "ofxsHalf.h"
+
+namespace OFX {
+namespace MergeImages2D {
+/** @brief the merge operators that can be applied component by component in single precision, by
+   MergeOp<f>::apply(A, B, a, b), where a and b are the alphas of A and B, all normalized to [0,1].
+   The scalar and the SIMD versions of apply() compute exactly the same thing.
+   kVectorized is 0 for the other operators, which use mergePixel().
+ */
+template <MergingFunctionEnum f>
+struct MergeOp
+{
+    enum { kVectorized = 0 };
+};
+
+#ifdef OFXS_USE_SSE2
+#define OFXS_MERGE_OP(f, expr, simdExpr) \
+    template <> \
+    struct MergeOp<f> \
+    { \
+        enum { kVectorized = 1 }; \
+        static float apply(float A, float B, float a, float b) \
+        { \
+            (void)A; (void)B; (void)a; (void)b; \
+            return expr; \
+        } \
+        static __m128 apply(__m128 A, __m128 B, __m128 a, __m128 b) \
+        { \
+            const __m128 one = _mm_set1_ps(1.f); \
+            (void)A; (void)B; (void)a; (void)b; (void)one; \
+            return simdExpr; \
+        } \
+    };
+#else
+#define OFXS_MERGE_OP(f, expr, simdExpr) \
+    template <> \
+    struct MergeOp<f> \
+    { \
+        enum { kVectorized = 1 }; \
+        static float apply(float A, float B, float a, float b) \
+        { \
+            (void)A; (void)B; (void)a; (void)b; \
+            return expr; \
+        } \
+    };
+#endif
+
+OFXS_MERGE_OP( eMergeATop, A * b + B * (1.f - a), _mm_add_ps( _mm_mul_ps(A, b), _mm_mul_ps( B, _mm_sub_ps(one, a) ) ) )
+OFXS_MERGE_OP( eMergeAverage, (A + B) * 0.5f, _mm_mul_ps( _mm_add_ps(A, B), _mm_set1_ps(0.5f) ) )
+OFXS_MERGE_OP( eMergeCopy, A, A )
+OFXS_MERGE_OP( eMergeDifference, std::fabs(A - B), _mm_andnot_ps( _mm_set1_ps(-0.f), _mm_sub_ps(A, B) ) )
+OFXS_MERGE_OP( eMergeExclusion, A + B - 2.f * A * B, _mm_sub_ps( _mm_add_ps(A, B), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.f), A), B) ) )
+OFXS_MERGE_OP( eMergeFrom, B - A, _mm_sub_ps(B, A) )
+OFXS_MERGE_OP( eMergeGrainExtract, B - A + 0.5f, _mm_add_ps( _mm_sub_ps(B, A), _mm_set1_ps(0.5f) ) )
+OFXS_MERGE_OP( eMergeGrainMerge, B + A - 0.5f, _mm_sub_ps( _mm_add_ps(B, A), _mm_set1_ps(0.5f) ) )
+OFXS_MERGE_OP( eMergeIn, A * b, _mm_mul_ps(A, b) )
+OFXS_MERGE_OP( eMergeMask, B * a, _mm_mul_ps(B, a) )
+OFXS_MERGE_OP( eMergeMatte, A * a + B * (1.f - a), _mm_add_ps( _mm_mul_ps(A, a), _mm_mul_ps( B, _mm_sub_ps(one, a) ) ) )
+// std::max(A, B) is (A < B) ? B : A, and std::min(A, B) is (B < A) ? B : A, even with NaNs
+OFXS_MERGE_OP( eMergeMax, std::max(A, B), _mm_max_ps(B, A) )
+OFXS_MERGE_OP( eMergeMin, std::min(A, B), _mm_min_ps(B, A) )
+OFXS_MERGE_OP( eMergeMinus, A - B, _mm_sub_ps(A, B) )
+OFXS_MERGE_OP( eMergeMultiply, A * B, _mm_mul_ps(A, B) )
+OFXS_MERGE_OP( eMergeOut, A * (1.f - b), _mm_mul_ps( A, _mm_sub_ps(one, b) ) )
+OFXS_MERGE_OP( eMergeOver, A + B * (1.f - a), _mm_add_ps( A, _mm_mul_ps( B, _mm_sub_ps(one, a) ) ) )
+OFXS_MERGE_OP( eMergePlus, A + B, _mm_add_ps(A, B) )
+OFXS_MERGE_OP( eMergeScreen, A + B - A * B, _mm_sub_ps( _mm_add_ps(A, B), _mm_mul_ps(A, B) ) )
+OFXS_MERGE_OP( eMergeStencil, B * (1.f - a), _mm_mul_ps( B, _mm_sub_ps(one, a) ) )
+OFXS_MERGE_OP( eMergeUnder, A * (1.f - b) + B, _mm_add_ps( _mm_mul_ps( A, _mm_sub_ps(one, b) ), B ) )
+OFXS_MERGE_OP( eMergeXOR, A * (1.f - b) + B * (1.f - a), _mm_add_ps( _mm_mul_ps( A, _mm_sub_ps(one, b) ), _mm_mul_ps( B, _mm_sub_ps(one, a) ) ) )
+
+#undef OFXS_MERGE_OP
+
+/** @brief the non-separable (HSL) merge operators, which are applied to 4 pixels at once by
+   MergeHslOp<f>::apply(A, B, R), with SIMD vectors holding the red, green, blue and alpha of the
+   4 pixels (see mergePixel() and blend_hsl_hue() in ofxsMerging.h for the formulas).
+   The computations are those of mergePixel(), in the same order so that the results are the same,
+   but without branches: the sorting of the components is replaced by min/max and comparison masks.
+   kVectorized is 0 for the other operators.
+ */
+template <MergingFunctionEnum f>
+struct MergeHslOp
+{
+    enum { kVectorized = 0 };
+};
+
+#ifdef OFXS_USE_SSE2
+/// the luminosity of the colors (r,g,b), see get_lum()
+inline __m128
+mergeHslLum(const __m128 c[3])
+{
+    return _mm_add_ps( _mm_add_ps( _mm_mul_ps( c[0], _mm_set1_ps(0.3f) ), _mm_mul_ps( c[1], _mm_set1_ps(0.59f) ) ),
+                       _mm_mul_ps( c[2], _mm_set1_ps(0.11f) ) );
+}
+
+inline __m128
+mergeHslMin(const __m128 c[3])
+{
+    return _mm_min_ps( _mm_min_ps(c[0], c[1]), c[2] );
+}
+
+inline __m128
+mergeHslMax(const __m128 c[3])
+{
+    return _mm_max_ps( _mm_max_ps(c[0], c[1]), c[2] );
+}
+
+/// mask of the lanes where v is zero or denormal, see float_is_zero()
+inline __m128
+mergeHslIsZero(__m128 v)
+{
+    return _mm_cmplt_ps( _mm_andnot_ps(_mm_set1_ps(-0.f), v), _mm_set1_ps(FLT_MIN) );
+}
+
+/// see clip_color()
+inline void
+mergeHslClipColor(__m128 c[3],
+                  __m128 a)
+{
+    const __m128 l = mergeHslLum(c);
+    const __m128 n = mergeHslMin(c);
+    const __m128 x = mergeHslMax(c);
+    // bring the negative components to 0
+    __m128 t = _mm_sub_ps(l, n);
+    const __m128 low = _mm_cmplt_ps( n, _mm_setzero_ps() );
+    __m128 flat = mergeHslIsZero(t);
+
+    for (int i = 0; i < 3; ++i) {
+        const __m128 v = _mm_add_ps( l, _mm_div_ps(_mm_mul_ps(_mm_sub_ps(c[i], l), l), t) );
+        c[i] = Simd::select( low, _mm_andnot_ps(flat, v), c[i] );
+    }
+    // bring the components above a to a
+    t = _mm_sub_ps(x, l);
+    const __m128 high = _mm_cmpgt_ps(x, a);
+    const __m128 al = _mm_sub_ps(a, l);
+    flat = mergeHslIsZero(t);
+    for (int i = 0; i < 3; ++i) {
+        const __m128 v = _mm_add_ps( l, _mm_div_ps(_mm_mul_ps(_mm_sub_ps(c[i], l), al), t) );
+        c[i] = Simd::select( high, Simd::select(flat, a, v), c[i] );
+    }
+}
+
+/// see set_lum()
+inline void
+mergeHslSetLum(__m128 c[3],
+               __m128 sa,
+               __m128 l)
+{
+    const __m128 d = _mm_sub_ps( l, mergeHslLum(c) );
+
+    for (int i = 0; i < 3; ++i) {
+        c[i] = _mm_add_ps(c[i], d);
+    }
+    mergeHslClipColor(c, sa);
+}
+
+/// see set_sat(): the maximum becomes sat, the minimum 0, and the middle component is scaled accordingly.
+/// The maximum is chosen among equal components as in set_sat().
+inline void
+mergeHslSetSat(__m128 c[3],
+               __m128 sat)
+{
+    const __m128 rg = _mm_cmpgt_ps(c[0], c[1]);
+    const __m128 rb = _mm_cmpgt_ps(c[0], c[2]);
+    const __m128 gb = _mm_cmpgt_ps(c[1], c[2]);
+    __m128 isMax[3];
+
+    isMax[0] = _mm_and_ps(rg, rb);
+    isMax[1] = _mm_andnot_ps( rg, _mm_or_ps( rb, gb ) );
+    isMax[2] = _mm_andnot_ps( _mm_or_ps(isMax[0], isMax[1]), _mm_castsi128_ps( _mm_set1_epi32(-1) ) );
+    const __m128 n = mergeHslMin(c);
+    const __m128 t = _mm_sub_ps(mergeHslMax(c), n);
+    const __m128 flat = mergeHslIsZero(t);
+
+    for (int i = 0; i < 3; ++i) {
+        // the minimum gives 0
+        const __m128 v = Simd::select( isMax[i], sat, _mm_div_ps(_mm_mul_ps(_mm_sub_ps(c[i], n), sat), t) );
+        c[i] = _mm_andnot_ps(flat, v);
+    }
+}
+
+/// see get_sat()
+inline __m128
+mergeHslSat(const __m128 c[3])
+{
+    return _mm_sub_ps( mergeHslMax(c), mergeHslMin(c) );
+}
+
+/// the colors of the 4 pixels of p, divided by their alpha (0 where the alpha is 0)
+inline void
+mergeHslUnpremult(const __m128 p[4],
+                  __m128 c[3])
+{
+    const __m128 nonZero = _mm_cmpneq_ps( p[3], _mm_setzero_ps() );
+
+    for (int i = 0; i < 3; ++i) {
+        c[i] = _mm_and_ps( nonZero, _mm_div_ps(p[i], p[3]) );
+    }
+}
+
+/// the colors of the 4 pixels of p, multiplied by s
+inline void
+mergeHslScale(const __m128 p[4],
+              __m128 s,
+              __m128 c[3])
+{
+    for (int i = 0; i < 3; ++i) {
+        c[i] = _mm_mul_ps(p[i], s);
+    }
+}
+
+template <>
+struct MergeHslOp<eMergeHue>
+{
+    enum { kVectorized = 1 };
+
+    static void apply(const __m128 A[4],
+                      const __m128 B[4],
+                      __m128 R[3])
+    {
+        __m128 src[3], dest[3];
+
+        mergeHslUnpremult(A, src);
+        mergeHslUnpremult(B, dest);
+        mergeHslScale(src, B[3], R);
+        mergeHslSetSat( R, _mm_mul_ps(mergeHslSat(dest), A[3]) );
+        mergeHslSetLum( R, _mm_mul_ps(A[3], B[3]), _mm_mul_ps(mergeHslLum(dest), A[3]) );
+    }
+};
+
+template <>
+struct MergeHslOp<eMergeSaturation>
+{
+    enum { kVectorized = 1 };
+
+    static void apply(const __m128 A[4],
+                      const __m128 B[4],
+                      __m128 R[3])
+    {
+        __m128 src[3], dest[3];
+
+        mergeHslUnpremult(A, src);
+        mergeHslUnpremult(B, dest);
+        mergeHslScale(dest, A[3], R);
+        mergeHslSetSat( R, _mm_mul_ps(mergeHslSat(src), B[3]) );
+        mergeHslSetLum( R, _mm_mul_ps(A[3], B[3]), _mm_mul_ps(mergeHslLum(dest), A[3]) );
+    }
+};
+
+template <>
+struct MergeHslOp<eMergeColor>
+{
+    enum { kVectorized = 1 };
+
+    static void apply(const __m128 A[4],
+                      const __m128 B[4],
+                      __m128 R[3])
+    {
+        __m128 src[3], dest[3];
+
+        mergeHslUnpremult(A, src);
+        mergeHslUnpremult(B, dest);
+        mergeHslScale(src, B[3], R);
+        mergeHslSetLum( R, _mm_mul_ps(A[3], B[3]), _mm_mul_ps(mergeHslLum(dest), A[3]) );
+    }
+};
+
+template <>
+struct MergeHslOp<eMergeLuminosity>
+{
+    enum { kVectorized = 1 };
+
+    static void apply(const __m128 A[4],
+                      const __m128 B[4],
+                      __m128 R[3])
+    {
+        __m128 src[3], dest[3];
+
+        mergeHslUnpremult(A, src);
+        mergeHslUnpremult(B, dest);
+        mergeHslScale(dest, A[3], R);
+        mergeHslSetLum( R, _mm_mul_ps(A[3], B[3]), _mm_mul_ps(mergeHslLum(src), B[3]) );
+    }
+};
+#endif // ifdef OFXS_USE_SSE2
+
+/** @brief load the pixels of A and B normalized to [0,1], with their alpha in [3].
+   A NULL pixel is black and transparent. Alpha images are their own alpha, and images without
+   alpha are opaque where they exist. */
+template <class PIX, int nComponents, int maxValue>
+inline void
+mergeLoadPixel(const PIX *srcPix,
+               float pix[4])
+{
+    for (int c = 0; c < 4; ++c) {
+        pix[c] = (c < nComponents && srcPix) ? (srcPix[c] / (float)maxValue) : 0.f;
+    }
+    if (nComponents == 1) {
+        pix[3] = pix[0];
+    } else if (nComponents != 4) {
+        pix[3] = srcPix ? 1.f : 0.f;
+    }
+}
+
+/** @brief SIMD row kernels for MergeProcessor. The primary template is used when there is no
+   SIMD version (kSupported is 0): the pixels are merged one by one.
+   The separable operators (see MergeOp) and the HSL operators (see MergeHslOp) have different kernels.
+ */
+template <MergingFunctionEnum f, class PIX, int nComponents, int maxValue,
+          bool supported =
+#ifdef OFXS_USE_SSE2
+              (Simd::PixelIO<PIX, maxValue>::supported != 0) && (MergeOp<f>::kVectorized != 0 || MergeHslOp<f>::kVectorized != 0)
+#else
+              false
+#endif
+          ,
+          bool hsl = MergeHslOp<f>::kVectorized != 0>
+struct MergeSimd
+{
+    enum { kSupported = 0 };
+
+    static int mergeRow(const PIX *,
+                        const PIX *,
+                        int,
+                        bool,
+                        float *)
+    {
+        return 0;
+    }
+};
+
+#ifdef OFXS_USE_SSE2
+template <MergingFunctionEnum f, class PIX, int nComponents, int maxValue>
+struct MergeSimd<f, PIX, nComponents, maxValue, true, false>
+{
+    enum { kSupported = 1 };
+
+    /** @brief merge the beginning of a row of n pixels of A and B (either may be NULL) into tmpPix, which is
+       not normalized (within [0,maxValue]), and return the number of pixels done. tmpPix may be srcPixB. */
+    static int mergeRow(const PIX *srcPixA,
+                        const PIX *srcPixB,
+                        int n,
+                        bool alphaMasking,
+                        float *tmpPix)
+    {
+        typedef Simd::PixelIO<PIX, maxValue> IO;
+        const __m128 zero = _mm_setzero_ps();
+        // divide then multiply, like mergeLoadPixel(), to get exactly the same results
+        const __m128 vmax = _mm_set1_ps( (float)maxValue );
+
+        if (nComponents == 4) {
+            alphaMasking = alphaMasking && isMaskable(f);
+            for (int i = 0; i < n; ++i) {
+                __m128 A = srcPixA ? _mm_div_ps(IO::load4(srcPixA + 4 * i), vmax) : zero;
+                __m128 B = srcPixB ? _mm_div_ps(IO::load4(srcPixB + 4 * i), vmax) : zero;
+                __m128 a = Simd::splatAlpha(A);
+                __m128 b = Simd::splatAlpha(B);
+                __m128 r = MergeOp<f>::apply(A, B, a, b);
+                if (alphaMasking) {
+                    // the output alpha is a+b-ab
+                    r = Simd::setAlpha( r, _mm_sub_ps( _mm_add_ps(a, b), _mm_mul_ps(a, b) ) );
+                }
+                _mm_storeu_ps( tmpPix + 4 * i, _mm_mul_ps(r, vmax) );
+            }
+
+            return n;
+        }
+
+        // without alpha, the row is a flat array of values. The alpha is the value itself
+        // for Alpha images, else it is 1 where the image exists
+        // stop on a pixel boundary, so that the scalar tail never reads a pixel that was partly written
+        const int count = n * nComponents - (n * nComponents) % (4 * nComponents);
+        const __m128 a = _mm_set1_ps(srcPixA ? 1.f : 0.f);
+        const __m128 b = _mm_set1_ps(srcPixB ? 1.f : 0.f);
+        int i = 0;
+        for (; i < count; i += 4) {
+            __m128 A = srcPixA ? _mm_div_ps(IO::load4(srcPixA + i), vmax) : zero;
+            __m128 B = srcPixB ? _mm_div_ps(IO::load4(srcPixB + i), vmax) : zero;
+            __m128 r = (nComponents == 1) ? MergeOp<f>::apply(A, B, A, B) : MergeOp<f>::apply(A, B, a, b);
+            _mm_storeu_ps( tmpPix + i, _mm_mul_ps(r, vmax) );
+        }
+
+        return i / nComponents;
+    }
+};
+
+template <MergingFunctionEnum f, class PIX, int nComponents, int maxValue>
+struct MergeSimd<f, PIX, nComponents, maxValue, true, true>
+{
+    enum { kSupported = 1 };
+
+    /** @brief merge a row of n pixels of A and B (either may be NULL) into tmpPix with a non-separable
+       operator, 4 pixels at a time, and return the number of pixels done (all of them, except for Alpha
+       images and two-component images, which are left to mergePixel()).
+       The output alpha is always a+b-ab. tmpPix may be srcPixB. */
+    static int mergeRow(const PIX *srcPixA,
+                        const PIX *srcPixB,
+                        int n,
+                        bool /*alphaMasking*/,
+                        float *tmpPix)
+    {
+        if ( (nComponents != 3) && (nComponents != 4) ) {
+            return 0;
+        }
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 vmax = _mm_set1_ps( (float)maxValue );
+
+        // the last group is padded with transparent pixels, so that all the pixels of the row
+        // get exactly the same computations
+        for (int i = 0; i < n; i += 4) {
+            const int count = std::min(4, n - i);
+            __m128 A[4], B[4];
+            for (int j = 0; j < 4; ++j) {
+                A[j] = (srcPixA && j < count) ? _mm_div_ps(Simd::loadPixel<PIX, maxValue, nComponents>( srcPixA + (i + j) * nComponents ), vmax) : zero;
+                B[j] = (srcPixB && j < count) ? _mm_div_ps(Simd::loadPixel<PIX, maxValue, nComponents>( srcPixB + (i + j) * nComponents ), vmax) : zero;
+            }
+            _MM_TRANSPOSE4_PS(A[0], A[1], A[2], A[3]);
+            _MM_TRANSPOSE4_PS(B[0], B[1], B[2], B[3]);
+            if (nComponents != 4) {
+                // opaque where the image exists
+                A[3] = srcPixA ? one : zero;
+                B[3] = srcPixB ? one : zero;
+            }
+            __m128 R[4];
+            MergeHslOp<f>::apply(A, B, R);
+            for (int c = 0; c < 3; ++c) {
+                R[c] = _mm_add_ps( _mm_add_ps( _mm_mul_ps(_mm_sub_ps(one, A[3]), B[c]), _mm_mul_ps(_mm_sub_ps(one, B[3]), A[c]) ), R[c] );
+            }
+            R[3] = _mm_sub_ps( _mm_add_ps(A[3], B[3]), _mm_mul_ps(A[3], B[3]) );
+            _MM_TRANSPOSE4_PS(R[0], R[1], R[2], R[3]);
+            for (int j = 0; j < count; ++j) {
+                Simd::storePixel<float, 1, nComponents>( tmpPix + (i + j) * nComponents, _mm_mul_ps(R[j], vmax) );
+            }
+        }
+
+        return n;
+    }
+};
+#endif // ifdef OFXS_USE_SSE2
+
+/** @brief merge the pixels of A and B (either may be NULL) into tmpPix, which is not normalized (within [0,maxValue]).
+   The operators for which MergeOp is vectorized are computed in single precision, the others by mergePixel(). */
+template <MergingFunctionEnum f, class PIX, int nComponents, int maxValue, bool vectorized>
+struct MergeScalar
+{
+    static void mergePixels(const PIX *srcPixA,
+                            const PIX *srcPixB,
+                            int n,
+                            bool alphaMasking,
+                            float *tmpPix)
+    {
+        for (int i = 0; i < n; ++i, tmpPix += nComponents) {
+            float A[4], B[4], res[4];
+            mergeLoadPixel<PIX, nComponents, maxValue>(srcPixA ? srcPixA + i * nComponents : 0, A);
+            mergeLoadPixel<PIX, nComponents, maxValue>(srcPixB ? srcPixB + i * nComponents : 0, B);
+            mergePixel<f, float, nComponents, 1>(alphaMasking, A, B, res);
+            for (int c = 0; c < nComponents; ++c) {
+                tmpPix[c] = res[c] * maxValue;
+            }
+        }
+    }
+};
+
+template <MergingFunctionEnum f, class PIX, int nComponents, int maxValue>
+struct MergeScalar<f, PIX, nComponents, maxValue, true>
+{
+    static void mergePixels(const PIX *srcPixA,
+                            const PIX *srcPixB,
+                            int n,
+                            bool alphaMasking,
+                            float *tmpPix)
+    {
+        alphaMasking = alphaMasking && isMaskable(f) && (nComponents == 4);
+        for (int i = 0; i < n; ++i, tmpPix += nComponents) {
+            float A[4], B[4];
+            mergeLoadPixel<PIX, nComponents, maxValue>(srcPixA ? srcPixA + i * nComponents : 0, A);
+            mergeLoadPixel<PIX, nComponents, maxValue>(srcPixB ? srcPixB + i * nComponents : 0, B);
+            for (int c = 0; c < nComponents; ++c) {
+                float r = MergeOp<f>::apply(A[c], B[c], A[3], B[3]);
+                if ( alphaMasking && (c == 3) ) {
+                    r = A[3] + B[3] - A[3] * B[3];
+                }
+                tmpPix[c] = r * maxValue;
+            }
+        }
+    }
+};
+
+/** @brief coverage of a pixel of A or B (see mergeAlphaKind()) */
+enum MergeAlphaEnum
+{
+    eMergeAlphaZero = 0, ///< all components are 0 (or the image does not exist)
+    eMergeAlphaOne,      ///< alpha is 1
+    eMergeAlphaPartial,  ///< anything else
+};
+
+/** @brief what an operator reduces to, given the coverage of A and B (see MergeCoverage) */
+enum MergeCoverageEnum
+{
+    eMergeCoverageCompute = 0, ///< the operator has to be computed
+    eMergeCoverageCopyA,       ///< the result is A
+    eMergeCoverageCopyB,       ///< the result is B
+    eMergeCoverageZero,        ///< the result is black and transparent
+};
+
+/** @brief the shortcuts of the Porter-Duff operators: get(a, b) tells what the operator reduces to
+   when the coverages of A and B are a and b. kHasShortcuts is 0 for the other operators, which are
+   always computed. The shortcuts give the same result as MergeOp<f>::apply() on finite values.
+ */
+template <MergingFunctionEnum f>
+struct MergeCoverage
+{
+    enum { kHasShortcuts = 0 };
+
+    static MergeCoverageEnum get(MergeAlphaEnum,
+                                 MergeAlphaEnum)
+    {
+        return eMergeCoverageCompute;
+    }
+};
+
+// A*b + B*(1-a)
+template <>
+struct MergeCoverage<eMergeATop>
+{
+    enum { kHasShortcuts = 1 };
+
+    static MergeCoverageEnum get(MergeAlphaEnum a,
+                                 MergeAlphaEnum b)
+    {
+        if (a == eMergeAlphaZero) {
+            return eMergeCoverageCopyB;
+        } else if (b == eMergeAlphaZero) {
+            return eMergeCoverageZero;
+        } else if ( (a == eMergeAlphaOne) && (b == eMergeAlphaOne) ) {
+            return eMergeCoverageCopyA;
+        }
+
+        return eMergeCoverageCompute;
+    }
+};
+
+// A*b
+template <>
+struct MergeCoverage<eMergeIn>
+{
+    enum { kHasShortcuts = 1 };
+
+    static MergeCoverageEnum get(MergeAlphaEnum a,
+                                 MergeAlphaEnum b)
+    {
+        if ( (a == eMergeAlphaZero) || (b == eMergeAlphaZero) ) {
+            return eMergeCoverageZero;
+        } else if (b == eMergeAlphaOne) {
+            return eMergeCoverageCopyA;
+        }
+
+        return eMergeCoverageCompute;
+    }
+};
+
+// B*a
+template <>
+struct MergeCoverage<eMergeMask>
+{
+    enum { kHasShortcuts = 1 };
+
+    static MergeCoverageEnum get(MergeAlphaEnum a,
+                                 MergeAlphaEnum b)
+    {
+        if ( (a == eMergeAlphaZero) || (b == eMergeAlphaZero) ) {
+            return eMergeCoverageZero;
+        } else if (a == eMergeAlphaOne) {
+            return eMergeCoverageCopyB;
+        }
+
+        return eMergeCoverageCompute;
+    }
+};
+
+// A*(1-b)
+template <>
+struct MergeCoverage<eMergeOut>
+{
+    enum { kHasShortcuts = 1 };
+
+    static MergeCoverageEnum get(MergeAlphaEnum a,
+                                 MergeAlphaEnum b)
+    {
+        if ( (a == eMergeAlphaZero) || (b == eMergeAlphaOne) ) {
+            return eMergeCoverageZero;
+        } else if (b == eMergeAlphaZero) {
+            return eMergeCoverageCopyA;
+        }
+
+        return eMergeCoverageCompute;
+    }
+};
+
+// A + B*(1-a)
+template <>
+struct MergeCoverage<eMergeOver>
+{
+    enum { kHasShortcuts = 1 };
+
+    static MergeCoverageEnum get(MergeAlphaEnum a,
+                                 MergeAlphaEnum b)
+    {
+        if (a == eMergeAlphaOne) {
+            return eMergeCoverageCopyA;
+        } else if (a == eMergeAlphaZero) {
+            return eMergeCoverageCopyB;
+        } else if (b == eMergeAlphaZero) {
+            return eMergeCoverageCopyA;
+        }
+
+        return eMergeCoverageCompute;
+    }
+};
+
+// B*(1-a)
+template <>
+struct MergeCoverage<eMergeStencil>
+{
+    enum { kHasShortcuts = 1 };
+
+    static MergeCoverageEnum get(MergeAlphaEnum a,
+                                 MergeAlphaEnum b)
+    {
+        if ( (a == eMergeAlphaOne) || (b == eMergeAlphaZero) ) {
+            return eMergeCoverageZero;
+        } else if (a == eMergeAlphaZero) {
+            return eMergeCoverageCopyB;
+        }
+
+        return eMergeCoverageCompute;
+    }
+};
+
+// A*(1-b) + B
+template <>
+struct MergeCoverage<eMergeUnder>
+{
+    enum { kHasShortcuts = 1 };
+
+    static MergeCoverageEnum get(MergeAlphaEnum a,
+                                 MergeAlphaEnum b)
+    {
+        if (b == eMergeAlphaOne) {
+            return eMergeCoverageCopyB;
+        } else if (b == eMergeAlphaZero) {
+            return eMergeCoverageCopyA;
+        } else if (a == eMergeAlphaZero) {
+            return eMergeCoverageCopyB;
+        }
+
+        return eMergeCoverageCompute;
+    }
+};
+
+/** @brief get the coverage of a pixel of A or B (srcPix may be NULL), with the alphas of mergeLoadPixel() */
+template <class PIX, int nComponents, int maxValue>
+inline MergeAlphaEnum
+mergeAlphaKind(const PIX *srcPix)
+{
+    if (!srcPix) {
+        return eMergeAlphaZero;
+    }
+    if ( (nComponents != 1) && (nComponents != 4) ) {
+        // images without alpha are opaque
+        return eMergeAlphaOne;
+    }
+    if ( srcPix[nComponents - 1] == PIX(maxValue) ) {
+        return eMergeAlphaOne;
+    }
+    for (int c = 0; c < nComponents; ++c) {
+        if ( !(srcPix[c] == PIX(0)) ) {
+            return eMergeAlphaPartial;
+        }
+    }
+
+    return eMergeAlphaZero;
+}
+
+/** @brief get the length of the run of pixels of A and B (either may be NULL) that starts at the first pixel
+   (n > 0), on which the operator reduces to the same shortcut, or has to be computed.
+
+   As in ofxsMaskRun(), runs to compute absorb shortcut runs shorter than kMergeRunMinLength.
+ */
+template <MergingFunctionEnum f, class PIX, int nComponents, int maxValue>
+int
+mergeCoverageRun(const PIX *srcPixA,
+                 const PIX *srcPixB,
+                 int n,
+                 MergeCoverageEnum *kind)
+{
+    const int kMergeRunMinLength = 16;
+
+    assert(n > 0);
+    if (!srcPixA && !srcPixB && MergeCoverage<f>::kHasShortcuts) {
+        // everything is black and transparent. Only the Porter-Duff operators are known to give black
+        // on two black pixels: the others (e.g. grain extract) are computed
+        *kind = eMergeCoverageZero;
+
+        return n;
+    }
+    if ( !MergeCoverage<f>::kHasShortcuts || ( (nComponents != 1) && (nComponents != 4) ) ) {
+        // without alpha, the coverage is the same on the whole interval
+        *kind = MergeCoverage<f>::get( srcPixA ? eMergeAlphaOne : eMergeAlphaZero, srcPixB ? eMergeAlphaOne : eMergeAlphaZero );
+
+        return n;
+    }
+
+#define OFXS_MERGE_COVERAGE(i) MergeCoverage<f>::get( mergeAlphaKind<PIX, nComponents, maxValue>(srcPixA ? srcPixA + (i) * nComponents : 0), \
+                                                      mergeAlphaKind<PIX, nComponents, maxValue>(srcPixB ? srcPixB + (i) * nComponents : 0) )
+    const MergeCoverageEnum first = OFXS_MERGE_COVERAGE(0);
+    int i = 1;
+    if (first != eMergeCoverageCompute) {
+        while ( i < n && OFXS_MERGE_COVERAGE(i) == first ) {
+            ++i;
+        }
+        *kind = first;
+
+        return i;
+    }
+    while (i < n) {
+        const MergeCoverageEnum k = OFXS_MERGE_COVERAGE(i);
+        if (k == eMergeCoverageCompute) {
+            ++i;
+            continue;
+        }
+        // a shortcut run: stop here if it is long enough
+        int j = i + 1;
+        while ( j < n && j - i < kMergeRunMinLength && OFXS_MERGE_COVERAGE(j) == k ) {
+            ++j;
+        }
+        if (j - i >= kMergeRunMinLength) {
+            break;
+        }
+        i = j;
+    }
+#undef OFXS_MERGE_COVERAGE
+    *kind = eMergeCoverageCompute;
+
+    return i;
+} // mergeCoverageRun
+
+/** @brief is the operator computed from 8-bit tables on unsigned char images (see MergeTableManager)?
+
+   These are the separable operators that only depend on the component values of A and B (not on
+   their alphas), and that are not vectorized because they need double precision, divides, square
+   roots or branches.
+ */
+inline bool
+isTabulated(MergingFunctionEnum operation)
+{
+    switch (operation) {
+    case eMergeColorBurn:
+    case eMergeColorDodge:
+    case eMergeDivide:
+    case eMergeFreeze:
+    case eMergeGeometric:
+    case eMergeHardLight:
+    case eMergeHypot:
+    case eMergeOverlay:
+    case eMergePinLight:
+    case eMergeReflect:
+    case eMergeSoftLight:
+
+        return true;
+    default:
+
+        return false;
+    }
+}
+
+/** @brief the results of an operator on all pairs of 8-bit values: values[(A << 8) | B] is what
+   MergeProcessor would store for the component values A and B */
+struct MergeTable8
+{
+    unsigned char values[0x10000];
+};
+
+/** @brief A singleton that holds the 8-bit tables of the tabulated operators (see isTabulated()).
+
+   A table is built on first use and kept until the end of the program. Unlike LutManager::getLut(),
+   this is thread-safe without a lock: the table is published atomically, and if several threads
+   build the same table at the same time, all but one of them are discarded.
+ */
+class MergeTableManager
+{
+    template <int id>
+    struct Slot
+    {
+        static MergeTable8* volatile table;
+    };
+
+    enum { kAlphaMaskingSlot = -1 };
+
+public:
+    /** @brief get the table of the tabulated operator f */
+    template <MergingFunctionEnum f>
+    static const MergeTable8* getTable8()
+    {
+        assert( isTabulated(f) );
+        MergeTable8* table = OFX::Atomic::loadPointerAcquire(&Slot<f>::table);
+        if (table) {
+            return table;
+        }
+        table = new MergeTable8;
+        for (int A = 0; A < 256; ++A) {
+            for (int B = 0; B < 256; ++B) {
+                // compute it exactly as MergeScalar does
+                float a[4] = { A / 255.f, 0.f, 0.f, A / 255.f };
+                float b[4] = { B / 255.f, 0.f, 0.f, B / 255.f };
+                float res[4];
+                mergePixel<f, float, 1, 1>(false, a, b, res);
+                table->values[(A << 8) | B] = ofxsClampIfInt<unsigned char, 255>(res[0] * 255, 0, 255);
+            }
+        }
+
+        return publish(&Slot<f>::table, table);
+    }
+
+    /** @brief get the table of the alpha of the maskable operators when alpha masking is on:
+       a+b-ab, computed as in mergePixel() */
+    static const MergeTable8* getAlphaMaskingTable8()
+    {
+        MergeTable8* table = OFX::Atomic::loadPointerAcquire(&Slot<kAlphaMaskingSlot>::table);
+        if (table) {
+            return table;
+        }
+        table = new MergeTable8;
+        for (int A = 0; A < 256; ++A) {
+            for (int B = 0; B < 256; ++B) {
+                const float a = A / 255.f;
+                const float b = B / 255.f;
+                const float alpha = float(a + b - a * b / (double)1);
+                table->values[(A << 8) | B] = ofxsClampIfInt<unsigned char, 255>(alpha * 255, 0, 255);
+            }
+        }
+
+        return publish(&Slot<kAlphaMaskingSlot>::table, table);
+    }
+
+private:
+    static const MergeTable8* publish(MergeTable8* volatile* slot,
+                                      MergeTable8* table)
+    {
+        if ( !OFX::Atomic::compareAndSwapPointer(slot, (MergeTable8*)0, table) ) {
+            // another thread was faster
+            delete table;
+            table = OFX::Atomic::loadPointerAcquire(slot);
+        }
+
+        return table;
+    }
+};
+
+template <int id>
+MergeTable8* volatile MergeTableManager::Slot<id>::table = 0;
+
+/** @brief row kernel for the tabulated operators: the primary template is used for images that are
+   not 8-bit (kSupported is 0) */
+template <class PIX, int nComponents, int maxValue>
+struct MergeTableRow
+{
+    enum { kSupported = 0 };
+
+    static void mergeRow(const MergeTable8 *,
+                         const MergeTable8 *,
+                         const PIX *,
+                         const PIX *,
+                         int,
+                         PIX *)
+    {
+    }
+};
+
+template <int nComponents>
+struct MergeTableRow<unsigned char, nComponents, 255>
+{
+    enum { kSupported = 1 };
+
+    /** @brief merge n pixels of A and B (either or both may be NULL) into dstPix, with table for the color
+       components and alphaTable for alpha (which is only used by RGBA images) */
+    static void mergeRow(const MergeTable8 *table,
+                         const MergeTable8 *alphaTable,
+                         const unsigned char *srcPixA,
+                         const unsigned char *srcPixB,
+                         int n,
+                         unsigned char *dstPix)
+    {
+        const int count = n * nComponents;
+
+        if (srcPixA && srcPixB) {
+            for (int i = 0; i < count; i += nComponents) {
+                for (int c = 0; c < nComponents; ++c) {
+                    const unsigned char *values = (nComponents == 4 && c == 3) ? alphaTable->values : table->values;
+                    dstPix[i + c] = values[(srcPixA[i + c] << 8) | srcPixB[i + c]];
+                }
+            }
+        } else if (!srcPixA && !srcPixB) {
+            // both are black and transparent: the result is the first entry of the tables
+            for (int i = 0; i < count; i += nComponents) {
+                for (int c = 0; c < nComponents; ++c) {
+                    dstPix[i + c] = (nComponents == 4 && c == 3) ? alphaTable->values[0] : table->values[0];
+                }
+            }
+        } else {
+            // one of them is black and transparent: use a single row of the tables
+            const unsigned char *pix = srcPixA ? srcPixA : srcPixB;
+            const int stride = srcPixA ? 256 : 1;
+            const unsigned char *row = table->values;
+            const unsigned char *alphaRow = alphaTable->values;
+            for (int i = 0; i < count; i += nComponents) {
+                for (int c = 0; c < nComponents; ++c) {
+                    const unsigned char *values = (nComponents == 4 && c == 3) ? alphaRow : row;
+                    dstPix[i + c] = values[pix[i + c] * stride];
+                }
+            }
+        }
+    }
+};
+
+/** @brief base class of MergeProcessor */
+class MergeProcessorBase
+    : public OFX::PixelProcessor
+{
+protected:
+    const OFX::Image *_srcImgA;
+    const OFX::Image *_srcImgB;
+    const OFX::Image *_maskImg;
+    bool _doMasking;
+    bool _alphaMasking;
+    float _mix;
+    bool _maskInvert;
+
+public:
+    MergeProcessorBase(OFX::ImageEffect &instance)
+        : OFX::PixelProcessor(instance)
+        , _srcImgA(0)
+        , _srcImgB(0)
+        , _maskImg(0)
+        , _doMasking(false)
+        , _alphaMasking(false)
+        , _mix(1.f)
+        , _maskInvert(false)
+    {
+    }
+
+    /** @brief set the A and B images (either may be NULL). B is also the background for masking and mixing. */
+    void setSrcImg(const OFX::Image *A,
+                   const OFX::Image *B)
+    {
+        _srcImgA = A;
+        _srcImgB = B;
+    }
+
+    void setMaskImg(const OFX::Image *v,
+                    bool maskInvert)
+    {
+        _maskImg = v;
+        _maskInvert = maskInvert;
+    }
+
+    void doMasking(bool v)
+    {
+        _doMasking = v;
+    }
+
+    /** @brief set the alpha masking (see mergePixel()) and the mix factor */
+    void setValues(bool alphaMasking,
+                   double mix)
+    {
+        _alphaMasking = alphaMasking;
+        _mix = (float)mix;
+    }
+};
+
+/** @brief A processor that merges A over B with the operator f, then masks and mixes the result
+   with B (see ofxsMaskMixRow()).
+
+   This is the same as calling mergePixel() on each pixel, with A and B normalized to [0,1], black and
+   transparent outside of their bounds. Images without alpha are opaque where they exist, Alpha images
+   are their own alpha. The operator is a template parameter, so that each operator gets its own row
+   kernel: use createMergeProcessor() or mergeImages() to select it once per render.
+
+   The rows are processed by chunks, split where A or B start or end. Separable operators that can be
+   computed in single precision (see MergeOp) are vectorized. The Porter-Duff operators (over, under,
+   in, out, atop, stencil, mask) are split further into runs where the alpha of A or B is 0 or 1, on
+   which they reduce to a copy of A or B, or to black (see MergeCoverage): compositing sparse elements
+   over a plate is then mostly a copy. On 8-bit images, the operators that are not vectorized but only
+   depend on the component values (see isTabulated()) are read from 256x256 tables when the result is
+   neither masked nor mixed.
+ */
+template <MergingFunctionEnum f, class PIX, int nComponents, int maxValue>
+class MergeProcessor
+    : public MergeProcessorBase
+{
+public:
+    enum { kChunkSize = 256 };
+
+    MergeProcessor(OFX::ImageEffect &instance)
+        : MergeProcessorBase(instance)
+        , _table8(0)
+        , _alphaTable8(0)
+    {
+    }
+
+    /** @brief get the 8-bit tables, if the operator is tabulated and the result is neither masked nor mixed */
+    void preProcess()
+    {
+        _table8 = _alphaTable8 = 0;
+        if ( MergeTableRow<PIX, nComponents, maxValue>::kSupported && isTabulated(f) && !_doMasking && (_mix == 1.f) ) {
+            _table8 = MergeTableManager::getTable8<f>();
+            _alphaTable8 = (nComponents == 4 && _alphaMasking && isMaskable(f)) ? MergeTableManager::getAlphaMaskingTable8() : _table8;
+        }
+    }
+
+    void multiThreadProcessImages(OfxRectI procWindow)
+    {
+        float tmpRow[kChunkSize * nComponents];
+        // without masking and mixing, the runs that are copies of A or B (or black) go straight to the destination
+        const bool direct = !_doMasking && (_mix == 1.f);
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) getDstPixelAddress(procWindow.x1, y);
+            assert(dstPix);
+
+            for (int x1 = procWindow.x1; x1 < procWindow.x2; x1 += kChunkSize) {
+                const int x2 = std::min(x1 + kChunkSize, procWindow.x2);
+                mergeRow(x1, x2, y, direct, tmpRow, dstPix);
+                if (!direct) {
+                    ofxsMaskMixRow<PIX, nComponents, maxValue, true>(tmpRow, x1, x2, y, _srcImgB, _doMasking, _maskImg, _mix, _maskInvert, dstPix);
+                }
+                dstPix += (x2 - x1) * nComponents;
+            }
+        }
+    }
+
+private:
+    /** @brief merge the pixels [x1,x2) of row y into tmpRow, by intervals where A and B exist or not, and by
+       runs on which the operator reduces to a copy of A or B or to black (see mergeCoverageRun()).
+       If direct is true, the result is stored to dstPix, and the runs that are copies are not even
+       converted to float. */
+    void mergeRow(int x1,
+                  int x2,
+                  int y,
+                  bool direct,
+                  float *tmpRow,
+                  PIX *dstPix) const
+    {
+        OFX::PixelRowSegment segA, segB;
+
+        for (int x = x1; x < x2; x = segB.x2) {
+            OFX::getPixelRowSegment(_srcImgA, 0, x, y, x2, &segA);
+            OFX::getPixelRowSegment(_srcImgB, 0, x, y, segA.x2, &segB);
+            const PIX *srcPixA = (const PIX *)segA.pix;
+            const PIX *srcPixB = (const PIX *)segB.pix;
+            const int n = segB.x2 - x;
+            for (int i = 0; i < n;) {
+                const PIX *pixA = srcPixA ? srcPixA + i * nComponents : 0;
+                const PIX *pixB = srcPixB ? srcPixB + i * nComponents : 0;
+                MergeCoverageEnum kind;
+                const int len = mergeCoverageRun<f, PIX, nComponents, maxValue>(pixA, pixB, n - i, &kind);
+                const int off = (x - x1 + i) * nComponents;
+                const int count = len * nComponents;
+                if ( (kind == eMergeCoverageCompute) && direct && _table8 ) {
+                    MergeTableRow<PIX, nComponents, maxValue>::mergeRow(_table8, _alphaTable8, pixA, pixB, len, dstPix + off);
+                } else if (kind == eMergeCoverageCompute) {
+                    mergePixels(pixA, pixB, len, tmpRow + off);
+                    if (direct) {
+                        ofxsMaskMixConstantRow<PIX, nComponents, maxValue>(tmpRow + off, len, 0, 1.f, dstPix + off);
+                    }
+                } else {
+                    const PIX *copyPix = (kind == eMergeCoverageCopyA) ? pixA : ( (kind == eMergeCoverageCopyB) ? pixB : 0 );
+                    if (direct && copyPix) {
+                        std::memcpy( dstPix + off, copyPix, count * sizeof(PIX) );
+                    } else if (direct) {
+                        std::fill( dstPix + off, dstPix + off + count, PIX(0) );
+                    } else if (copyPix) {
+                        std::copy(copyPix, copyPix + count, tmpRow + off);
+                    } else {
+                        std::fill(tmpRow + off, tmpRow + off + count, 0.f);
+                    }
+                }
+                i += len;
+            }
+        }
+    }
+
+    /** @brief merge n pixels of A and B (either may be NULL) into tmpPix */
+    void mergePixels(const PIX *srcPixA,
+                     const PIX *srcPixB,
+                     int n,
+                     float *tmpPix) const
+    {
+        typedef MergeSimd<f, PIX, nComponents, maxValue> Kernel;
+        typedef MergeScalar<f, PIX, nComponents, maxValue, MergeOp<f>::kVectorized != 0> Scalar;
+        int i = Kernel::kSupported ? Kernel::mergeRow(srcPixA, srcPixB, n, _alphaMasking, tmpPix) : 0;
+
+        Scalar::mergePixels(srcPixA ? srcPixA + i * nComponents : 0,
+                            srcPixB ? srcPixB + i * nComponents : 0,
+                            n - i, _alphaMasking, tmpPix + i * nComponents);
+    }
+
+    const MergeTable8 *_table8;
+    const MergeTable8 *_alphaTable8;
+};
+
+/** @brief create the MergeProcessor for operation. The caller owns the result. */
+template <class PIX, int nComponents, int maxValue>
+MergeProcessorBase*
+createMergeProcessor(OFX::ImageEffect &instance,
+                     MergingFunctionEnum operation)
+{
+    switch (operation) {
+    case eMergeATop:
+        return new MergeProcessor<eMergeATop, PIX, nComponents, maxValue>(instance);
+
+    case eMergeAverage:
+        return new MergeProcessor<eMergeAverage, PIX, nComponents, maxValue>(instance);
+
+    case eMergeColor:
+        return new MergeProcessor<eMergeColor, PIX, nComponents, maxValue>(instance);
+
+    case eMergeColorBurn:
+        return new MergeProcessor<eMergeColorBurn, PIX, nComponents, maxValue>(instance);
+
+    case eMergeColorDodge:
+        return new MergeProcessor<eMergeColorDodge, PIX, nComponents, maxValue>(instance);
+
+    case eMergeConjointOver:
+        return new MergeProcessor<eMergeConjointOver, PIX, nComponents, maxValue>(instance);
+
+    case eMergeCopy:
+        return new MergeProcessor<eMergeCopy, PIX, nComponents, maxValue>(instance);
+
+    case eMergeDifference:
+        return new MergeProcessor<eMergeDifference, PIX, nComponents, maxValue>(instance);
+
+    case eMergeDisjointOver:
+        return new MergeProcessor<eMergeDisjointOver, PIX, nComponents, maxValue>(instance);
+
+    case eMergeDivide:
+        return new MergeProcessor<eMergeDivide, PIX, nComponents, maxValue>(instance);
+
+    case eMergeExclusion:
+        return new MergeProcessor<eMergeExclusion, PIX, nComponents, maxValue>(instance);
+
+    case eMergeFreeze:
+        return new MergeProcessor<eMergeFreeze, PIX, nComponents, maxValue>(instance);
+
+    case eMergeFrom:
+        return new MergeProcessor<eMergeFrom, PIX, nComponents, maxValue>(instance);
+
+    case eMergeGeometric:
+        return new MergeProcessor<eMergeGeometric, PIX, nComponents, maxValue>(instance);
+
+    case eMergeGrainExtract:
+        return new MergeProcessor<eMergeGrainExtract, PIX, nComponents, maxValue>(instance);
+
+    case eMergeGrainMerge:
+        return new MergeProcessor<eMergeGrainMerge, PIX, nComponents, maxValue>(instance);
+
+    case eMergeHardLight:
+        return new MergeProcessor<eMergeHardLight, PIX, nComponents, maxValue>(instance);
+
+    case eMergeHue:
+        return new MergeProcessor<eMergeHue, PIX, nComponents, maxValue>(instance);
+
+    case eMergeHypot:
+        return new MergeProcessor<eMergeHypot, PIX, nComponents, maxValue>(instance);
+
+    case eMergeIn:
+        return new MergeProcessor<eMergeIn, PIX, nComponents, maxValue>(instance);
+
+    case eMergeLuminosity:
+        return new MergeProcessor<eMergeLuminosity, PIX, nComponents, maxValue>(instance);
+
+    case eMergeMask:
+        return new MergeProcessor<eMergeMask, PIX, nComponents, maxValue>(instance);
+
+    case eMergeMatte:
+        return new MergeProcessor<eMergeMatte, PIX, nComponents, maxValue>(instance);
+
+    case eMergeMax:
+        return new MergeProcessor<eMergeMax, PIX, nComponents, maxValue>(instance);
+
+    case eMergeMin:
+        return new MergeProcessor<eMergeMin, PIX, nComponents, maxValue>(instance);
+
+    case eMergeMinus:
+        return new MergeProcessor<eMergeMinus, PIX, nComponents, maxValue>(instance);
+
+    case eMergeMultiply:
+        return new MergeProcessor<eMergeMultiply, PIX, nComponents, maxValue>(instance);
+
+    case eMergeOut:
+        return new MergeProcessor<eMergeOut, PIX, nComponents, maxValue>(instance);
+
+    case eMergeOver:
+        return new MergeProcessor<eMergeOver, PIX, nComponents, maxValue>(instance);
+
+    case eMergeOverlay:
+        return new MergeProcessor<eMergeOverlay, PIX, nComponents, maxValue>(instance);
+
+    case eMergePinLight:
+        return new MergeProcessor<eMergePinLight, PIX, nComponents, maxValue>(instance);
+
+    case eMergePlus:
+        return new MergeProcessor<eMergePlus, PIX, nComponents, maxValue>(instance);
+
+    case eMergeReflect:
+        return new MergeProcessor<eMergeReflect, PIX, nComponents, maxValue>(instance);
+
+    case eMergeSaturation:
+        return new MergeProcessor<eMergeSaturation, PIX, nComponents, maxValue>(instance);
+
+    case eMergeScreen:
+        return new MergeProcessor<eMergeScreen, PIX, nComponents, maxValue>(instance);
+
+    case eMergeSoftLight:
+        return new MergeProcessor<eMergeSoftLight, PIX, nComponents, maxValue>(instance);
+
+    case eMergeStencil:
+        return new MergeProcessor<eMergeStencil, PIX, nComponents, maxValue>(instance);
+
+    case eMergeUnder:
+        return new MergeProcessor<eMergeUnder, PIX, nComponents, maxValue>(instance);
+
+    case eMergeXOR:
+        return new MergeProcessor<eMergeXOR, PIX, nComponents, maxValue>(instance);
+    } // switch
+
+    return 0;
+} // createMergeProcessor
+
+template <class PIX, int nComponents, int maxValue>
+void
+mergeImagesForDepthAndComponents(OFX::ImageEffect &instance,
+                                 MergingFunctionEnum operation,
+                                 const OfxRectI & renderWindow,
+                                 const OFX::Image *srcImgA,
+                                 const OFX::Image *srcImgB,
+                                 OFX::Image *dstImg,
+                                 bool alphaMasking,
+                                 double mix,
+                                 bool doMasking,
+                                 const OFX::Image *maskImg,
+                                 bool maskInvert)
+{
+    std::auto_ptr<MergeProcessorBase> processor( createMergeProcessor<PIX, nComponents, maxValue>(instance, operation) );
+
+    if ( !processor.get() ) {
+        OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
+
+        return;
+    }
+    processor->setDstImg(dstImg);
+    processor->setSrcImg(srcImgA, srcImgB);
+    processor->setMaskImg(maskImg, maskInvert);
+    processor->doMasking(doMasking);
+    processor->setValues(alphaMasking, mix);
+    processor->setRenderWindow(renderWindow);
+    processor->process();
+}
+
+template <class PIX, int maxValue>
+void
+mergeImagesForDepth(OFX::ImageEffect &instance,
+                    MergingFunctionEnum operation,
+                    const OfxRectI & renderWindow,
+                    const OFX::Image *srcImgA,
+                    const OFX::Image *srcImgB,
+                    OFX::Image *dstImg,
+                    bool alphaMasking,
+                    double mix,
+                    bool doMasking,
+                    const OFX::Image *maskImg,
+                    bool maskInvert)
+{
+    switch ( dstImg->getPixelComponentCount() ) {
+    case 4:
+        mergeImagesForDepthAndComponents<PIX, 4, maxValue>(instance, operation, renderWindow, srcImgA, srcImgB, dstImg, alphaMasking, mix, doMasking, maskImg, maskInvert);
+        break;
+
+    case 3:
+        mergeImagesForDepthAndComponents<PIX, 3, maxValue>(instance, operation, renderWindow, srcImgA, srcImgB, dstImg, alphaMasking, mix, doMasking, maskImg, maskInvert);
+        break;
+
+    case 2:
+        mergeImagesForDepthAndComponents<PIX, 2, maxValue>(instance, operation, renderWindow, srcImgA, srcImgB, dstImg, alphaMasking, mix, doMasking, maskImg, maskInvert);
+        break;
+
+    case 1:
+        mergeImagesForDepthAndComponents<PIX, 1, maxValue>(instance, operation, renderWindow, srcImgA, srcImgB, dstImg, alphaMasking, mix, doMasking, maskImg, maskInvert);
+        break;
+
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+        break;
+    }
+}
+
+/** @brief merge srcImgA over srcImgB into dstImg on renderWindow, with MergeProcessor.
+   All images must have the same components and bit depth, and the mask (if any) must be Alpha. */
+inline void
+mergeImages(OFX::ImageEffect &instance,
+            MergingFunctionEnum operation,
+            const OfxRectI & renderWindow,
+            const OFX::Image *srcImgA,
+            const OFX::Image *srcImgB,
+            OFX::Image *dstImg,
+            bool alphaMasking = false,
+            double mix = 1.,
+            bool doMasking = false,
+            const OFX::Image *maskImg = 0,
+            bool maskInvert = false)
+{
+    assert(dstImg);
+    assert( !srcImgA || (srcImgA->getPixelDepth() == dstImg->getPixelDepth() && srcImgA->getPixelComponentCount() == dstImg->getPixelComponentCount()) );
+    assert( !srcImgB || (srcImgB->getPixelDepth() == dstImg->getPixelDepth() && srcImgB->getPixelComponentCount() == dstImg->getPixelComponentCount()) );
+    switch ( dstImg->getPixelDepth() ) {
+    case OFX::eBitDepthUByte:
+        mergeImagesForDepth<unsigned char, 255>(instance, operation, renderWindow, srcImgA, srcImgB, dstImg, alphaMasking, mix, doMasking, maskImg, maskInvert);
+        break;
+
+    case OFX::eBitDepthUShort:
+        mergeImagesForDepth<unsigned short, 65535>(instance, operation, renderWindow, srcImgA, srcImgB, dstImg, alphaMasking, mix, doMasking, maskImg, maskInvert);
+        break;
+
+    case OFX::eBitDepthHalf:
+        mergeImagesForDepth<OFX::Half, 1>(instance, operation, renderWindow, srcImgA, srcImgB, dstImg, alphaMasking, mix, doMasking, maskImg, maskInvert);
+        break;
+
+    case OFX::eBitDepthFloat:
+        mergeImagesForDepth<float, 1>(instance, operation, renderWindow, srcImgA, srcImgB, dstImg, alphaMasking, mix, doMasking, maskImg, maskInvert);
+        break;
+
+    default:
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+        break;
+    }
+}
+} // namespace MergeImages2D
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsMergeProcessor_h
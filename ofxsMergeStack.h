@@ -0,0 +1,558 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Merge of a stack of layers over a background in a single pass.
+ */
+
+#ifndef openfx_supportext_ofxsMergeStack_h
+#define openfx_supportext_ofxsMergeStack_h
+
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+#include "ofxsCoords.h"
+#include "ofxsPixelProcessor.h"
+#include "ofxsMaskMix.h"
+#include "ofxsMaskMixRow.h"
+#include "ofxsMergeProcessor.h"
+#include "ofxsSimd.h"
+#include "ofxsHalf.h"
+
+namespace OFX {
+namespace MergeImages2D {
+/** @brief does merging a black and transparent A with the operator leave B unchanged?
+   Where such a layer does not exist, it can be skipped. */
+inline bool
+isIdentityWithoutA(MergingFunctionEnum operation)
+{
+    switch (operation) {
+    case eMergeATop:
+    case eMergeFrom:
+    case eMergeMatte:
+    case eMergeOver:
+    case eMergePlus:
+    case eMergeScreen:
+    case eMergeStencil:
+    case eMergeUnder:
+    case eMergeXOR:
+
+        return true;
+    default:
+
+        return false;
+    }
+}
+
+/** @brief merge one layer on n pixels of the accumulator accPix. srcPixA holds the pixels of the layer, or is
+   NULL if it does not exist there. All values are normalized to [0,1].
+   If direct is true, the result is written to accPix, else it is written to tmpPix, to be masked and mixed. */
+typedef void (*MergeStackLayerFunc)(const float *srcPixA, int n, bool alphaMasking, bool direct, float *tmpPix, float *accPix);
+
+/** @brief the MergeStackLayerFunc of the operator f, which uses the same kernels as MergeProcessor */
+template <MergingFunctionEnum f, int nComponents>
+void
+mergeStackLayerRow(const float *srcPixA,
+                   int n,
+                   bool alphaMasking,
+                   bool direct,
+                   float *tmpPix,
+                   float *accPix)
+{
+    typedef MergeSimd<f, float, nComponents, 1> Kernel;
+    typedef MergeScalar<f, float, nComponents, 1, MergeOp<f>::kVectorized != 0> Scalar;
+
+    for (int i = 0; i < n;) {
+        const float *pixA = srcPixA ? srcPixA + i * nComponents : 0;
+        float *acc = accPix + i * nComponents;
+        // each pixel is read before it is written, so that the merge can be done in place
+        float *out = direct ? acc : tmpPix + i * nComponents;
+        MergeCoverageEnum kind;
+        const int len = mergeCoverageRun<f, float, nComponents, 1>(pixA, acc, n - i, &kind);
+        const int count = len * nComponents;
+        switch (kind) {
+        case eMergeCoverageCompute: {
+            const int j = Kernel::kSupported ? Kernel::mergeRow(pixA, acc, len, alphaMasking, out) : 0;
+            Scalar::mergePixels(pixA ? pixA + j * nComponents : 0, acc + j * nComponents, len - j, alphaMasking, out + j * nComponents);
+            break;
+        }
+        case eMergeCoverageCopyA:
+            if (pixA) {
+                std::copy(pixA, pixA + count, out);
+            } else {
+                std::fill(out, out + count, 0.f);
+            }
+            break;
+
+        case eMergeCoverageCopyB:
+            if (!direct) {
+                std::copy(acc, acc + count, out);
+            }
+            break;
+
+        case eMergeCoverageZero:
+            std::fill(out, out + count, 0.f);
+            break;
+        }
+        i += len;
+    }
+}
+
+/** @brief get the MergeStackLayerFunc of operation */
+template <int nComponents>
+MergeStackLayerFunc
+getMergeStackLayerFunc(MergingFunctionEnum operation)
+{
+    switch (operation) {
+    case eMergeATop:
+        return &mergeStackLayerRow<eMergeATop, nComponents>;
+
+    case eMergeAverage:
+        return &mergeStackLayerRow<eMergeAverage, nComponents>;
+
+    case eMergeColor:
+        return &mergeStackLayerRow<eMergeColor, nComponents>;
+
+    case eMergeColorBurn:
+        return &mergeStackLayerRow<eMergeColorBurn, nComponents>;
+
+    case eMergeColorDodge:
+        return &mergeStackLayerRow<eMergeColorDodge, nComponents>;
+
+    case eMergeConjointOver:
+        return &mergeStackLayerRow<eMergeConjointOver, nComponents>;
+
+    case eMergeCopy:
+        return &mergeStackLayerRow<eMergeCopy, nComponents>;
+
+    case eMergeDifference:
+        return &mergeStackLayerRow<eMergeDifference, nComponents>;
+
+    case eMergeDisjointOver:
+        return &mergeStackLayerRow<eMergeDisjointOver, nComponents>;
+
+    case eMergeDivide:
+        return &mergeStackLayerRow<eMergeDivide, nComponents>;
+
+    case eMergeExclusion:
+        return &mergeStackLayerRow<eMergeExclusion, nComponents>;
+
+    case eMergeFreeze:
+        return &mergeStackLayerRow<eMergeFreeze, nComponents>;
+
+    case eMergeFrom:
+        return &mergeStackLayerRow<eMergeFrom, nComponents>;
+
+    case eMergeGeometric:
+        return &mergeStackLayerRow<eMergeGeometric, nComponents>;
+
+    case eMergeGrainExtract:
+        return &mergeStackLayerRow<eMergeGrainExtract, nComponents>;
+
+    case eMergeGrainMerge:
+        return &mergeStackLayerRow<eMergeGrainMerge, nComponents>;
+
+    case eMergeHardLight:
+        return &mergeStackLayerRow<eMergeHardLight, nComponents>;
+
+    case eMergeHue:
+        return &mergeStackLayerRow<eMergeHue, nComponents>;
+
+    case eMergeHypot:
+        return &mergeStackLayerRow<eMergeHypot, nComponents>;
+
+    case eMergeIn:
+        return &mergeStackLayerRow<eMergeIn, nComponents>;
+
+    case eMergeLuminosity:
+        return &mergeStackLayerRow<eMergeLuminosity, nComponents>;
+
+    case eMergeMask:
+        return &mergeStackLayerRow<eMergeMask, nComponents>;
+
+    case eMergeMatte:
+        return &mergeStackLayerRow<eMergeMatte, nComponents>;
+
+    case eMergeMax:
+        return &mergeStackLayerRow<eMergeMax, nComponents>;
+
+    case eMergeMin:
+        return &mergeStackLayerRow<eMergeMin, nComponents>;
+
+    case eMergeMinus:
+        return &mergeStackLayerRow<eMergeMinus, nComponents>;
+
+    case eMergeMultiply:
+        return &mergeStackLayerRow<eMergeMultiply, nComponents>;
+
+    case eMergeOut:
+        return &mergeStackLayerRow<eMergeOut, nComponents>;
+
+    case eMergeOver:
+        return &mergeStackLayerRow<eMergeOver, nComponents>;
+
+    case eMergeOverlay:
+        return &mergeStackLayerRow<eMergeOverlay, nComponents>;
+
+    case eMergePinLight:
+        return &mergeStackLayerRow<eMergePinLight, nComponents>;
+
+    case eMergePlus:
+        return &mergeStackLayerRow<eMergePlus, nComponents>;
+
+    case eMergeReflect:
+        return &mergeStackLayerRow<eMergeReflect, nComponents>;
+
+    case eMergeSaturation:
+        return &mergeStackLayerRow<eMergeSaturation, nComponents>;
+
+    case eMergeScreen:
+        return &mergeStackLayerRow<eMergeScreen, nComponents>;
+
+    case eMergeSoftLight:
+        return &mergeStackLayerRow<eMergeSoftLight, nComponents>;
+
+    case eMergeStencil:
+        return &mergeStackLayerRow<eMergeStencil, nComponents>;
+
+    case eMergeUnder:
+        return &mergeStackLayerRow<eMergeUnder, nComponents>;
+
+    case eMergeXOR:
+        return &mergeStackLayerRow<eMergeXOR, nComponents>;
+    } // switch
+
+    return 0;
+} // getMergeStackLayerFunc
+
+/** @brief SIMD kernels for MergeStackProcessor. The primary template is used when there is no
+   SIMD version (kSupported is 0): the values are processed one by one.
+ */
+template <class PIX, int maxValue,
+          bool supported =
+#ifdef OFXS_USE_SSE2
+              Simd::PixelIO<PIX, maxValue>::supported != 0
+#else
+              false
+#endif
+          >
+struct MergeStackSimd
+{
+    enum { kSupported = 0 };
+
+    static int loadRow(const PIX *,
+                       int,
+                       float *)
+    {
+        return 0;
+    }
+
+    static int storeRow(const float *,
+                        int,
+                        PIX *)
+    {
+        return 0;
+    }
+};
+
+#ifdef OFXS_USE_SSE2
+template <class PIX, int maxValue>
+struct MergeStackSimd<PIX, maxValue, true>
+{
+    enum { kSupported = 1 };
+
+    /** @brief normalize the beginning of count values of srcPix to [0,1], and return the number of values done */
+    static int loadRow(const PIX *srcPix,
+                       int count,
+                       float *dst)
+    {
+        // divide, like mergeLoadPixel(), to get exactly the same results
+        const __m128 vmax = _mm_set1_ps( (float)maxValue );
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m128 v[4];
+            Simd::PixelIO<PIX, maxValue>::load16(srcPix + i, v);
+            for (int k = 0; k < 4; ++k) {
+                _mm_storeu_ps( dst + i + 4 * k, _mm_div_ps(v[k], vmax) );
+            }
+        }
+
+        return i;
+    }
+
+    /** @brief store the beginning of count normalized values (clamped and rounded, see ofxsClampIfInt()),
+       and return the number of values done */
+    static int storeRow(const float *src,
+                        int count,
+                        PIX *dstPix)
+    {
+        const __m128 vmax = _mm_set1_ps( (float)maxValue );
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m128 v[4];
+            Simd::PixelIO<float, 1>::load16(src + i, v);
+            for (int k = 0; k < 4; ++k) {
+                v[k] = _mm_mul_ps(v[k], vmax);
+            }
+            Simd::PixelIO<PIX, maxValue>::store16(dstPix + i, v);
+        }
+
+        return i;
+    }
+};
+#endif // ifdef OFXS_USE_SSE2
+
+/** @brief base class of MergeStackProcessor, which holds the layers */
+class MergeStackProcessorBase
+    : public OFX::PixelProcessor
+{
+protected:
+    struct Layer
+    {
+        const OFX::Image *srcImg;
+        MergingFunctionEnum operation;
+        bool alphaMasking;
+        float mix;
+        const OFX::Image *maskImg;
+        bool maskInvert;
+        MergeStackLayerFunc func;
+    };
+
+    const OFX::Image *_bgImg;
+    std::vector<Layer> _layers;
+
+public:
+    MergeStackProcessorBase(OFX::ImageEffect &instance)
+        : OFX::PixelProcessor(instance)
+        , _bgImg(0)
+        , _layers()
+    {
+        // the cost of a pixel depends a lot on the number of layers that exist there
+        setScheduling(OFX::ePixelProcessorSchedulingTiles, 256, 32);
+    }
+
+    /** @brief set the bottom of the stack (which may be NULL) */
+    void setBackgroundImg(const OFX::Image *v)
+    {
+        _bgImg = v;
+    }
+
+    /** @brief add a layer on top of the stack: srcImg (which may be NULL) is merged over the result of
+       the layers below as A over B, then masked and mixed with it (see MergeProcessor).
+       If maskImg is NULL, the layer is not masked. */
+    void addLayer(const OFX::Image *srcImg,
+                  MergingFunctionEnum operation,
+                  bool alphaMasking = false,
+                  double mix = 1.,
+                  const OFX::Image *maskImg = 0,
+                  bool maskInvert = false)
+    {
+        Layer layer;
+
+        layer.srcImg = srcImg;
+        layer.operation = operation;
+        layer.alphaMasking = alphaMasking;
+        layer.mix = (float)mix;
+        layer.maskImg = maskImg;
+        layer.maskInvert = maskInvert;
+        layer.func = 0;
+        _layers.push_back(layer);
+    }
+
+    /** @brief remove all layers */
+    void clearLayers()
+    {
+        _layers.clear();
+    }
+};
+
+/** @brief A processor that merges a stack of layers over a background in a single pass.
+
+   The result is the same (up to rounding) as merging the layers one by one from bottom to top with MergeProcessor, into float
+   intermediate images, but there are no intermediate images: each chunk of a row is loaded once in a
+   normalized float accumulator, which stays in the cache while all the layers are merged in it, and is
+   then stored to the destination. With integer images the result is thus more accurate than with
+   separate passes, which round and clamp the intermediate results.
+
+   The layers that do not touch a tile are skipped, as well as the parts of a row where a layer does not
+   exist, if the operator leaves B unchanged there (see isIdentityWithoutA()). The render window is
+   processed by tiles (see PixelProcessor::setScheduling()), so that a stack of small elements over a
+   plate costs about as much as the plate.
+
+   The accumulator is defined everywhere: outside of the background, it is black and transparent for Alpha
+   and RGBA images, and black and opaque for the other ones. All images must have the same components and bit
+   depth, and the masks must be Alpha.
+ */
+template <class PIX, int nComponents, int maxValue>
+class MergeStackProcessor
+    : public MergeStackProcessorBase
+{
+public:
+    enum { kChunkSize = 256 };
+
+    MergeStackProcessor(OFX::ImageEffect &instance)
+        : MergeStackProcessorBase(instance)
+    {
+    }
+
+    /** @brief get the operator of each layer */
+    void preProcess()
+    {
+        for (size_t l = 0; l < _layers.size(); ++l) {
+            _layers[l].func = getMergeStackLayerFunc<nComponents>(_layers[l].operation);
+            if (!_layers[l].func) {
+                OFX::throwSuiteStatusException(kOfxStatErrUnsupported);
+            }
+        }
+        setPixelCost( (double)std::max( (size_t)1, _layers.size() ) );
+    }
+
+    void multiThreadProcessImages(OfxRectI procWindow)
+    {
+        OFX::ScratchArena & arena = getScratchArena();
+        float *accRow = arena.allocateArray<float>(kChunkSize * nComponents);
+        float *tmpRow = arena.allocateArray<float>(kChunkSize * nComponents);
+        float *srcRow = arena.allocateArray<float>(kChunkSize * nComponents);
+        float *maskRow = arena.allocateArray<float>(kChunkSize);
+        // the layers that touch this window
+        const Layer **layers = arena.allocateArray<const Layer *>( _layers.size() + 1 );
+        int nLayers = 0;
+
+        for (size_t l = 0; l < _layers.size(); ++l) {
+            const Layer &layer = _layers[l];
+            if ( layer.srcImg || !isIdentityWithoutA(layer.operation) ) {
+                OfxRectI inter;
+                if ( !isIdentityWithoutA(layer.operation) || OFX::Coords::rectIntersection(procWindow, layer.srcImg->getBounds(), &inter) ) {
+                    layers[nLayers++] = &layer;
+                }
+            }
+        }
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) getDstPixelAddress(procWindow.x1, y);
+            assert(dstPix);
+
+            for (int x1 = procWindow.x1; x1 < procWindow.x2; x1 += kChunkSize) {
+                const int x2 = std::min(x1 + kChunkSize, procWindow.x2);
+                loadRow(_bgImg, nComponents, x1, x2, y, accRow);
+                for (int l = 0; l < nLayers; ++l) {
+                    mergeLayer(*layers[l], x1, x2, y, srcRow, maskRow, tmpRow, accRow);
+                }
+                storeValues(accRow, (x2 - x1) * nComponents, dstPix + (x1 - procWindow.x1) * nComponents);
+            }
+        }
+    }
+
+private:
+    /** @brief merge the pixels [x1,x2) of row y of a layer into accRow, by intervals where it exists or not */
+    void mergeLayer(const Layer &layer,
+                    int x1,
+                    int x2,
+                    int y,
+                    float *srcRow,
+                    float *maskRow,
+                    float *tmpRow,
+                    float *accRow) const
+    {
+        const bool identityWithoutA = isIdentityWithoutA(layer.operation);
+        const bool direct = !layer.maskImg && (layer.mix == 1.f);
+        OFX::PixelRowSegment seg;
+
+        for (int x = x1; x < x2; x = seg.x2) {
+            OFX::getPixelRowSegment(layer.srcImg, 0, x, y, x2, &seg);
+            if (!seg.pix && identityWithoutA) {
+                continue;
+            }
+            const int off = (x - x1) * nComponents;
+            const int n = seg.x2 - x;
+            const float *srcPix = 0;
+            if (seg.pix) {
+                loadValues( (const PIX *)seg.pix, n * nComponents, srcRow + off );
+                srcPix = srcRow + off;
+            }
+            layer.func(srcPix, n, layer.alphaMasking, direct, tmpRow + off, accRow + off);
+            if (direct) {
+                continue;
+            }
+            if (layer.maskImg) {
+                loadRow(layer.maskImg, 1, x, seg.x2, y, maskRow);
+                ofxsMaskMixMaskedRow<float, nComponents, 1>(tmpRow + off, n, accRow + off, maskRow, layer.mix, layer.maskInvert, accRow + off);
+            } else {
+                ofxsMaskMixConstantRow<float, nComponents, 1>(tmpRow + off, n, accRow + off, layer.mix, accRow + off);
+            }
+        }
+    }
+
+    /** @brief load the pixels [x1,x2) of row y of img (which may be NULL), which has nComps components,
+       normalized to [0,1], and 0 outside of img */
+    static void loadRow(const OFX::Image *img,
+                        int nComps,
+                        int x1,
+                        int x2,
+                        int y,
+                        float *dst)
+    {
+        OFX::PixelRowSegment seg;
+
+        for (int x = x1; x < x2; x = seg.x2) {
+            OFX::getPixelRowSegment(img, 0, x, y, x2, &seg);
+            float *d = dst + (x - x1) * nComps;
+            const int count = (seg.x2 - x) * nComps;
+            if (seg.pix) {
+                loadValues( (const PIX *)seg.pix, count, d );
+            } else {
+                std::fill(d, d + count, 0.f);
+            }
+        }
+    }
+
+    static void loadValues(const PIX *srcPix,
+                           int count,
+                           float *dst)
+    {
+        typedef MergeStackSimd<PIX, maxValue> Kernel;
+        int i = Kernel::kSupported ? Kernel::loadRow(srcPix, count, dst) : 0;
+
+        for (; i < count; ++i) {
+            dst[i] = srcPix[i] / (float)maxValue;
+        }
+    }
+
+    static void storeValues(const float *src,
+                            int count,
+                            PIX *dstPix)
+    {
+        typedef MergeStackSimd<PIX, maxValue> Kernel;
+        int i = Kernel::kSupported ? Kernel::storeRow(src, count, dstPix) : 0;
+
+        for (; i < count; ++i) {
+            dstPix[i] = ofxsClampIfInt<PIX, maxValue>(src[i] * maxValue, 0, maxValue);
+        }
+    }
+};
+} // namespace MergeImages2D
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsMergeStack_h
@@ -20,7 +20,12 @@
  * OFX mipmapping help functions
  */
 
-#include "ofxsMipMap.h"
+#include "ofxsMipmap.h"
+
+#include <memory>
+
+#include "ofxsCoords.h"
+#include "ofxsHalf.h"
 
 namespace OFX {
 // update the window of dst defined by dstRoI by halving the corresponding area in src.
@@ -77,10 +82,11 @@ halveWindow(const OfxRectI & dstRoI,
                 ///a b
                 ///c d
 
-                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
-                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + nComponents) : 0;
-                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize): 0;
-                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + nComponents)  : 0;
+                // the sum is computed in float (PIX may be Half)
+                const float a = (pickThisCol && pickThisRow) ? (float)*(srcPixStart + k) : 0.f;
+                const float b = (pickNextCol && pickThisRow) ? (float)*(srcPixStart + k + nComponents) : 0.f;
+                const float c = (pickThisCol && pickNextRow) ? (float)*(srcPixStart + k + srcRowSize): 0.f;
+                const float d = (pickNextCol && pickNextRow) ? (float)*(srcPixStart + k + srcRowSize  + nComponents)  : 0.f;
 
                 assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
                 assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
@@ -107,10 +113,10 @@ buildMipMapLevel(OFX::ImageEffect* instance,
 {
     assert(level > 0);
 
-    std::auto_ptr<OFX::ImageMemory> mem;
-    size_t memSize = 0;
-    std::auto_ptr<OFX::ImageMemory> tmpMem;
-    size_t tmpMemSize = 0;
+    // Two buffers are used alternately for the intermediate levels. Levels get smaller,
+    // so the buffers allocated for the first two levels are large enough for the next ones.
+    std::auto_ptr<OFX::ImageMemory> mem[2];
+    size_t memSize[2] = {0, 0};
     PIX* nextImg = NULL;
     const PIX* previousImg = srcPixels;
     OfxRectI previousBounds = srcBounds;
@@ -124,25 +130,25 @@ buildMipMapLevel(OFX::ImageEffect* instance,
         // - nextRenderWindow contains the renderWindow at the level before i
         //
         ///Halve the smallest enclosing po2 rect as we need to render a minimum of the renderWindow
-        nextRenderWindow = downscalePowerOfTwoSmallestEnclosing(nextRenderWindow, 1);
+        nextRenderWindow = Coords::downscalePowerOfTwoSmallestEnclosing(nextRenderWindow, 1);
 #     ifdef DEBUG
         {
             // check that doing i times 1 level is the same as doing i levels
-            OfxRectI nrw = downscalePowerOfTwoSmallestEnclosing(renderWindowFullRes, i);
+            OfxRectI nrw = Coords::downscalePowerOfTwoSmallestEnclosing(renderWindowFullRes, i);
             assert(nrw.x1 == nextRenderWindow.x1 && nrw.x2 == nextRenderWindow.x2 && nrw.y1 == nextRenderWindow.y1 && nrw.y2 == nextRenderWindow.y2);
         }
 #     endif
-        ///Allocate a temporary image if necessary, or reuse the previously allocated buffer
+        ///Allocate a temporary image if necessary, or reuse the buffer of the level before the previous one
         int nextRowBytes =  (nextRenderWindow.x2 - nextRenderWindow.x1)  * nComponents * sizeof(PIX);
         size_t newMemSize =  (nextRenderWindow.y2 - nextRenderWindow.y1) * nextRowBytes;
-        if ( tmpMem.get() ) {
-            // there should be enough memory: no need to reallocate
-            assert(tmpMemSize >= memSize);
-        } else {
+        std::auto_ptr<OFX::ImageMemory> & tmpMem = mem[i % 2];
+        if ( !tmpMem.get() ) {
             tmpMem.reset( new OFX::ImageMemory(newMemSize, instance) );
-            tmpMemSize = newMemSize;
+            memSize[i % 2] = newMemSize;
         }
-        nextImg = (float*)tmpMem->lock();
+        // there should be enough memory: no need to reallocate
+        assert(memSize[i % 2] >= newMemSize);
+        nextImg = (PIX*)tmpMem->lock();
 
         halveWindow<PIX, nComponents>(nextRenderWindow, previousImg, previousBounds, previousRowBytes, nextImg, nextRenderWindow, nextRowBytes);
 
@@ -150,8 +156,6 @@ buildMipMapLevel(OFX::ImageEffect* instance,
         previousBounds = nextRenderWindow;
         previousRowBytes = nextRowBytes;
         previousImg = nextImg;
-        mem = tmpMem;
-        memSize = tmpMemSize;
     }
     // here:
     // - previousImg, previousBounds, previousRowBytes describe the data ate the level before 'level'
@@ -159,7 +163,7 @@ buildMipMapLevel(OFX::ImageEffect* instance,
 
     ///On the last iteration halve directly into the dstPixels
     ///The nextRenderWindow should be equal to the original render window.
-    nextRenderWindow = downscalePowerOfTwoSmallestEnclosing(nextRenderWindow, 1);
+    nextRenderWindow = Coords::downscalePowerOfTwoSmallestEnclosing(nextRenderWindow, 1);
     assert(originalRenderWindow.x1 == nextRenderWindow.x1 && originalRenderWindow.x2 == nextRenderWindow.x2 &&
            originalRenderWindow.y1 == nextRenderWindow.y1 && originalRenderWindow.y2 == nextRenderWindow.y2);
 
@@ -167,6 +171,32 @@ buildMipMapLevel(OFX::ImageEffect* instance,
     // mem and tmpMem are freed at destruction
 } // buildMipMapLevel
 
+template <typename PIX>
+static void
+ofxsScalePixelDataForDepth(OFX::ImageEffect* instance,
+                           const OfxRectI & originalRenderWindow,
+                           const OfxRectI & renderWindow,
+                           unsigned int levels,
+                           const void* srcPixelData,
+                           const OfxRectI & srcBounds,
+                           int srcRowBytes,
+                           void* dstPixelData,
+                           OFX::PixelComponentEnum dstPixelComponents,
+                           const OfxRectI & dstBounds,
+                           int dstRowBytes)
+{
+    if (dstPixelComponents == OFX::ePixelComponentRGBA) {
+        buildMipMapLevel<PIX, 4>(instance, originalRenderWindow, renderWindow, levels, (const PIX*)srcPixelData,
+                                 srcBounds, srcRowBytes, (PIX*)dstPixelData, dstBounds, dstRowBytes);
+    } else if (dstPixelComponents == OFX::ePixelComponentRGB) {
+        buildMipMapLevel<PIX, 3>(instance, originalRenderWindow, renderWindow, levels, (const PIX*)srcPixelData,
+                                 srcBounds, srcRowBytes, (PIX*)dstPixelData, dstBounds, dstRowBytes);
+    }  else if (dstPixelComponents == OFX::ePixelComponentAlpha) {
+        buildMipMapLevel<PIX, 1>(instance, originalRenderWindow, renderWindow,levels, (const PIX*)srcPixelData,
+                                 srcBounds, srcRowBytes, (PIX*)dstPixelData, dstBounds, dstRowBytes);
+    }     // switch
+}
+
 void
 ofxsScalePixelData(OFX::ImageEffect* instance,
                    const OfxRectI & originalRenderWindow,
@@ -186,7 +216,8 @@ ofxsScalePixelData(OFX::ImageEffect* instance,
     assert(srcPixelData && dstPixelData);
 
     // do the rendering
-    if ( ( dstPixelDepth != OFX::eBitDepthFloat) ||
+    if ( ( ( dstPixelDepth != OFX::eBitDepthFloat) &&
+           ( dstPixelDepth != OFX::eBitDepthHalf) ) ||
          ( ( dstPixelComponents != OFX::ePixelComponentRGBA) &&
            ( dstPixelComponents != OFX::ePixelComponentRGB) &&
            ( dstPixelComponents != OFX::ePixelComponentAlpha) ) ||
@@ -195,16 +226,13 @@ ofxsScalePixelData(OFX::ImageEffect* instance,
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
     }
 
-    if (dstPixelComponents == OFX::ePixelComponentRGBA) {
-        buildMipMapLevel<float, 4>(instance, originalRenderWindow, renderWindow, levels, (const float*)srcPixelData,
-                                   srcBounds, srcRowBytes, (float*)dstPixelData, dstBounds, dstRowBytes);
-    } else if (dstPixelComponents == OFX::ePixelComponentRGB) {
-        buildMipMapLevel<float, 3>(instance, originalRenderWindow, renderWindow, levels, (const float*)srcPixelData,
-                                   srcBounds, srcRowBytes, (float*)dstPixelData, dstBounds, dstRowBytes);
-    }  else if (dstPixelComponents == OFX::ePixelComponentAlpha) {
-        buildMipMapLevel<float, 1>(instance, originalRenderWindow, renderWindow,levels, (const float*)srcPixelData,
-                                   srcBounds, srcRowBytes, (float*)dstPixelData, dstBounds, dstRowBytes);
-    }     // switch
+    if (dstPixelDepth == OFX::eBitDepthHalf) {
+        ofxsScalePixelDataForDepth<OFX::Half>(instance, originalRenderWindow, renderWindow, levels, srcPixelData,
+                                              srcBounds, srcRowBytes, dstPixelData, dstPixelComponents, dstBounds, dstRowBytes);
+    } else {
+        ofxsScalePixelDataForDepth<float>(instance, originalRenderWindow, renderWindow, levels, srcPixelData,
+                                          srcBounds, srcRowBytes, dstPixelData, dstPixelComponents, dstBounds, dstRowBytes);
+    }
 }
 
 template <typename PIX,int nComponents>
@@ -217,7 +245,7 @@ ofxsBuildMipMapsForComponents(OFX::ImageEffect* instance,
                               unsigned int maxLevel,
                               MipMapsVector & mipmaps)
 {
-    const PIX* previousImg = srcPixels;
+    const PIX* previousImg = srcPixelData;
     OfxRectI previousBounds = srcBounds;
     int previousRowBytes = srcRowBytes;
     OfxRectI nextRenderWindow = renderWindow;
@@ -229,25 +257,24 @@ ofxsBuildMipMapsForComponents(OFX::ImageEffect* instance,
         // - nextRenderWindow contains the renderWindow at the level before i
         //
         ///Halve the smallest enclosing po2 rect as we need to render a minimum of the renderWindow
-        nextRenderWindow = downscalePowerOfTwoSmallestEnclosing(nextRenderWindow, 1);
+        nextRenderWindow = Coords::downscalePowerOfTwoSmallestEnclosing(nextRenderWindow, 1);
 #     ifdef DEBUG
         {
             // check that doing i times 1 level is the same as doing i levels
-            OfxRectI nrw = downscalePowerOfTwoSmallestEnclosing(renderWindowFullRes, i);
+            OfxRectI nrw = Coords::downscalePowerOfTwoSmallestEnclosing(renderWindow, i);
             assert(nrw.x1 == nextRenderWindow.x1 && nrw.x2 == nextRenderWindow.x2 && nrw.y1 == nextRenderWindow.y1 && nrw.y2 == nextRenderWindow.y2);
         }
 #     endif
-        assert(i - 1 >= 0);
 
-        ///Allocate a temporary image if necessary, or reuse the previously allocated buffer
+        ///Allocate the image of this level
         int nextRowBytes = (nextRenderWindow.x2 - nextRenderWindow.x1)  * nComponents * sizeof(PIX);
         mipmaps[i - 1].memSize = (nextRenderWindow.y2 - nextRenderWindow.y1) * nextRowBytes;
         mipmaps[i - 1].bounds = nextRenderWindow;
 
+        delete mipmaps[i - 1].data;
         mipmaps[i - 1].data = new OFX::ImageMemory(mipmaps[i - 1].memSize, instance);
-        tmpMemSize = newMemSize;
 
-        float* nextImg = (float*)tmpMem->lock();
+        PIX* nextImg = (PIX*)mipmaps[i - 1].data->lock();
 
         halveWindow<PIX, nComponents>(nextRenderWindow, previousImg, previousBounds, previousRowBytes, nextImg, nextRenderWindow, nextRowBytes);
 
@@ -269,7 +296,7 @@ ofxsBuildMipMaps(OFX::ImageEffect* instance,
                  unsigned int maxLevel,
                  MipMapsVector & mipmaps)
 {
-    assert(srcPixelData && mipmaps->size() == maxLevel);
+    assert(srcPixelData && mipmaps.size() >= maxLevel);
 
     // do the rendering
     if ( ( srcPixelDepth != OFX::eBitDepthFloat) ||
@@ -279,14 +306,14 @@ ofxsBuildMipMaps(OFX::ImageEffect* instance,
         OFX::throwSuiteStatusException(kOfxStatErrFormat);
     }
 
-    if (dstPixelComponents == OFX::ePixelComponentRGBA) {
-        ofxsBuildMipMapsForComponents<float,4>(instance,renderWindow,srcPixelData,srcBounds,
+    if (srcPixelComponents == OFX::ePixelComponentRGBA) {
+        ofxsBuildMipMapsForComponents<float,4>(instance,renderWindow,(const float*)srcPixelData,srcBounds,
                                                srcRowBytes,maxLevel,mipmaps);
-    } else if (dstPixelComponents == OFX::ePixelComponentRGB) {
-        ofxsBuildMipMapsForComponents<float,3>(instance,renderWindow,srcPixelData,srcBounds,
+    } else if (srcPixelComponents == OFX::ePixelComponentRGB) {
+        ofxsBuildMipMapsForComponents<float,3>(instance,renderWindow,(const float*)srcPixelData,srcBounds,
                                                srcRowBytes,maxLevel,mipmaps);
-    }  else if (dstPixelComponents == OFX::ePixelComponentAlpha) {
-        ofxsBuildMipMapsForComponents<float,1>(instance,renderWindow,srcPixelData,srcBounds,
+    }  else if (srcPixelComponents == OFX::ePixelComponentAlpha) {
+        ofxsBuildMipMapsForComponents<float,1>(instance,renderWindow,(const float*)srcPixelData,srcBounds,
                                                srcRowBytes,maxLevel,mipmaps);
     }
 }
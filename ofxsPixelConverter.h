@@ -0,0 +1,422 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * OFX pixel format conversion: bit depth (8 bits, 16 bits, half, float) and components (Alpha, RGB, RGBA).
+ */
+
+#ifndef openfx_supportext_ofxsPixelConverter_h
+#define openfx_supportext_ofxsPixelConverter_h
+
+#include <cassert>
+#include <algorithm>
+
+#include "ofxsPixelProcessor.h"
+#include "ofxsMaskMix.h"
+#include "ofxsCopier.h"
+#include "ofxsSimd.h"
+#include "ofxsHalf.h"
+
+namespace OFX {
+/** @brief convert one pixel.
+
+   Components are mapped as in ofxsToRGBA(): Alpha is converted to (0,0,0,a), RGB to (r,g,b,1), and the
+   destination takes a, rgb or rgba from it. Values are scaled by dstMaxValue/srcMaxValue, and integer
+   types are clamped and rounded.
+ */
+template <class SRCPIX, int srcNComponents, int srcMaxValue, class DSTPIX, int dstNComponents, int dstMaxValue>
+inline void
+ofxsConvertPixel(const SRCPIX *srcPix,
+                 DSTPIX *dstPix)
+{
+    float rgba[4];
+
+    ofxsToRGBA<SRCPIX, srcNComponents, srcMaxValue>(srcPix, rgba);
+    const int c0 = (dstNComponents == 1) ? 3 : 0;
+    for (int c = 0; c < dstNComponents; ++c) {
+        dstPix[c] = ofxsClampIfInt<DSTPIX, dstMaxValue>(rgba[c0 + c] * dstMaxValue, 0, dstMaxValue);
+    }
+}
+
+/** @brief SIMD kernels for ofxsConvertPixelRow(). The primary template is used when there is no
+   SIMD version (kSupported is 0): the conversion is done pixel by pixel.
+ */
+template <class SRCPIX, int srcNComponents, int srcMaxValue, class DSTPIX, int dstNComponents, int dstMaxValue,
+          bool supported =
+#ifdef OFXS_USE_SSE2
+              Simd::PixelIO<SRCPIX, srcMaxValue>::supported && Simd::PixelIO<DSTPIX, dstMaxValue>::supported
+#else
+              false
+#endif
+          >
+struct PixelConverterSimd
+{
+    enum { kSupported = 0 };
+
+    static int convertRow(const SRCPIX *,
+                          int,
+                          DSTPIX *)
+    {
+        return 0;
+    }
+};
+
+#ifdef OFXS_USE_SSE2
+template <class SRCPIX, int srcNComponents, int srcMaxValue, class DSTPIX, int dstNComponents, int dstMaxValue>
+struct PixelConverterSimd<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue, true>
+{
+    enum { kSupported = 1 };
+
+    /** @brief convert the beginning of a row of n pixels, and return the number of pixels converted.
+       The remaining pixels must be converted by ofxsConvertPixel(). */
+    static int convertRow(const SRCPIX *srcPix,
+                          int n,
+                          DSTPIX *dstPix)
+    {
+        typedef Simd::PixelIO<SRCPIX, srcMaxValue> SrcIO;
+        typedef Simd::PixelIO<DSTPIX, dstMaxValue> DstIO;
+        // divide then multiply, like ofxsConvertPixel(), to get exactly the same results
+        const __m128 srcMax = _mm_set1_ps( (float)srcMaxValue );
+        const __m128 dstMax = _mm_set1_ps( (float)dstMaxValue );
+
+        if (srcNComponents == dstNComponents) {
+            // same components: the row is a flat array of values, converted 16 at a time
+            const int count = n * srcNComponents;
+            int i = 0;
+            for (; i + 16 <= count; i += 16) {
+                __m128 v[4];
+                SrcIO::load16(srcPix + i, v);
+                for (int k = 0; k < 4; ++k) {
+                    v[k] = _mm_mul_ps(_mm_div_ps(v[k], srcMax), dstMax);
+                }
+                DstIO::store16(dstPix + i, v);
+            }
+
+            // the remaining values may not be a whole number of pixels: the caller restarts at the last whole pixel
+            return i / srcNComponents;
+        }
+        if ( (srcNComponents == 3 || srcNComponents == 4) && (dstNComponents == 3 || dstNComponents == 4) ) {
+            // RGB <-> RGBA: convert pixel by pixel, the alpha of RGB is 1
+            const __m128 one = _mm_set1_ps(1.f);
+            for (int i = 0; i < n; ++i, srcPix += srcNComponents, dstPix += dstNComponents) {
+                __m128 v = _mm_div_ps(Simd::loadPixel<SRCPIX, srcMaxValue, srcNComponents>(srcPix), srcMax);
+                if (srcNComponents == 3) {
+                    v = Simd::setAlpha(v, one);
+                }
+                Simd::storePixel<DSTPIX, dstMaxValue, dstNComponents>(dstPix, _mm_mul_ps(v, dstMax));
+            }
+
+            return n;
+        }
+
+        // Alpha <-> RGB(A): nothing to gain
+        return 0;
+    }
+};
+#endif // ifdef OFXS_USE_SSE2
+
+/** @brief convert a row of n pixels. srcStep is srcNComponents, or 0 to convert the same pixel n times. */
+template <class SRCPIX, int srcNComponents, int srcMaxValue, class DSTPIX, int dstNComponents, int dstMaxValue>
+void
+ofxsConvertPixelRow(const SRCPIX *srcPix,
+                    int srcStep,
+                    int n,
+                    DSTPIX *dstPix)
+{
+    typedef PixelConverterSimd<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue> Kernel;
+
+    if (srcStep == 0) {
+        // convert once, then copy
+        if (n <= 0) {
+            return;
+        }
+        ofxsConvertPixel<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue>(srcPix, dstPix);
+        for (int i = 1; i < n; ++i) {
+            std::copy(dstPix, dstPix + dstNComponents, dstPix + i * dstNComponents);
+        }
+
+        return;
+    }
+    assert(srcStep == srcNComponents);
+    int i = Kernel::kSupported ? Kernel::convertRow(srcPix, n, dstPix) : 0;
+    srcPix += i * srcNComponents;
+    dstPix += i * dstNComponents;
+    for (; i < n; ++i, srcPix += srcNComponents, dstPix += dstNComponents) {
+        ofxsConvertPixel<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue>(srcPix, dstPix);
+    }
+}
+
+/** @brief A processor that converts the source image to the depth and components of the destination
+   image (see ofxsConvertPixel()). Pixels outside the source follow the boundary conditions of setSrcImg().
+ */
+template <class SRCPIX, int srcNComponents, int srcMaxValue, class DSTPIX, int dstNComponents, int dstMaxValue>
+class PixelConverter
+    : public OFX::PixelProcessorFilterBase
+{
+public:
+    PixelConverter(OFX::ImageEffect &instance)
+        : OFX::PixelProcessorFilterBase(instance)
+    {
+        setPixelCost(OFX::ePixelProcessorCostCheap);
+    }
+
+    void multiThreadProcessImages(OfxRectI procWindow)
+    {
+        OFX::PixelRowSegment seg;
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            DSTPIX *dstPix = (DSTPIX *) getDstPixelAddress(procWindow.x1, y);
+            assert(dstPix);
+
+            for (int x = procWindow.x1; x < procWindow.x2; x = seg.x2) {
+                getSrcRowSegment(x, y, procWindow.x2, &seg);
+                const int n = seg.x2 - seg.x1;
+                if (seg.kind == OFX::ePixelRowSegmentBlack) {
+                    std::fill( dstPix, dstPix + n * dstNComponents, DSTPIX() );
+                } else {
+                    ofxsConvertPixelRow<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue>( (const SRCPIX *)seg.pix,
+                                                                                                                   (seg.kind == OFX::ePixelRowSegmentPixels) ? srcNComponents : 0,
+                                                                                                                   n, dstPix );
+                }
+                dstPix += n * dstNComponents;
+            }
+        }
+    }
+};
+
+template <class SRCPIX, int srcNComponents, int srcMaxValue, class DSTPIX, int dstNComponents, int dstMaxValue>
+void
+convertPixelsForDepthsAndComponents(OFX::ImageEffect &instance,
+                                    const OfxRectI & renderWindow,
+                                    const void *srcPixelData,
+                                    const OfxRectI & srcBounds,
+                                    OFX::PixelComponentEnum srcPixelComponents,
+                                    int srcPixelComponentCount,
+                                    OFX::BitDepthEnum srcBitDepth,
+                                    int srcRowBytes,
+                                    void *dstPixelData,
+                                    const OfxRectI & dstBounds,
+                                    OFX::PixelComponentEnum dstPixelComponents,
+                                    int dstPixelComponentCount,
+                                    OFX::BitDepthEnum dstBitDepth,
+                                    int dstRowBytes)
+{
+    OFX::PixelConverter<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, dstNComponents, dstMaxValue> processor(instance);
+    // set the images
+    processor.setDstImg(dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    processor.setSrcImg(srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes, 0);
+
+    // set the render window
+    processor.setRenderWindow(renderWindow);
+
+    // Call the base class process member, this will call the derived templated process code
+    processor.process();
+}
+
+template <class SRCPIX, int srcNComponents, int srcMaxValue, class DSTPIX, int dstMaxValue>
+void
+convertPixelsForDepthsAndSrcComponents(OFX::ImageEffect &instance,
+                                       const OfxRectI & renderWindow,
+                                       const void *srcPixelData,
+                                       const OfxRectI & srcBounds,
+                                       OFX::PixelComponentEnum srcPixelComponents,
+                                       int srcPixelComponentCount,
+                                       OFX::BitDepthEnum srcBitDepth,
+                                       int srcRowBytes,
+                                       void *dstPixelData,
+                                       const OfxRectI & dstBounds,
+                                       OFX::PixelComponentEnum dstPixelComponents,
+                                       int dstPixelComponentCount,
+                                       OFX::BitDepthEnum dstBitDepth,
+                                       int dstRowBytes)
+{
+    if (dstPixelComponents == OFX::ePixelComponentRGBA) {
+        convertPixelsForDepthsAndComponents<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, 4, dstMaxValue>(instance, renderWindow,
+                                                                                                       srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                                                                       dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (dstPixelComponents == OFX::ePixelComponentRGB) {
+        convertPixelsForDepthsAndComponents<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, 3, dstMaxValue>(instance, renderWindow,
+                                                                                                       srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                                                                       dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (dstPixelComponents == OFX::ePixelComponentAlpha) {
+        convertPixelsForDepthsAndComponents<SRCPIX, srcNComponents, srcMaxValue, DSTPIX, 1, dstMaxValue>(instance, renderWindow,
+                                                                                                       srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                                                                       dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else {
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+    }
+}
+
+template <class SRCPIX, int srcMaxValue, class DSTPIX, int dstMaxValue>
+void
+convertPixelsForDepths(OFX::ImageEffect &instance,
+                       const OfxRectI & renderWindow,
+                       const void *srcPixelData,
+                       const OfxRectI & srcBounds,
+                       OFX::PixelComponentEnum srcPixelComponents,
+                       int srcPixelComponentCount,
+                       OFX::BitDepthEnum srcBitDepth,
+                       int srcRowBytes,
+                       void *dstPixelData,
+                       const OfxRectI & dstBounds,
+                       OFX::PixelComponentEnum dstPixelComponents,
+                       int dstPixelComponentCount,
+                       OFX::BitDepthEnum dstBitDepth,
+                       int dstRowBytes)
+{
+    if (srcPixelComponents == OFX::ePixelComponentRGBA) {
+        convertPixelsForDepthsAndSrcComponents<SRCPIX, 4, srcMaxValue, DSTPIX, dstMaxValue>(instance, renderWindow,
+                                                                                          srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                                                          dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (srcPixelComponents == OFX::ePixelComponentRGB) {
+        convertPixelsForDepthsAndSrcComponents<SRCPIX, 3, srcMaxValue, DSTPIX, dstMaxValue>(instance, renderWindow,
+                                                                                          srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                                                          dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (srcPixelComponents == OFX::ePixelComponentAlpha) {
+        convertPixelsForDepthsAndSrcComponents<SRCPIX, 1, srcMaxValue, DSTPIX, dstMaxValue>(instance, renderWindow,
+                                                                                          srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                                                          dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else {
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+    }
+}
+
+template <class SRCPIX, int srcMaxValue>
+void
+convertPixelsForSrcDepth(OFX::ImageEffect &instance,
+                         const OfxRectI & renderWindow,
+                         const void *srcPixelData,
+                         const OfxRectI & srcBounds,
+                         OFX::PixelComponentEnum srcPixelComponents,
+                         int srcPixelComponentCount,
+                         OFX::BitDepthEnum srcBitDepth,
+                         int srcRowBytes,
+                         void *dstPixelData,
+                         const OfxRectI & dstBounds,
+                         OFX::PixelComponentEnum dstPixelComponents,
+                         int dstPixelComponentCount,
+                         OFX::BitDepthEnum dstBitDepth,
+                         int dstRowBytes)
+{
+    if (dstBitDepth == OFX::eBitDepthUByte) {
+        convertPixelsForDepths<SRCPIX, srcMaxValue, unsigned char, 255>(instance, renderWindow,
+                                                                        srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                                        dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (dstBitDepth == OFX::eBitDepthUShort) {
+        convertPixelsForDepths<SRCPIX, srcMaxValue, unsigned short, 65535>(instance, renderWindow,
+                                                                           srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                                           dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (dstBitDepth == OFX::eBitDepthHalf) {
+        convertPixelsForDepths<SRCPIX, srcMaxValue, OFX::Half, 1>(instance, renderWindow,
+                                                                  srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                                  dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (dstBitDepth == OFX::eBitDepthFloat) {
+        convertPixelsForDepths<SRCPIX, srcMaxValue, float, 1>(instance, renderWindow,
+                                                              srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                              dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else {
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+    }
+}
+
+/** @brief copy srcPixelData to dstPixelData over renderWindow, converting the bit depth and the components
+   (Alpha, RGB or RGBA) of the source to those of the destination.
+
+   If both have the same format, this is copyPixels().
+ */
+inline void
+convertPixels(OFX::ImageEffect &instance,
+              const OfxRectI & renderWindow,
+              const void *srcPixelData,
+              const OfxRectI & srcBounds,
+              OFX::PixelComponentEnum srcPixelComponents,
+              int srcPixelComponentCount,
+              OFX::BitDepthEnum srcBitDepth,
+              int srcRowBytes,
+              void *dstPixelData,
+              const OfxRectI & dstBounds,
+              OFX::PixelComponentEnum dstPixelComponents,
+              int dstPixelComponentCount,
+              OFX::BitDepthEnum dstBitDepth,
+              int dstRowBytes)
+{
+    assert(dstPixelData);
+    if (!srcPixelData) {
+        // no input, be black and transparent
+        return fillBlack(instance, renderWindow,
+                         dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    }
+    if ( (srcPixelComponents == dstPixelComponents) && (srcPixelComponentCount == dstPixelComponentCount) && (srcBitDepth == dstBitDepth) ) {
+        // nothing to convert
+        return copyPixels(instance, renderWindow,
+                          srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                          dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    }
+    if (srcBitDepth == OFX::eBitDepthUByte) {
+        convertPixelsForSrcDepth<unsigned char, 255>(instance, renderWindow,
+                                                     srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                     dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (srcBitDepth == OFX::eBitDepthUShort) {
+        convertPixelsForSrcDepth<unsigned short, 65535>(instance, renderWindow,
+                                                        srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                                        dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (srcBitDepth == OFX::eBitDepthHalf) {
+        convertPixelsForSrcDepth<OFX::Half, 1>(instance, renderWindow,
+                                               srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                               dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else if (srcBitDepth == OFX::eBitDepthFloat) {
+        convertPixelsForSrcDepth<float, 1>(instance, renderWindow,
+                                           srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes,
+                                           dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+    } else {
+        OFX::throwSuiteStatusException(kOfxStatErrFormat);
+    }
+}
+
+inline void
+convertPixels(OFX::ImageEffect &instance,
+              const OfxRectI & renderWindow,
+              const OFX::Image* srcImg,
+              OFX::Image* dstImg)
+{
+    const void* srcPixelData = 0;
+    OfxRectI srcBounds = { 0, 0, 0, 0 };
+    OFX::PixelComponentEnum srcPixelComponents = OFX::ePixelComponentNone;
+    OFX::BitDepthEnum srcBitDepth = OFX::eBitDepthNone;
+    int srcRowBytes = 0;
+    int srcPixelComponentCount = 0;
+    if (srcImg) {
+        getImageData(srcImg, &srcPixelData, &srcBounds, &srcPixelComponents, &srcBitDepth, &srcRowBytes);
+        srcPixelComponentCount = srcImg->getPixelComponentCount();
+    }
+    void* dstPixelData;
+    OfxRectI dstBounds;
+    OFX::PixelComponentEnum dstPixelComponents;
+    OFX::BitDepthEnum dstBitDepth;
+    int dstRowBytes;
+    getImageData(dstImg, &dstPixelData, &dstBounds, &dstPixelComponents, &dstBitDepth, &dstRowBytes);
+    int dstPixelComponentCount = dstImg->getPixelComponentCount();
+    return convertPixels(instance, renderWindow, srcPixelData, srcBounds, srcPixelComponents, srcPixelComponentCount, srcBitDepth, srcRowBytes, dstPixelData, dstBounds, dstPixelComponents, dstPixelComponentCount, dstBitDepth, dstRowBytes);
+}
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsPixelConverter_h
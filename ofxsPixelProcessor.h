@@ -25,10 +25,23 @@
  */
 
 #include <cassert>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <algorithm>
+#include <vector>
+#include <string>
+#include <typeinfo>
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
 
 #include "ofxsImageEffect.h"
 #include "ofxsMultiThread.h"
+#include "ofxsAtomic.h"
+#include "ofxsTimer.h"
+#include "ofxsScratchArena.h"
 
 /** @file This file contains a useful base class that can be used to process images
 
@@ -143,6 +156,179 @@ getPixelAddress(const void* pixelData,
     return (void *) pix;
 }
 
+/** @brief what a PixelRowSegment contains */
+enum PixelRowSegmentKindEnum
+{
+    ePixelRowSegmentBlack = 0, ///< no source pixels: black and transparent
+    ePixelRowSegmentPixels,    ///< contiguous source pixels, pixel x is at pix + (x - x1) * pixelBytes
+    ePixelRowSegmentConstant,  ///< all pixels are equal to the source pixel at pix (nearest boundary condition)
+};
+
+/** @brief a span [x1,x2) of a row, on which the source pixels can be walked without any test */
+struct PixelRowSegment
+{
+    int x1;
+    int x2;
+    PixelRowSegmentKindEnum kind;
+    const void* pix; ///< NULL for ePixelRowSegmentBlack
+};
+
+/** @brief get the longest span starting at x (and ending at most at xEnd) of row y of an image,
+   on which the boundary condition does not change.
+
+   boundary is 0 for Black/Dirichlet, 1 for Nearest/Neumann, 2 for Repeat/Periodic.
+   A whole row is processed by calling this with x = seg.x2 until x reaches xEnd. The y coordinate is
+   mapped by the boundary condition too, so that the caller can work in destination coordinates.
+ */
+inline void
+getPixelRowSegment(const void* pixelData,
+                   const OfxRectI & bounds,
+                   int pixelBytes,
+                   int rowBytes,
+                   int boundary,
+                   int x,
+                   int y,
+                   int xEnd,
+                   PixelRowSegment* seg)
+{
+    assert(x < xEnd);
+    seg->x1 = x;
+    seg->x2 = xEnd;
+    seg->kind = ePixelRowSegmentBlack;
+    seg->pix = 0;
+    if ( !pixelData || (pixelBytes == 0) || (bounds.x2 <= bounds.x1) || (bounds.y2 <= bounds.y1) ) {
+        return;
+    }
+    if ( (y < bounds.y1) || (bounds.y2 <= y) ) {
+        if (boundary == 1) {
+            y = (y < bounds.y1) ? bounds.y1 : (bounds.y2 - 1);
+        } else if (boundary == 2) {
+            int h = bounds.y2 - bounds.y1;
+            y = bounds.y1 + ( (y - bounds.y1) % h + h ) % h;
+        } else {
+            return;
+        }
+    }
+    const char* row = (const char*)pixelData + (size_t)(y - bounds.y1) * rowBytes;
+    if ( (bounds.x1 <= x) && (x < bounds.x2) ) {
+        seg->x2 = std::min(xEnd, bounds.x2);
+        seg->kind = ePixelRowSegmentPixels;
+        seg->pix = row + (size_t)(x - bounds.x1) * pixelBytes;
+    } else if (boundary == 1) {
+        if (x < bounds.x1) {
+            seg->x2 = std::min(xEnd, bounds.x1);
+            seg->pix = row;
+        } else {
+            seg->pix = row + (size_t)(bounds.x2 - 1 - bounds.x1) * pixelBytes;
+        }
+        seg->kind = ePixelRowSegmentConstant;
+    } else if (boundary == 2) {
+        int w = bounds.x2 - bounds.x1;
+        int sx = ( (x - bounds.x1) % w + w ) % w;
+        // the span ends where the source row wraps around
+        seg->x2 = std::min(xEnd, x + (w - sx));
+        seg->kind = ePixelRowSegmentPixels;
+        seg->pix = row + (size_t)sx * pixelBytes;
+    } else if (x < bounds.x1) {
+        // black up to the start of the image
+        seg->x2 = std::min(xEnd, bounds.x1);
+    }
+}
+
+/** @brief same as above, for an OFX::Image (which may be NULL) */
+inline void
+getPixelRowSegment(const OFX::Image* img,
+                   int boundary,
+                   int x,
+                   int y,
+                   int xEnd,
+                   PixelRowSegment* seg)
+{
+    if (!img) {
+        seg->x1 = x;
+        seg->x2 = xEnd;
+        seg->kind = ePixelRowSegmentBlack;
+        seg->pix = 0;
+
+        return;
+    }
+    getPixelRowSegment(img->getPixelData(), img->getBounds(), img->getPixelComponentCount() * getComponentBytes( img->getPixelDepth() ),
+                       img->getRowBytes(), boundary, x, y, xEnd, seg);
+}
+
+/** @brief how PixelProcessor distributes the render window over the threads */
+enum PixelProcessorSchedulingEnum
+{
+    ePixelProcessorSchedulingStripes = 0, ///< one horizontal stripe of equal height per thread (the default)
+    ePixelProcessorSchedulingTiles,       ///< small tiles, pulled by each thread from a shared counter until none are left
+};
+
+/** @brief relative cost of processing one pixel, used by PixelProcessor to choose the number of threads */
+enum PixelProcessorCostEnum
+{
+    ePixelProcessorCostCheap = 0,     ///< memory-bound processing (copy, fill)
+    ePixelProcessorCostNormal,        ///< a few operations per component (the default)
+    ePixelProcessorCostExpensive,     ///< small filters, per-pixel transcendental functions
+    ePixelProcessorCostVeryExpensive, ///< supersampling, large filters
+};
+
+/** @brief keeps track of the measured time per pixel of a processor across renders.
+
+   A plugin which owns one of these (typically as a member of its ImageEffect) and gives it
+   to each processor it creates with PixelProcessor::setCostEstimator() gets the number of
+   threads computed from the time actually spent on the previous renders, rather than from
+   the declared cost class. It may be shared by concurrent renders.
+ */
+class PixelProcessorCostEstimator
+{
+public:
+    PixelProcessorCostEstimator()
+        : _mutex()
+        , _secondsPerPixel(0.)
+        , _nSamples(0)
+    {
+    }
+
+    /** @brief true if at least one render was measured */
+    bool hasEstimate() const
+    {
+        OFX::MultiThread::AutoMutex l(_mutex);
+
+        return _nSamples > 0;
+    }
+
+    /** @brief estimated processing time for one pixel on one thread, in seconds */
+    double getSecondsPerPixel() const
+    {
+        OFX::MultiThread::AutoMutex l(_mutex);
+
+        return _secondsPerPixel;
+    }
+
+    /** @brief record that processing nPixels took the given time, summed over all threads */
+    void addSample(double seconds,
+                   double nPixels)
+    {
+        if ( (seconds <= 0.) || (nPixels <= 0.) ) {
+            return;
+        }
+        double spp = seconds / nPixels;
+        OFX::MultiThread::AutoMutex l(_mutex);
+        if (_nSamples == 0) {
+            _secondsPerPixel = spp;
+        } else {
+            // exponential moving average, so that the estimate follows parameter changes
+            _secondsPerPixel += (spp - _secondsPerPixel) * 0.25;
+        }
+        ++_nSamples;
+    }
+
+private:
+    mutable OFX::MultiThread::Mutex _mutex;
+    double _secondsPerPixel;
+    int _nSamples;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // base class to process images with
 class PixelProcessor
@@ -159,6 +345,19 @@ protected:
     int _dstPixelBytes;
     int _dstRowBytes;
     OfxRectI _renderWindow;               /**< @brief render window to use */
+    PixelProcessorSchedulingEnum _scheduling;
+    int _tileWidth;
+    int _tileHeight;
+    int _nTilesX;                         /**< @brief number of tile columns in the render window */
+    int _nTiles;                          /**< @brief total number of tiles in the render window */
+    volatile int _nextTile;               /**< @brief index of the next tile to process, shared by all threads */
+    double _pixelCost;                    /**< @brief cost of one pixel, relative to ePixelProcessorCostNormal */
+    PixelProcessorCostEstimator *_costEstimator; /**< @brief measured cost, if not NULL */
+    std::vector<OFX::ScratchArena*> _scratchArenas; /**< @brief one scratch arena per thread */
+    unsigned int _nThreads;               /**< @brief number of threads used by the current render */
+    int _statsMode;                       /**< @brief instrumentation of the current render, see getStatsMode() */
+    std::vector<double> _threadStart;     /**< @brief per-thread start time, when instrumented */
+    std::vector<double> _threadEnd;       /**< @brief per-thread end time, when instrumented */
 
 public:
     /** @brief ctor */
@@ -171,10 +370,30 @@ public:
           , _dstBitDepth(OFX::eBitDepthNone)
           , _dstPixelBytes(0)
           , _dstRowBytes(0)
+          , _scheduling(ePixelProcessorSchedulingStripes)
+          , _tileWidth(64)
+          , _tileHeight(64)
+          , _nTilesX(0)
+          , _nTiles(0)
+          , _nextTile(0)
+          , _pixelCost(1.)
+          , _costEstimator(0)
+          , _scratchArenas()
+          , _nThreads(1)
+          , _statsMode(0)
+          , _threadStart()
+          , _threadEnd()
     {
         _renderWindow.x1 = _renderWindow.y1 = _renderWindow.x2 = _renderWindow.y2 = 0;
     }
 
+    virtual ~PixelProcessor()
+    {
+        for (size_t i = 0; i < _scratchArenas.size(); ++i) {
+            delete _scratchArenas[i];
+        }
+    }
+
     /** @brief set the destination image */
     void setDstImg(OFX::Image *v)
     {
@@ -210,12 +429,72 @@ public:
         _renderWindow = rect;
     }
 
-    /** @brief overridden from OFX::MultiThread::Processor. This function is called once on each SMP thread by the base class */
-    void multiThreadFunction(unsigned int threadId,
-                             unsigned int nThreads)
+    /** @brief set how the render window is split between threads.
+       With ePixelProcessorSchedulingTiles, the render window is cut into tiles of tileWidth x tileHeight pixels,
+       and multiThreadProcessImages() is called once per tile, so that threads which get cheap tiles
+       pick up more work. This should be preferred when the cost per pixel varies a lot across the image. */
+    void setScheduling(PixelProcessorSchedulingEnum scheduling,
+                       int tileWidth = 64,
+                       int tileHeight = 64)
+    {
+        assert(tileWidth > 0 && tileHeight > 0);
+        _scheduling = scheduling;
+        _tileWidth = std::max(1, tileWidth);
+        _tileHeight = std::max(1, tileHeight);
+    }
+
+    /** @brief declare the cost class of a pixel, used to choose the number of threads */
+    void setPixelCost(PixelProcessorCostEnum cost)
+    {
+        switch (cost) {
+        case ePixelProcessorCostCheap:
+            _pixelCost = 0.25;
+            break;
+        case ePixelProcessorCostNormal:
+            _pixelCost = 1.;
+            break;
+        case ePixelProcessorCostExpensive:
+            _pixelCost = 16.;
+            break;
+        case ePixelProcessorCostVeryExpensive:
+            _pixelCost = 256.;
+            break;
+        }
+    }
+
+    /** @brief declare the cost of a pixel, relative to ePixelProcessorCostNormal */
+    void setPixelCost(double cost)
+    {
+        assert(cost > 0.);
+        _pixelCost = cost;
+    }
+
+    /** @brief the number of threads to use for nPixels pixels of the given cost (relative to ePixelProcessorCostNormal):
+       each thread gets at least the work of 4096 pixels of cost ePixelProcessorCostNormal, there are at most
+       maxThreads threads, and at least one. */
+    static unsigned int getNumThreadsForPixels(double nPixels,
+                                               double pixelCost,
+                                               unsigned int maxThreads)
+    {
+        double nThreads = nPixels * pixelCost / 4096.;
+
+        if ( nThreads < (double)maxThreads ) {
+            maxThreads = (unsigned int)nThreads;
+        }
+
+        // use at least 1 CPU
+        return std::max(1u, maxThreads);
+    }
+
+    /** @brief the band of rows of window processed by thread threadId out of nThreads in stripe scheduling.
+       @return false if that band is empty (there are more threads than rows) */
+    static bool getStripe(const OfxRectI & window,
+                          unsigned int threadId,
+                          unsigned int nThreads,
+                          OfxRectI* stripe)
     {
         // slice the y range into the number of threads it has
-        unsigned int dy = _renderWindow.y2 - _renderWindow.y1;
+        unsigned int dy = window.y2 - window.y1;
         // the following is equivalent to std::ceil(dy/(double)nThreads);
         unsigned int h = (dy + nThreads - 1) / nThreads;
 
@@ -224,17 +503,33 @@ public:
             h = 1;
         }
         if (threadId * h >= dy) {
-            // empty render subwindow
-            return;
+            return false;
         }
-        unsigned int y1 = _renderWindow.y1 + threadId * h;
         unsigned int step = (threadId + 1) * h;
-        unsigned int y2 = _renderWindow.y1 + (step < dy ? step : dy);
-        OfxRectI win = _renderWindow;
-        win.y1 = y1; win.y2 = y2;
+        *stripe = window;
+        stripe->y1 = window.y1 + threadId * h;
+        stripe->y2 = window.y1 + (step < dy ? step : dy);
 
-        // and render that thread on each
-        multiThreadProcessImages(win);
+        return true;
+    }
+
+    /** @brief measure the render time, and use the previous measures (if any) instead of the declared cost */
+    void setCostEstimator(PixelProcessorCostEstimator *estimator)
+    {
+        _costEstimator = estimator;
+    }
+
+    /** @brief overridden from OFX::MultiThread::Processor. This function is called once on each SMP thread by the base class */
+    void multiThreadFunction(unsigned int threadId,
+                             unsigned int nThreads)
+    {
+        if ( (_statsMode != eStatsNone) && ( threadId < _threadStart.size() ) ) {
+            _threadStart[threadId] = OFX::getTimeSeconds();
+            multiThreadRender(threadId, nThreads);
+            _threadEnd[threadId] = OFX::getTimeSeconds();
+        } else {
+            multiThreadRender(threadId, nThreads);
+        }
     }
 
     /** @brief called before any MP is done */
@@ -250,7 +545,9 @@ public:
     {
     }
 
-    /** @brief called to process everything */
+    /** @brief called to process everything.
+       If the environment variable OFXS_PROCESSOR_STATS is set, each call is timed and reported on stderr
+       (see getStatsMode()). */
     virtual void process(void)
     {
         // _dstPixelData may be NULL (e.g. when doing multi-pass, as in FrameBlend)
@@ -265,23 +562,242 @@ public:
             return;
         }
 
+        _statsMode = getStatsMode();
+        double tStart = (_statsMode != eStatsNone) ? OFX::getTimeSeconds() : 0.;
+
         // call the pre MP pass
         preProcess();
 
-        // make sure there are at least 4096 pixels per CPU and at least 1 line par CPU
-        unsigned int nCPUs = (std::min(_renderWindow.x2 - _renderWindow.x1, 4096) *
-                              (_renderWindow.y2 - _renderWindow.y1)) / 4096;
-        // make sure the number of CPUs is valid (and use at least 1 CPU)
-        nCPUs = std::max(1u, std::min(nCPUs, OFX::MultiThread::getNumCPUs()));
+        unsigned int nCPUs = getNumThreads();
+
+        if (_scheduling == ePixelProcessorSchedulingTiles) {
+            _nTilesX = (_renderWindow.x2 - _renderWindow.x1 + _tileWidth - 1) / _tileWidth;
+            int nTilesY = (_renderWindow.y2 - _renderWindow.y1 + _tileHeight - 1) / _tileHeight;
+            _nTiles = _nTilesX * nTilesY;
+            _nextTile = 0;
+            // no need for more threads than tiles
+            nCPUs = std::min(nCPUs, (unsigned int)_nTiles);
+        }
+
+        // one scratch arena per thread, kept from previous renders by this processor
+        _nThreads = nCPUs;
+        while (_scratchArenas.size() < nCPUs) {
+            _scratchArenas.push_back( new OFX::ScratchArena() );
+        }
+        if (_statsMode != eStatsNone) {
+            _threadStart.assign(nCPUs, 0.);
+            _threadEnd.assign(nCPUs, 0.);
+        }
+
+        double t0 = (_costEstimator || _statsMode != eStatsNone) ? OFX::getTimeSeconds() : 0.;
 
         // call the base multi threading code, should put a pre & post thread calls in too
         multiThread(nCPUs);
 
+        double t1 = (_costEstimator || _statsMode != eStatsNone) ? OFX::getTimeSeconds() : 0.;
+        if ( _costEstimator && !_effect.abort() ) {
+            // assume all threads were busy during the whole time
+            _costEstimator->addSample( (t1 - t0) * nCPUs,
+                                       (double)(_renderWindow.x2 - _renderWindow.x1) * (_renderWindow.y2 - _renderWindow.y1) );
+        }
+
         // call the post MP pass
         postProcess();
+
+        if (_statsMode != eStatsNone) {
+            reportStats(tStart, t0, t1, OFX::getTimeSeconds(), nCPUs);
+        }
     }
 
 protected:
+    enum StatsModeEnum
+    {
+        eStatsNone = 0,
+        eStatsText,
+        eStatsTrace,
+    };
+
+    /** @brief the instrumentation mode, from the OFXS_PROCESSOR_STATS environment variable:
+       - unset, empty or "0": no instrumentation
+       - "trace": Chrome trace events (chrome://tracing, Perfetto), one JSON object per line, each followed by a comma
+         (make a valid trace file by adding a "[" line before the output)
+       - anything else: one line of text per render
+     */
+    static int getStatsMode()
+    {
+        const char* env = std::getenv("OFXS_PROCESSOR_STATS");
+
+        if ( !env || !env[0] || !std::strcmp(env, "0") ) {
+            return eStatsNone;
+        }
+        if ( !std::strcmp(env, "trace") ) {
+            return eStatsTrace;
+        }
+
+        return eStatsText;
+    }
+
+    /** @brief the name of the actual processor class, for the stats */
+    std::string getProcessorName() const
+    {
+        const char* name = typeid(*this).name();
+#ifdef __GNUC__
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(name, 0, 0, &status);
+        if (demangled) {
+            std::string ret = (status == 0) ? demangled : name;
+            std::free(demangled);
+
+            return ret;
+        }
+#endif
+
+        return name;
+    }
+
+    /** @brief print the stats of the last render on stderr. Times are in seconds. */
+    void reportStats(double tStart,
+                     double tMTStart,
+                     double tMTEnd,
+                     double tEnd,
+                     unsigned int nThreads) const
+    {
+        const char* depth = "none";
+        switch (_dstBitDepth) {
+        case OFX::eBitDepthUByte:  depth = "8u"; break;
+        case OFX::eBitDepthUShort: depth = "16u"; break;
+        case OFX::eBitDepthHalf:   depth = "16f"; break;
+        case OFX::eBitDepthFloat:  depth = "32f"; break;
+        default: break;
+        }
+        std::string name = getProcessorName();
+        // the name is printed in a JSON string: replace the characters that would need escaping
+        for (size_t i = 0; i < name.size(); ++i) {
+            if ( (name[i] == '"') || (name[i] == '\\') ) {
+                name[i] = '\'';
+            }
+        }
+        long nPixels = (long)(_renderWindow.x2 - _renderWindow.x1) * (_renderWindow.y2 - _renderWindow.y1);
+
+        if (_statsMode == eStatsTrace) {
+            // timestamps and durations in microseconds. All events of a render are printed at once,
+            // so that the lines of concurrent renders are not mixed.
+            std::string events;
+            char buf[512];
+            const char* phases[3] = { "preProcess", "multiThread", "postProcess" };
+            double times[4] = { tStart, tMTStart, tMTEnd, tEnd };
+            for (int i = 0; i < 3; ++i) {
+                std::sprintf(buf, "{\"name\":\"%s\",\"cat\":\"ofxsPixelProcessor\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"args\":{\"processor\":\"",
+                             phases[i], times[i] * 1e6, (times[i + 1] - times[i]) * 1e6);
+                events += buf;
+                events += name;
+                std::sprintf(buf, "\",\"depth\":\"%s\",\"components\":%d,\"pixels\":%ld,\"threads\":%u,\"tiles\":%d}},\n",
+                             depth, _dstPixelComponentCount, nPixels, nThreads,
+                             (_scheduling == ePixelProcessorSchedulingTiles) ? _nTiles : 0);
+                events += buf;
+            }
+            for (unsigned int i = 0; i < _threadStart.size(); ++i) {
+                std::sprintf(buf, "{\"name\":\"multiThreadProcessImages\",\"cat\":\"ofxsPixelProcessor\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n",
+                             i + 1, _threadStart[i] * 1e6, (_threadEnd[i] - _threadStart[i]) * 1e6);
+                events += buf;
+            }
+            std::fputs(events.c_str(), stderr);
+        } else {
+            // busy time of each thread, to detect load imbalance
+            double busyMin = 0., busyMax = 0., busySum = 0.;
+            for (unsigned int i = 0; i < _threadStart.size(); ++i) {
+                double busy = _threadEnd[i] - _threadStart[i];
+                busyMin = (i == 0) ? busy : std::min(busyMin, busy);
+                busyMax = std::max(busyMax, busy);
+                busySum += busy;
+            }
+            double busyAvg = _threadStart.empty() ? 0. : busySum / _threadStart.size();
+            std::fprintf(stderr,
+                         "ofxsPixelProcessor: processor=\"%s\" depth=%s components=%d pixels=%ld threads=%u scheduling=%s"
+                         " pre_ms=%.3f mt_ms=%.3f post_ms=%.3f busy_min_ms=%.3f busy_avg_ms=%.3f busy_max_ms=%.3f imbalance=%.2f\n",
+                         name.c_str(), depth, _dstPixelComponentCount, nPixels, nThreads,
+                         (_scheduling == ePixelProcessorSchedulingTiles) ? "tiles" : "stripes",
+                         (tMTStart - tStart) * 1e3, (tMTEnd - tMTStart) * 1e3, (tEnd - tMTEnd) * 1e3,
+                         busyMin * 1e3, busyAvg * 1e3, busyMax * 1e3, (busyAvg > 0.) ? busyMax / busyAvg : 1.);
+        }
+    }
+
+    /** @brief render the part of the render window assigned to thread threadId */
+    void multiThreadRender(unsigned int threadId,
+                           unsigned int nThreads)
+    {
+        if (_scheduling == ePixelProcessorSchedulingTiles) {
+            return multiThreadProcessTiles();
+        }
+
+        OfxRectI win;
+        if ( !getStripe(_renderWindow, threadId, nThreads, &win) ) {
+            // empty render subwindow
+            return;
+        }
+
+        // and render that thread on each
+        getScratchArena().reset();
+        multiThreadProcessImages(win);
+    }
+
+    /** @brief the scratch arena of the calling thread.
+       It can be used from multiThreadProcessImages() for temporary buffers, which must not be freed:
+       the memory allocated from it may be reused as soon as multiThreadProcessImages() returns. */
+    OFX::ScratchArena & getScratchArena()
+    {
+        if ( _scratchArenas.empty() ) {
+            // multiThreadProcessImages() was called directly, not from process()
+            _scratchArenas.push_back( new OFX::ScratchArena() );
+        }
+        unsigned int i = (_nThreads > 1) ? OFX::MultiThread::getThreadIndex() : 0;
+        assert( i < _scratchArenas.size() );
+
+        return *_scratchArenas[i];
+    }
+
+    /** @brief the number of threads to use for the current render window (see getNumThreadsForPixels()).
+       A measured cost of 100us is worth 4096 pixels of cost ePixelProcessorCostNormal,
+       and there is at least one line per thread in stripe scheduling. */
+    unsigned int getNumThreads() const
+    {
+        double nPixels = (double)(_renderWindow.x2 - _renderWindow.x1) * (_renderWindow.y2 - _renderWindow.y1);
+        double pixelCost = _pixelCost;
+
+        if ( _costEstimator && _costEstimator->hasEstimate() ) {
+            pixelCost = _costEstimator->getSecondsPerPixel() * (4096. / 1e-4);
+        }
+        unsigned int nCPUs = OFX::MultiThread::getNumCPUs();
+        if (_scheduling == ePixelProcessorSchedulingStripes) {
+            nCPUs = std::min(nCPUs, (unsigned int)(_renderWindow.y2 - _renderWindow.y1));
+        }
+
+        return getNumThreadsForPixels(nPixels, pixelCost, nCPUs);
+    }
+
+    /** @brief process tiles until there are none left. Tiles are numbered in row order, so that
+       threads working at the same time process neighboring tiles. */
+    void multiThreadProcessTiles()
+    {
+        for (;;) {
+            int tile = OFX::Atomic::fetchAndAdd(&_nextTile, 1);
+            if ( (tile >= _nTiles) || _effect.abort() ) {
+                return;
+            }
+            int tx = tile % _nTilesX;
+            int ty = tile / _nTilesX;
+            OfxRectI win;
+            win.x1 = _renderWindow.x1 + tx * _tileWidth;
+            win.x2 = std::min(win.x1 + _tileWidth, _renderWindow.x2);
+            win.y1 = _renderWindow.y1 + ty * _tileHeight;
+            win.y2 = std::min(win.y1 + _tileHeight, _renderWindow.y2);
+
+            getScratchArena().reset();
+            multiThreadProcessImages(win);
+        }
+    }
+
     void* getDstPixelAddress(int x,
                              int y) const
     {
@@ -399,6 +915,118 @@ public:
     }
 
 protected:
+    /** @brief get the longest span of source pixels for destination row y, starting at x and ending at most at xEnd,
+       on which the source can be walked without tests (see getPixelRowSegment()).
+
+       A typical row loop is:
+       for (int x = procWindow.x1; x < procWindow.x2; x = seg.x2) {
+           getSrcRowSegment(x, y, procWindow.x2, &seg);
+           const PIX* srcPix = (const PIX*)seg.pix;
+           int srcStep = (seg.kind == ePixelRowSegmentPixels) ? nComponents : 0;
+           ...
+       }
+     */
+    void getSrcRowSegment(int x,
+                          int y,
+                          int xEnd,
+                          PixelRowSegment* seg) const
+    {
+        getPixelRowSegment(_srcPixelData, _srcBounds, _srcPixelBytes, _srcRowBytes, _srcBoundary, x, y, xEnd, seg);
+    }
+
+    /** @brief copy the source pixels for destination row y, from x1 - halo to x2 + halo, into rowBuf,
+       with the boundary conditions applied.
+
+       rowBuf must hold (x2 - x1 + 2 * halo) source pixels. The returned pointer is the address of
+       pixel x1 in rowBuf, so that pixels from -halo to x2 - x1 + halo - 1 can be read relative to it
+       without any test. */
+    const void* fillSrcRow(int x1,
+                           int x2,
+                           int y,
+                           int halo,
+                           void *rowBuf) const
+    {
+        assert(x1 < x2 && halo >= 0);
+        char *dst = (char *)rowBuf;
+        PixelRowSegment seg;
+
+        for (int x = x1 - halo; x < x2 + halo; x = seg.x2) {
+            getSrcRowSegment(x, y, x2 + halo, &seg);
+            size_t nBytes = (size_t)(seg.x2 - seg.x1) * _srcPixelBytes;
+            switch (seg.kind) {
+            case ePixelRowSegmentBlack:
+                std::memset(dst, 0, nBytes);
+                break;
+            case ePixelRowSegmentPixels:
+                std::memcpy(dst, seg.pix, nBytes);
+                break;
+            case ePixelRowSegmentConstant:
+                for (size_t i = 0; i < nBytes; i += _srcPixelBytes) {
+                    std::memcpy(dst + i, seg.pix, _srcPixelBytes);
+                }
+                break;
+            }
+            dst += nBytes;
+        }
+
+        return (const char *)rowBuf + (size_t)halo * _srcPixelBytes;
+    }
+
+    /** @brief a ring buffer of padded source rows (see fillSrcRow()), for neighbourhood filters.
+
+       When the destination rows are processed in order, each source row is only built once,
+       and a filter of radius (haloX, haloY) can read the 2*haloY+1 rows around the current row
+       with no boundary tests.
+     */
+    struct SrcRowCache
+    {
+        int x1;
+        int x2;
+        int haloX;
+        int nRows;         // number of rows in the ring
+        size_t rowBytes;   // size of a padded row
+        char *data;        // nRows padded rows
+        int *rowY;         // the source row y held by each slot of the ring
+    };
+
+    /** @brief set up a row cache for the destination columns [x1,x2) and a filter of radius (haloX, haloY).
+       Its memory comes from the scratch arena, so it is only valid during the current multiThreadProcessImages() call. */
+    void initSrcRowCache(SrcRowCache *cache,
+                         int x1,
+                         int x2,
+                         int haloX,
+                         int haloY)
+    {
+        assert(x1 < x2 && haloX >= 0 && haloY >= 0);
+        cache->x1 = x1;
+        cache->x2 = x2;
+        cache->haloX = haloX;
+        cache->nRows = 2 * haloY + 1;
+        // keep rows aligned for SIMD loads
+        cache->rowBytes = ( (size_t)(x2 - x1 + 2 * haloX) * _srcPixelBytes + 15 ) & ~(size_t)15;
+        cache->data = (char *)getScratchArena().allocate(cache->rowBytes * cache->nRows);
+        cache->rowY = getScratchArena().allocateArray<int>(cache->nRows);
+        for (int i = 0; i < cache->nRows; ++i) {
+            cache->rowY[i] = INT_MIN;
+        }
+    }
+
+    /** @brief return the address of pixel x1 in the padded source row for destination row y,
+       building it if it is not in the cache. The row is valid until a row more than 2*haloY rows away is requested. */
+    const void* getCachedSrcRow(SrcRowCache *cache,
+                                int y) const
+    {
+        int slot = positive_modulo(y, cache->nRows);
+        char *row = cache->data + slot * cache->rowBytes;
+
+        if (cache->rowY[slot] != y) {
+            fillSrcRow(cache->x1, cache->x2, y, cache->haloX, row);
+            cache->rowY[slot] = y;
+        }
+
+        return row + (size_t)cache->haloX * _srcPixelBytes;
+    }
+
     const void* getSrcPixelAddress(int x,
                                    int y) const
     {
@@ -0,0 +1,170 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * ScratchArena: a bump allocator for temporary buffers (row buffers, sample tables, intermediate tiles).
+ */
+
+#ifndef openfx_supportext_ofxsScratchArena_h
+#define openfx_supportext_ofxsScratchArena_h
+
+#include <cassert>
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace OFX {
+/** @brief A bump allocator: allocate() returns memory from large blocks, which are only released
+   all at once by reset().
+
+   Memory is kept after reset(), so that once the arena has grown to the size needed by a render,
+   subsequent renders do not touch the heap. If more than one block was needed, reset() replaces
+   them by a single block of the total size.
+
+   An arena must not be used by several threads at the same time (see PixelProcessor::getScratchArena()).
+ */
+class ScratchArena
+{
+public:
+    enum { kArrayAlignment = 16 };
+
+    explicit ScratchArena(size_t initialSize = 0)
+        : _blocks()
+        , _current(0)
+        , _used(0)
+    {
+        if (initialSize > 0) {
+            addBlock(initialSize);
+        }
+    }
+
+    ~ScratchArena()
+    {
+        freeBlocks();
+    }
+
+    /** @brief return nBytes of uninitialized memory, aligned on alignment bytes (a power of two) */
+    void* allocate(size_t nBytes,
+                   size_t alignment = 16)
+    {
+        assert( alignment > 0 && (alignment & (alignment - 1)) == 0 );
+        while ( _current < _blocks.size() ) {
+            Block & b = _blocks[_current];
+            size_t start = alignUp( (size_t)b.data + _used, alignment ) - (size_t)b.data;
+            if (start + nBytes <= b.size) {
+                _used = start + nBytes;
+
+                return b.data + start;
+            }
+            // try the next block, if any
+            ++_current;
+            _used = 0;
+        }
+        // no more space: add a block, at least twice as large as the previous one
+        size_t size = _blocks.empty() ? (size_t)kMinBlockSize : 2 * _blocks.back().size;
+        if (size < nBytes + alignment) {
+            size = nBytes + alignment;
+        }
+        addBlock(size);
+        _current = _blocks.size() - 1;
+
+        return allocate(nBytes, alignment);
+    }
+
+    /** @brief allocate an array of n elements of type T (which should be a POD type: no constructor is called).
+
+       The array is aligned on kArrayAlignment bytes, which suits SSE loads and stores and all
+       the scalar types. Use allocate() for a stricter alignment.
+     */
+    template <class T>
+    T* allocateArray(size_t n)
+    {
+        return (T*)allocate(n * sizeof(T), kArrayAlignment);
+    }
+
+    /** @brief release everything that was allocated since the last reset() */
+    void reset()
+    {
+        if (_blocks.size() > 1) {
+            size_t total = capacity();
+            freeBlocks();
+            addBlock(total);
+        }
+        _current = 0;
+        _used = 0;
+    }
+
+    /** @brief total size of the memory held by the arena */
+    size_t capacity() const
+    {
+        size_t total = 0;
+
+        for (size_t i = 0; i < _blocks.size(); ++i) {
+            total += _blocks[i].size;
+        }
+
+        return total;
+    }
+
+private:
+    enum { kMinBlockSize = 64 * 1024 };
+
+    struct Block
+    {
+        char* data;
+        size_t size;
+    };
+
+    static size_t alignUp(size_t p,
+                          size_t alignment)
+    {
+        return (p + alignment - 1) & ~(alignment - 1);
+    }
+
+    void addBlock(size_t size)
+    {
+        Block b;
+
+        b.data = (char*)std::malloc(size);
+        if (!b.data) {
+            throw std::bad_alloc();
+        }
+        b.size = size;
+        _blocks.push_back(b);
+    }
+
+    void freeBlocks()
+    {
+        for (size_t i = 0; i < _blocks.size(); ++i) {
+            std::free(_blocks[i].data);
+        }
+        _blocks.clear();
+    }
+
+    // non-copyable
+    ScratchArena(const ScratchArena &);
+    ScratchArena & operator=(const ScratchArena &);
+
+    std::vector<Block> _blocks;
+    size_t _current; // block currently used for allocation
+    size_t _used;    // bytes used in the current block
+};
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsScratchArena_h
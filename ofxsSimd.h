@@ -0,0 +1,397 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * SIMD helpers.
+ *
+ * OFXS_USE_SSE2 is defined when SSE2 can be used without a runtime check (it is always available
+ * on x86-64). Define OFXS_NO_SIMD to disable all SIMD code. Code using these helpers must always
+ * keep a scalar version, which is used on other architectures.
+ */
+
+#ifndef openfx_supportext_ofxsSimd_h
+#define openfx_supportext_ofxsSimd_h
+
+#include <cstring>
+
+#if !defined(OFXS_NO_SIMD) && ( defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) )
+#define OFXS_USE_SSE2 1
+#endif
+
+#ifdef OFXS_USE_SSE2
+#include <emmintrin.h>
+
+namespace OFX {
+namespace Simd {
+/** @brief round v (which must be in [0, 2^23]) to the nearest integer, halfway cases away from zero.
+
+   This is the same as adding 0.5 and truncating in double precision (see ofxsClampIfInt()): adding 0.5f
+   in single precision would round up the values just below n + 0.5.
+ */
+inline __m128i
+roundPositive(__m128 v)
+{
+    __m128i i = _mm_cvttps_epi32(v);
+    __m128 frac = _mm_sub_ps( v, _mm_cvtepi32_ps(i) );
+
+    // the comparison gives -1 where the fractional part is at least 0.5
+    return _mm_sub_epi32( i, _mm_castps_si128( _mm_cmpge_ps( frac, _mm_set1_ps(0.5f) ) ) );
+}
+
+/** @brief load/store pixels of type PIX, with values in [0, maxValue], to/from the four lanes of a __m128.
+
+   Stores clamp integer types to [0, maxValue] and round them (add 0.5 and truncate), like ofxsClampIfInt().
+   Float types are not clamped. Only the types used for OFX images are supported: supported is 0 for the others.
+ */
+template <class PIX, int maxValue>
+struct PixelIO
+{
+    enum { supported = 0 };
+};
+
+template <>
+struct PixelIO<float, 1>
+{
+    enum { supported = 1 };
+
+    static __m128 load4(const float *p) { return _mm_loadu_ps(p); }
+
+    /// load 3 components, the last lane is 0
+    static __m128 load3(const float *p)
+    {
+        return _mm_movelh_ps( _mm_castpd_ps( _mm_load_sd( (const double *)p ) ), _mm_load_ss(p + 2) );
+    }
+
+    static void store4(float *p,
+                       __m128 v)
+    {
+        _mm_storeu_ps(p, v);
+    }
+
+    static void store3(float *p,
+                       __m128 v)
+    {
+        _mm_store_sd( (double *)p, _mm_castps_pd(v) );
+        _mm_store_ss( p + 2, _mm_movehl_ps(v, v) );
+    }
+
+    /// load 16 consecutive values
+    static void load16(const float *p,
+                       __m128 v[4])
+    {
+        v[0] = _mm_loadu_ps(p);
+        v[1] = _mm_loadu_ps(p + 4);
+        v[2] = _mm_loadu_ps(p + 8);
+        v[3] = _mm_loadu_ps(p + 12);
+    }
+
+    /// store 16 consecutive values
+    static void store16(float *p,
+                        const __m128 v[4])
+    {
+        _mm_storeu_ps(p, v[0]);
+        _mm_storeu_ps(p + 4, v[1]);
+        _mm_storeu_ps(p + 8, v[2]);
+        _mm_storeu_ps(p + 12, v[3]);
+    }
+};
+
+template <>
+struct PixelIO<unsigned char, 255>
+{
+    enum { supported = 1 };
+
+    static __m128 fromInt(int packed)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i i = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+
+        return _mm_cvtepi32_ps( _mm_unpacklo_epi16(i, zero) );
+    }
+
+    /// clamp to [0,255] and round
+    static __m128i roundToInt(__m128 v)
+    {
+        v = _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ), _mm_set1_ps(255.f) );
+
+        return roundPositive(v);
+    }
+
+    static int toInt(__m128 v)
+    {
+        __m128i i = roundToInt(v);
+
+        i = _mm_packs_epi32(i, i);
+
+        return _mm_cvtsi128_si32( _mm_packus_epi16(i, i) );
+    }
+
+    static __m128 load4(const unsigned char *p)
+    {
+        int packed;
+
+        std::memcpy(&packed, p, 4);
+
+        return fromInt(packed);
+    }
+
+    static __m128 load3(const unsigned char *p)
+    {
+        return fromInt( p[0] | (p[1] << 8) | (p[2] << 16) );
+    }
+
+    static void store4(unsigned char *p,
+                       __m128 v)
+    {
+        int packed = toInt(v);
+
+        std::memcpy(p, &packed, 4);
+    }
+
+    static void store3(unsigned char *p,
+                       __m128 v)
+    {
+        int packed = toInt(v);
+
+        std::memcpy(p, &packed, 3);
+    }
+
+    static void load16(const unsigned char *p,
+                       __m128 v[4])
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i i = _mm_loadu_si128( (const __m128i *)p );
+        __m128i lo = _mm_unpacklo_epi8(i, zero);
+        __m128i hi = _mm_unpackhi_epi8(i, zero);
+
+        v[0] = _mm_cvtepi32_ps( _mm_unpacklo_epi16(lo, zero) );
+        v[1] = _mm_cvtepi32_ps( _mm_unpackhi_epi16(lo, zero) );
+        v[2] = _mm_cvtepi32_ps( _mm_unpacklo_epi16(hi, zero) );
+        v[3] = _mm_cvtepi32_ps( _mm_unpackhi_epi16(hi, zero) );
+    }
+
+    static void store16(unsigned char *p,
+                        const __m128 v[4])
+    {
+        __m128i lo = _mm_packs_epi32( roundToInt(v[0]), roundToInt(v[1]) );
+        __m128i hi = _mm_packs_epi32( roundToInt(v[2]), roundToInt(v[3]) );
+
+        _mm_storeu_si128( (__m128i *)p, _mm_packus_epi16(lo, hi) );
+    }
+};
+
+template <>
+struct PixelIO<unsigned short, 65535>
+{
+    enum { supported = 1 };
+
+    static __m128 fromInt(__m128i packed)
+    {
+        return _mm_cvtepi32_ps( _mm_unpacklo_epi16( packed, _mm_setzero_si128() ) );
+    }
+
+    /// clamp to [0,65535], round, and shift to the signed range [-32768,32767]
+    static __m128i roundToSignedInt(__m128 v)
+    {
+        v = _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ), _mm_set1_ps(65535.f) );
+        __m128i i = roundPositive(v);
+
+        // there is no unsigned saturating pack in SSE2: shift to the signed range, pack, and shift back
+        return _mm_sub_epi32( i, _mm_set1_epi32(32768) );
+    }
+
+    static __m128i toInt(__m128 v)
+    {
+        __m128i i = roundToSignedInt(v);
+
+        i = _mm_packs_epi32(i, i);
+
+        return _mm_xor_si128( i, _mm_set1_epi16( (short)0x8000 ) );
+    }
+
+    static __m128 load4(const unsigned short *p)
+    {
+        return fromInt( _mm_loadl_epi64( (const __m128i *)p ) );
+    }
+
+    static __m128 load3(const unsigned short *p)
+    {
+        unsigned short tmp[4] = { p[0], p[1], p[2], 0 };
+
+        return fromInt( _mm_loadl_epi64( (const __m128i *)tmp ) );
+    }
+
+    static void store4(unsigned short *p,
+                       __m128 v)
+    {
+        _mm_storel_epi64( (__m128i *)p, toInt(v) );
+    }
+
+    static void store3(unsigned short *p,
+                       __m128 v)
+    {
+        unsigned short tmp[8];
+
+        _mm_storeu_si128( (__m128i *)tmp, toInt(v) );
+        p[0] = tmp[0];
+        p[1] = tmp[1];
+        p[2] = tmp[2];
+    }
+
+    static void load16(const unsigned short *p,
+                       __m128 v[4])
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i lo = _mm_loadu_si128( (const __m128i *)p );
+        __m128i hi = _mm_loadu_si128( (const __m128i *)(p + 8) );
+
+        v[0] = _mm_cvtepi32_ps( _mm_unpacklo_epi16(lo, zero) );
+        v[1] = _mm_cvtepi32_ps( _mm_unpackhi_epi16(lo, zero) );
+        v[2] = _mm_cvtepi32_ps( _mm_unpacklo_epi16(hi, zero) );
+        v[3] = _mm_cvtepi32_ps( _mm_unpackhi_epi16(hi, zero) );
+    }
+
+    static void store16(unsigned short *p,
+                        const __m128 v[4])
+    {
+        const __m128i sign = _mm_set1_epi16( (short)0x8000 );
+        __m128i lo = _mm_packs_epi32( roundToSignedInt(v[0]), roundToSignedInt(v[1]) );
+        __m128i hi = _mm_packs_epi32( roundToSignedInt(v[2]), roundToSignedInt(v[3]) );
+
+        _mm_storeu_si128( (__m128i *)p, _mm_xor_si128(lo, sign) );
+        _mm_storeu_si128( (__m128i *)(p + 8), _mm_xor_si128(hi, sign) );
+    }
+};
+
+/// load nComponents (3 or 4) components
+template <class PIX, int maxValue, int nComponents>
+inline __m128
+loadPixel(const PIX *p)
+{
+    return (nComponents == 4) ? PixelIO<PIX, maxValue>::load4(p) : PixelIO<PIX, maxValue>::load3(p);
+}
+
+/// store nComponents (3 or 4) components
+template <class PIX, int maxValue, int nComponents>
+inline void
+storePixel(PIX *p,
+           __m128 v)
+{
+    if (nComponents == 4) {
+        PixelIO<PIX, maxValue>::store4(p, v);
+    } else {
+        PixelIO<PIX, maxValue>::store3(p, v);
+    }
+}
+
+/// broadcast lane 3 (alpha) to all lanes
+inline __m128
+splatAlpha(__m128 v)
+{
+    return _mm_shuffle_ps( v, v, _MM_SHUFFLE(3, 3, 3, 3) );
+}
+
+/// replace lane 3 of v by lane 3 of w
+inline __m128
+setAlpha(__m128 v,
+         __m128 w)
+{
+    const __m128 rgbMask = _mm_castsi128_ps( _mm_set_epi32(0, -1, -1, -1) );
+
+    return _mm_or_ps( _mm_and_ps(rgbMask, v), _mm_andnot_ps(rgbMask, w) );
+}
+
+/// select a where mask is set, else b
+inline __m128
+select(__m128 mask,
+       __m128 a,
+       __m128 b)
+{
+    return _mm_or_ps( _mm_and_ps(mask, a), _mm_andnot_ps(mask, b) );
+}
+
+/** @brief set nBytes of dst to zero with non-temporal stores, which bypass the cache.
+   Only worth it for buffers much larger than the cache, which are not read back soon. */
+inline void
+streamZero(void *dst,
+           size_t nBytes)
+{
+    char *p = (char *)dst;
+    // the stores must be aligned on 16 bytes
+    size_t head = ( 16 - ( (size_t)p & 15 ) ) & 15;
+
+    if (head > nBytes) {
+        head = nBytes;
+    }
+    std::memset(p, 0, head);
+    p += head;
+    nBytes -= head;
+    const __m128i zero = _mm_setzero_si128();
+    for (; nBytes >= 64; nBytes -= 64, p += 64) {
+        _mm_stream_si128( (__m128i *)p, zero );
+        _mm_stream_si128( (__m128i *)(p + 16), zero );
+        _mm_stream_si128( (__m128i *)(p + 32), zero );
+        _mm_stream_si128( (__m128i *)(p + 48), zero );
+    }
+    for (; nBytes >= 16; nBytes -= 16, p += 16) {
+        _mm_stream_si128( (__m128i *)p, zero );
+    }
+    std::memset(p, 0, nBytes);
+    // non-temporal stores are weakly ordered
+    _mm_sfence();
+}
+
+/** @brief copy nBytes from src to dst (which must not overlap) with non-temporal stores (see streamZero()) */
+inline void
+streamCopy(void *dst,
+           const void *src,
+           size_t nBytes)
+{
+    char *p = (char *)dst;
+    const char *s = (const char *)src;
+    size_t head = ( 16 - ( (size_t)p & 15 ) ) & 15;
+
+    if (head > nBytes) {
+        head = nBytes;
+    }
+    std::memcpy(p, s, head);
+    p += head;
+    s += head;
+    nBytes -= head;
+    for (; nBytes >= 64; nBytes -= 64, p += 64, s += 64) {
+        __m128i a = _mm_loadu_si128( (const __m128i *)s );
+        __m128i b = _mm_loadu_si128( (const __m128i *)(s + 16) );
+        __m128i c = _mm_loadu_si128( (const __m128i *)(s + 32) );
+        __m128i d = _mm_loadu_si128( (const __m128i *)(s + 48) );
+        _mm_stream_si128( (__m128i *)p, a );
+        _mm_stream_si128( (__m128i *)(p + 16), b );
+        _mm_stream_si128( (__m128i *)(p + 32), c );
+        _mm_stream_si128( (__m128i *)(p + 48), d );
+    }
+    for (; nBytes >= 16; nBytes -= 16, p += 16, s += 16) {
+        _mm_stream_si128( (__m128i *)p, _mm_loadu_si128( (const __m128i *)s ) );
+    }
+    std::memcpy(p, s, nBytes);
+    _mm_sfence();
+}
+} // namespace Simd
+} // namespace OFX
+
+#endif // ifdef OFXS_USE_SSE2
+
+#endif // ifndef openfx_supportext_ofxsSimd_h
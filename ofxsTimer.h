@@ -0,0 +1,58 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-supportext <https://github.com/devernay/openfx-supportext>,
+ * Copyright (C) 2015 INRIA
+ *
+ * openfx-supportext is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-supportext is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-supportext.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Wall-clock time, for timing renders.
+ *
+ * This header is included by ofxsPixelProcessor.h, so it must not include <windows.h>:
+ * the two Windows functions it needs are declared here, exactly as in <windows.h>.
+ */
+
+#ifndef openfx_supportext_ofxsTimer_h
+#define openfx_supportext_ofxsTimer_h
+
+#ifdef _WIN32
+// LARGE_INTEGER is a union _LARGE_INTEGER whose QuadPart is a 64-bit integer
+union _LARGE_INTEGER;
+extern "C" __declspec(dllimport) int __stdcall QueryPerformanceCounter(union _LARGE_INTEGER *lpPerformanceCount);
+extern "C" __declspec(dllimport) int __stdcall QueryPerformanceFrequency(union _LARGE_INTEGER *lpFrequency);
+#else
+#include <sys/time.h>
+#endif
+
+namespace OFX {
+/// return a monotonic-enough wall-clock time, in seconds. Only differences between two values are meaningful.
+inline double
+getTimeSeconds()
+{
+#ifdef _WIN32
+    long long freq, t;
+    QueryPerformanceFrequency( reinterpret_cast<union _LARGE_INTEGER *>(&freq) );
+    QueryPerformanceCounter( reinterpret_cast<union _LARGE_INTEGER *>(&t) );
+
+    return (double)t / (double)freq;
+#else
+    struct timeval t;
+    gettimeofday(&t, 0);
+
+    return t.tv_sec + t.tv_usec * 1e-6;
+#endif
+}
+} // namespace OFX
+
+#endif // ifndef openfx_supportext_ofxsTimer_h